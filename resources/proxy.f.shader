@@ -0,0 +1,8 @@
+#version 150
+
+//colour writes are disabled, only the samples passing the depth test are counted
+out vec4 finalColor;
+
+void main() {
+    finalColor = vec4(1.0);
+}
\ No newline at end of file
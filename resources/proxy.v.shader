@@ -0,0 +1,25 @@
+#version 150
+
+struct Fog {
+    vec4 color;
+    float density;
+    float start;
+    float end;
+    int eq;
+};
+
+//per-frame state, shared by every program (gk3d::FrameState)
+layout(std140) uniform Frame {
+    mat4 camera;
+    vec3 cameraPosition;
+    Fog fog;
+};
+
+//world-space bounding box of the tested object, drawn for gk3d::OcclusionCuller
+uniform mat4 model;
+
+in vec3 vert;
+
+void main() {
+    gl_Position = camera*model*vec4(vert,1);
+}
\ No newline at end of file
@@ -1,45 +1,61 @@
 #version 150
 
-uniform mat4 model;
-uniform vec3 cameraPosition;
+#define MAX_TEXTURES 10
+//the scene's textures, one per layer (gk3d::TextureArray), blended in order
+uniform sampler2DArray layers;
 uniform int numTextures;
-uniform sampler2D tex[10];
-uniform float materialShininess;
-uniform vec4 materialSpecularColor;
-uniform vec4 materialDiffuseColor;
-uniform vec4 materialAmbientColor;
+uniform int textureLayers[MAX_TEXTURES];
+uniform int textureWraps[MAX_TEXTURES]; //0 repeat, 1 mirrored repeat, 2 clamp to edge, 3 clamp to border
 uniform float useTexture;
 
+struct Fog {
+    vec4 color;
+    float density;
+    float start;
+    float end;
+    int eq;
+};
+
+//per-frame state, shared by every program (gk3d::FrameState)
+layout(std140) uniform Frame {
+    mat4 camera;
+    vec3 cameraPosition;
+    Fog fog;
+};
+
 #define MAX_LIGHTS 10
-uniform int numLights;
-uniform struct Light {
+struct Light {
    vec4 position;
    vec3 intensities; //a.k.a the color of the light
    float attenuation;
-   float ambientCoefficient;
-   float coneAngle;
    vec3 coneDirection;
-} lights[MAX_LIGHTS];
+   float coneAngle;
+   float ambientCoefficient;
+};
 
+layout(std140) uniform Lights {
+    int numLights;
+    Light lights[MAX_LIGHTS];
+};
+
+#define MAX_MATERIALS 64
 struct Material {
     vec4 specularColor;
     vec4 diffuseColor;
     vec4 ambientColor;
     float shininess;
-} material;
+};
 
-uniform struct Fog {
-    vec4 color;
-    float density;
-    float start;
-    float end;
-    int eq;
-} fog;
+//every material of the scene (gk3d::MaterialTable)
+layout(std140) uniform Materials {
+    Material materials[MAX_MATERIALS];
+};
 
 in vec2 fragTexCoord;
 in vec3 fragNormal;
 in vec3 fragVert;
 in vec4 viewCoord;
+flat in uint fragMaterial;
 
 out vec4 finalColor;
 
@@ -80,6 +96,22 @@ vec3 ApplyLight(Light light, vec3 surfaceColor, vec3 normal, vec3 surfacePos, ve
     return ambient + attenuation*(diffuse + specular);
 }
 
+//samples a layer with its own wrap mode; the array itself repeats
+vec4 sample_layer(int layer, int wrap, vec2 uv) {
+    vec2 wrapped = uv;
+    if (wrap == 1) {
+        wrapped = 1.0 - abs(mod(uv, 2.0) - 1.0);
+    } else if (wrap == 2) {
+        vec2 halfTexel = 0.5 / vec2(textureSize(layers, 0).xy);
+        wrapped = clamp(uv, halfTexel, 1.0 - halfTexel);
+    }
+    //gradients of the unwrapped coordinates keep the mip level steady across the folds
+    vec4 color = textureGrad(layers, vec3(wrapped, layer), dFdx(uv), dFdy(uv));
+    if (wrap == 3 && (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))))
+        color = vec4(0.0);
+    return color;
+}
+
 float fog_factor(Fog fog, float viewCoord) {
     float result=1.0;
     if (fog.eq==0) {
@@ -95,28 +127,23 @@ float fog_factor(Fog fog, float viewCoord) {
 
 void main() {
 
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 normal=normalize(transpose(inverse(mat3(model)))*fragNormal);
-    vec3 surfacePos=vec3(model*vec4(fragVert,1));
-    vec4 surfaceColor=vec4(materialDiffuseColor);
+    vec3 normal=normalize(fragNormal);
+    vec3 surfacePos=fragVert;
+    Material material=materials[fragMaterial];
+    vec4 surfaceColor=material.diffuseColor;
     vec3 surfaceToCamera=normalize(cameraPosition-surfacePos);
 
-    material.specularColor=materialSpecularColor;
-    material.ambientColor=materialAmbientColor;
-    material.diffuseColor=materialDiffuseColor;
-    material.shininess=materialShininess;
-
     if (useTexture==1.0) {
         vec4 tcolor=vec4(0,0,0,0);
         for (int i=0; i<numTextures; i++) {
-            vec4 t=texture(tex[i],fragTexCoord);
+            vec4 t=sample_layer(textureLayers[i],textureWraps[i],fragTexCoord);
             tcolor=mix(tcolor,t,t.a);
         }
         surfaceColor=tcolor;
         material.specularColor=surfaceColor;
         material.ambientColor=surfaceColor;
         material.diffuseColor=surfaceColor;
-        material.shininess=materialShininess+10;
+        material.shininess=material.shininess+10;
     }
 
     vec3 linearColor = vec3(0);
@@ -1,21 +1,58 @@
 #version 150
 
-uniform mat4 camera;
-uniform mat4 model;
+struct Fog {
+    vec4 color;
+    float density;
+    float start;
+    float end;
+    int eq;
+};
 
+//per-frame state, shared by every program (gk3d::FrameState)
+layout(std140) uniform Frame {
+    mat4 camera;
+    vec3 cameraPosition;
+    Fog fog;
+};
+
+//quantised positions and packed normals, see gk3d::VertexFormat
 in vec3 vert;
 in vec3 vertNormal;
 in vec2 vertTexCoord;
+in uint vertMaterial; //index into the Materials block
+
+//per-instance transforms, streamed by gk3d::RenderQueue
+in mat4 instanceModel;
+in mat3 instanceNormalMatrix;
 
 out vec3 fragNormal;
 out vec3 fragVert;
 out vec2 fragTexCoord;
 out vec4 viewCoord;
+flat out uint fragMaterial;
+
+//per-mesh dequantisation (gk3d::Mesh)
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform int octahedralNormals;
+
+//unfolds a normal from the octahedron; the fragment shader normalises it
+vec3 DecodeOctahedral(vec2 e) {
+    vec3 n=vec3(e,1.0-abs(e.x)-abs(e.y));
+    if (n.z<0.0)
+        n.xy=(1.0-abs(n.yx))*vec2(n.x>=0.0 ? 1.0 : -1.0, n.y>=0.0 ? 1.0 : -1.0);
+    return n;
+}
 
 void main() {
-    fragVert=vert;
-    viewCoord=model*vec4(vert,1);
-    fragNormal=vertNormal;
+    vec3 position=positionOffset+vert*positionScale;
+    vec3 normal=octahedralNormals==1 ? DecodeOctahedral(vertNormal.xy) : vertNormal;
+
+    //lighting is done in world space
+    viewCoord=instanceModel*vec4(position,1);
+    fragVert=vec3(viewCoord);
+    fragNormal=instanceNormalMatrix*normal;
     fragTexCoord=vertTexCoord;
-    gl_Position = camera*model*vec4(vert, 1); //order multiplication : right to left
+    fragMaterial=vertMaterial;
+    gl_Position = camera*viewCoord; //order multiplication : right to left
 }
\ No newline at end of file
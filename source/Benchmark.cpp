@@ -0,0 +1,340 @@
+#include "Benchmark.h"
+#include "Helper.h"
+#include "gk3d/AssetCache.h"
+#include "gk3d/Bitmap.h"
+#include "gk3d/BitmapView.h"
+#include "gk3d/BlockCompression.h"
+#include "gk3d/MipGenerator.h"
+#include "gk3d/ModelImport.h"
+#include "gk3d/ObjParser.h"
+
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static const char* const BenchmarkTextures[] = {"stone.png", "court_mat.png", "olympic.png", "parquet.jpg"};
+static const char* const BenchmarkModels[] = {"spotlight.obj", "Volleyball.obj", "bench.obj"};
+static const char* const BenchmarkObjFiles[] = {"Volleyball.obj", "spotlight.obj"};
+
+// seconds every measurement repeats its work for
+static const double MinSeconds = 0.5;
+
+static double Now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// expands any bitmap format to 4 bytes per pixel
+static std::vector<unsigned char> ToRGBA(const gk3d::Bitmap& bitmap) {
+    const size_t pixels = (size_t) bitmap.width() * bitmap.height();
+    const int channels = bitmap.format();
+    std::vector<unsigned char> rgba(pixels * 4);
+    for (size_t i = 0; i < pixels; ++i) {
+        const unsigned char* src = bitmap.pixelBuffer() + i * channels;
+        unsigned char* dest = &rgba[i * 4];
+        dest[0] = src[0];
+        dest[1] = channels >= 3 ? src[1] : src[0];
+        dest[2] = channels >= 3 ? src[2] : src[0];
+        dest[3] = channels == 4 ? src[3] : channels == 2 ? src[1] : 255;
+    }
+    return rgba;
+}
+
+static void BenchmarkBlockCompression(const std::vector<std::vector<unsigned char> >& images, const std::vector<gk3d::Bitmap>& bitmaps) {
+    static const char* const formatNames[] = {"BC1", "BC3", "BC4", "BC5"};
+    const unsigned hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::cout << "Block compression (MB/s of RGBA input, 1 / " << hardwareThreads << " threads):" << std::endl;
+    for (int format = gk3d::BlockFormat_BC1; format <= gk3d::BlockFormat_BC5; ++format) {
+        double throughput[2];
+        unsigned threadCounts[2] = {1, hardwareThreads};
+        for (int t = 0; t < 2; ++t) {
+            std::vector<unsigned char> blocks;
+            size_t bytes = 0;
+            double start = Now(), elapsed = 0.0;
+            do {
+                for (size_t i = 0; i < images.size(); ++i) {
+                    const gk3d::Bitmap& bitmap = bitmaps[i];
+                    blocks.resize(gk3d::CompressedSize((gk3d::BlockFormat) format, bitmap.width(), bitmap.height()));
+                    gk3d::CompressBlocks(&images[i][0], bitmap.width(), bitmap.height(), (gk3d::BlockFormat) format,
+                                         &blocks[0], threadCounts[t]);
+                    bytes += images[i].size();
+                }
+                elapsed = Now() - start;
+            } while (elapsed < MinSeconds);
+            throughput[t] = bytes / elapsed / 1e6;
+        }
+        std::cout << "  " << formatNames[format] << ": " << std::fixed << std::setprecision(1)
+                  << throughput[0] << " / " << throughput[1] << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+static void BenchmarkMipGeneration(const std::vector<std::vector<unsigned char> >& images, const std::vector<gk3d::Bitmap>& bitmaps) {
+    static const char* const filterNames[] = {"box", "Kaiser", "Lanczos"};
+    const unsigned hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::cout << "Mip chains, gamma-correct (MB/s of RGBA base level, 1 / " << hardwareThreads << " threads):" << std::endl;
+    for (int filter = gk3d::MipFilter_Box; filter <= gk3d::MipFilter_Lanczos; ++filter) {
+        double throughput[2];
+        unsigned threadCounts[2] = {1, hardwareThreads};
+        for (int t = 0; t < 2; ++t) {
+            std::vector<std::vector<unsigned char> > levels;
+            size_t bytes = 0;
+            double start = Now(), elapsed = 0.0;
+            do {
+                for (size_t i = 0; i < images.size(); ++i) {
+                    gk3d::GenerateMips(&images[i][0], bitmaps[i].width(), bitmaps[i].height(), 4, (gk3d::MipFilter) filter,
+                                       true, levels, threadCounts[t]);
+                    bytes += images[i].size();
+                }
+                elapsed = Now() - start;
+            } while (elapsed < MinSeconds);
+            throughput[t] = bytes / elapsed / 1e6;
+        }
+        std::cout << "  " << filterNames[filter] << ": " << std::fixed << std::setprecision(1)
+                  << throughput[0] << " / " << throughput[1] << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+// each pair of formats converts a 16 megapixel image; bytes read and written count towards the rate
+static void BenchmarkPixelConversion() {
+    static const char* const formatNames[] = {"gray", "gray+alpha", "RGB", "RGBA"};
+    static const size_t Pixels = 4096 * 4096;
+
+    std::vector<unsigned char> src(Pixels * 4), dest(Pixels * 4);
+    for (size_t i = 0; i < src.size(); ++i)
+        src[i] = (unsigned char) rand();
+
+    std::cout << "Pixel conversion (GB/s read and written, 4096x4096):" << std::endl;
+    for (int srcFormat = gk3d::Bitmap::Format_Grayscale; srcFormat <= gk3d::Bitmap::Format_RGBA; ++srcFormat) {
+        std::cout << " ";
+        for (int destFormat = gk3d::Bitmap::Format_Grayscale; destFormat <= gk3d::Bitmap::Format_RGBA; ++destFormat) {
+            //the same format is a memcpy, for reference
+            size_t bytes = 0;
+            double start = Now(), elapsed = 0.0;
+            do {
+                gk3d::Bitmap::convertPixels(&src[0], (gk3d::Bitmap::Format) srcFormat, &dest[0],
+                                            (gk3d::Bitmap::Format) destFormat, Pixels);
+                bytes += Pixels * (srcFormat + destFormat);
+                elapsed = Now() - start;
+            } while (elapsed < MinSeconds);
+            std::cout << " " << formatNames[srcFormat - 1] << " -> " << formatNames[destFormat - 1] << ": "
+                      << std::fixed << std::setprecision(2) << bytes / elapsed / 1e9 << (destFormat < 4 ? "," : "");
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        std::cout << std::endl;
+    }
+}
+
+// rotation the way Bitmap::rotate90CounterClockwise did it before tiling, a pixel at a time, for reference
+static void RotatePerPixel(const gk3d::BitmapView& src, const gk3d::BitmapView& dest) {
+    for (unsigned row = 0; row < src.height; ++row) {
+        for (unsigned col = 0; col < src.width; ++col)
+            memcpy(dest.pixel(row, src.width - col - 1), src.pixel(col, row), src.format);
+    }
+}
+
+// MB/s of `bytes` that `transform` gets through, repeated for MinSeconds
+template <typename Transform>
+static double TransformThroughput(size_t bytes, Transform transform) {
+    size_t total = 0;
+    double start = Now(), elapsed = 0.0;
+    do {
+        transform();
+        total += bytes;
+        elapsed = Now() - start;
+    } while (elapsed < MinSeconds);
+    return total / elapsed / 1e6;
+}
+
+static void BenchmarkImageTransforms() {
+    static const char* const formatNames[] = {"gray", "gray+alpha", "RGB", "RGBA"};
+    static const unsigned Width = 4096, Height = 2048;
+    const unsigned hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::vector<unsigned char> src((size_t) Width * Width * 4), dest((size_t) Width * Height * 4);
+    for (size_t i = 0; i < src.size(); ++i)
+        src[i] = (unsigned char) rand();
+
+    std::cout << "Rotation by 90 degrees (MB/s; " << Width << "x" << Height << " per pixel / tiled 1 / " << hardwareThreads
+              << " threads, " << Width << "x" << Width << " in place 1 / " << hardwareThreads << " threads):" << std::endl;
+    for (int format = gk3d::Bitmap::Format_Grayscale; format <= gk3d::Bitmap::Format_RGBA; ++format) {
+        const gk3d::BitmapView from(&src[0], Width, Height, (gk3d::Bitmap::Format) format);
+        const gk3d::BitmapView to(&dest[0], Height, Width, (gk3d::Bitmap::Format) format);
+        const gk3d::BitmapView square(&src[0], Width, Width, (gk3d::Bitmap::Format) format);
+        const size_t bytes = from.rowBytes() * Height, squareBytes = square.rowBytes() * Width;
+
+        const double perPixel = TransformThroughput(bytes, [&]() { RotatePerPixel(from, to); });
+        double tiled[2], inPlace[2];
+        unsigned threadCounts[2] = {1, hardwareThreads};
+        for (int t = 0; t < 2; ++t) {
+            tiled[t] = TransformThroughput(bytes, [&]() { gk3d::RotatePixelsCounterClockwise(from, to, threadCounts[t]); });
+            inPlace[t] = TransformThroughput(squareBytes, [&]() {
+                gk3d::TransposePixelsInPlace(square, threadCounts[t]);
+                gk3d::FlipVertically(square, threadCounts[t]);
+            });
+        }
+        std::cout << "  " << formatNames[format - 1] << ": " << std::fixed << std::setprecision(1) << perPixel << " / "
+                  << tiled[0] << " / " << tiled[1] << ", " << inPlace[0] << " / " << inPlace[1] << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+// seconds a fresh asset cache takes to load `path`, averaged over MinSeconds
+static double ModelLoadSeconds(const std::string& path, const std::string& cacheExtension, bool compressed) {
+    const unsigned importFlags = aiProcess_Triangulate | aiProcess_GenNormals;
+    unsigned loads = 0;
+    double start = Now(), elapsed = 0.0;
+    do {
+        gk3d::AssetCache assets;
+        assets.setModelCache(cacheExtension, compressed);
+        assets.model(path, importFlags);
+        loads++;
+        elapsed = Now() - start;
+    } while (elapsed < MinSeconds);
+    return elapsed / loads;
+}
+
+static long FileSize(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static void BenchmarkObjParsing() {
+    const unsigned hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::cout << "OBJ parsing (MB/s; Assimp ReadFile / native 1 / " << hardwareThreads << " threads):" << std::endl;
+    for (size_t i = 0; i < sizeof(BenchmarkObjFiles) / sizeof(BenchmarkObjFiles[0]); ++i) {
+        const std::string path = GetProcessPath() + "/resources/" + BenchmarkObjFiles[i];
+        const double megabytes = FileSize(path) / 1e6;
+
+        unsigned reads = 0;
+        double start = Now(), elapsed = 0.0;
+        do {
+            Assimp::Importer importer;
+            importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenNormals);
+            reads++;
+            elapsed = Now() - start;
+        } while (elapsed < MinSeconds);
+        const double assimp = megabytes * reads / elapsed;
+
+        double native[2];
+        unsigned threadCounts[2] = {1, hardwareThreads};
+        for (int t = 0; t < 2; ++t) {
+            std::vector<gk3d::ObjMesh> meshes;
+            reads = 0;
+            start = Now();
+            do {
+                gk3d::ParseObj(path, meshes, threadCounts[t]);
+                reads++;
+                elapsed = Now() - start;
+            } while (elapsed < MinSeconds);
+            native[t] = megabytes * reads / elapsed;
+        }
+        std::cout << "  " << BenchmarkObjFiles[i] << ": " << std::fixed << std::setprecision(1)
+                  << assimp << " / " << native[0] << " / " << native[1] << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+// the cache files are read from the OS file cache, as on any start after the first
+static void BenchmarkModelCache() {
+    static const char* const rawExtension = ".benchmark.gkmesh";
+    static const char* const compressedExtension = ".benchmark-lz.gkmesh";
+
+    std::cout << "Model loading (ms; import / cache file / LZ4 cache file, and their sizes in bytes):" << std::endl;
+    for (size_t i = 0; i < sizeof(BenchmarkModels) / sizeof(BenchmarkModels[0]); ++i) {
+        const std::string path = GetProcessPath() + "/resources/" + BenchmarkModels[i];
+        const double importSeconds = ModelLoadSeconds(path, "", false);
+        //the first load of each writes the file the others map
+        const double rawSeconds = ModelLoadSeconds(path, rawExtension, false);
+        const double compressedSeconds = ModelLoadSeconds(path, compressedExtension, true);
+        const long rawSize = FileSize(path + rawExtension), compressedSize = FileSize(path + compressedExtension);
+        remove((path + rawExtension).c_str());
+        remove((path + compressedExtension).c_str());
+
+        std::cout << "  " << BenchmarkModels[i] << ": " << std::fixed << std::setprecision(2) << 1000.0 * importSeconds
+                  << " / " << 1000.0 * rawSeconds << " / " << 1000.0 * compressedSeconds << "; "
+                  << FileSize(path) << " / " << rawSize << " / " << compressedSize << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+// a cache file whose header is valid but with one index past the vertices must be rejected
+static bool CheckModelCache() {
+    static const GLuint Indices[] = {5, 4, 3, 2, 1, 0};
+    static const gk3d::ContentHash Source = 42;
+    const std::string path = GetProcessPath() + "/resources/check.benchmark.gkmesh";
+
+    gk3d::ModelData model;
+    gk3d::SubMesh subMesh;
+    for (unsigned i = 0; i < 6 * 6; ++i)
+        subMesh.vertices.push_back(0.25f * i);
+    subMesh.indices.assign(Indices, Indices + 6);
+    subMesh.lods.resize(gk3d::ModelData::LodLevels, subMesh.indices);
+    model.subMeshes.push_back(subMesh);
+    model.save(path, Source, false);
+
+    gk3d::ModelData loaded;
+    bool intact = loaded.load(path, Source);
+
+    //overwrite the 3 of the first index array with 6, one past the last vertex
+    std::vector<unsigned char> bytes;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file) {
+        bytes.resize(FileSize(path));
+        if (!bytes.empty() && fread(&bytes[0], bytes.size(), 1, file) != 1)
+            bytes.clear();
+        fclose(file);
+    }
+    const unsigned char* found = std::search(bytes.data(), bytes.data() + bytes.size(),
+                                             (const unsigned char*) Indices, (const unsigned char*) (Indices + 6));
+    bool corrupted = false;
+    if (found != bytes.data() + bytes.size()) {
+        const GLuint outside = 6;
+        memcpy(&bytes[found - bytes.data() + 2 * sizeof(GLuint)], &outside, sizeof(outside));
+        file = fopen(path.c_str(), "wb");
+        if (file) {
+            corrupted = fwrite(&bytes[0], bytes.size(), 1, file) == 1;
+            fclose(file);
+        }
+    }
+    const bool rejected = corrupted && !loaded.load(path, Source);
+    remove(path.c_str());
+
+    std::cout << "Model cache check: intact file " << (intact ? "loaded" : "NOT loaded") << ", corrupted index "
+              << (rejected ? "rejected" : "NOT rejected") << std::endl;
+    return intact && rejected;
+}
+
+int RunBenchmarks() {
+    std::vector<gk3d::Bitmap> bitmaps;
+    std::vector<std::vector<unsigned char> > images;
+    for (size_t i = 0; i < sizeof(BenchmarkTextures) / sizeof(BenchmarkTextures[0]); ++i) {
+        bitmaps.push_back(gk3d::Bitmap::bitmapFromFile(GetProcessPath() + "/resources/" + BenchmarkTextures[i]));
+        images.push_back(ToRGBA(bitmaps.back()));
+    }
+
+    BenchmarkBlockCompression(images, bitmaps);
+    BenchmarkMipGeneration(images, bitmaps);
+    BenchmarkPixelConversion();
+    BenchmarkImageTransforms();
+    BenchmarkObjParsing();
+    BenchmarkModelCache();
+    return CheckModelCache() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+/**
+ Runs the CPU benchmarks of the asset pipeline on the app's resources and prints
+ their throughput, then checks that a model cache with an index past its vertices
+ is rejected. Needs no window or OpenGL context.
+
+ @result the exit code of the program: failure if the check failed
+ */
+int RunBenchmarks();
@@ -0,0 +1,251 @@
+#include "AssetCache.h"
+#include "Bitmap.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+using namespace gk3d;
+
+//the absolute, canonical form of `path`, or `path` itself if it can not be resolved
+static std::string ResolvePath(const std::string& path) {
+#ifdef _WIN32
+    char resolved[_MAX_PATH];
+    if (_fullpath(resolved, path.c_str(), _MAX_PATH))
+        return resolved;
+#else
+    char* resolved = realpath(path.c_str(), NULL);
+    if (resolved) {
+        std::string result(resolved);
+        free(resolved);
+        return result;
+    }
+#endif
+    return path;
+}
+
+//true if one of the zero-separated fields of `key` is `path`
+static bool KeyNames(const std::string& key, const std::string& path) {
+    size_t start = 0;
+    for (;;) {
+        size_t end = key.find('\0', start);
+        if (key.compare(start, end == std::string::npos ? std::string::npos : end - start, path) == 0)
+            return true;
+        if (end == std::string::npos)
+            return false;
+        start = end + 1;
+    }
+}
+
+template <typename Resource>
+static size_t EvictNamed(std::map<std::string, std::shared_ptr<Resource> >& entries, const std::string& path) {
+    size_t evicted = 0;
+    for (typename std::map<std::string, std::shared_ptr<Resource> >::iterator it = entries.begin(); it != entries.end(); ) {
+        if (KeyNames(it->first, path)) {
+            entries.erase(it++);
+            evicted++;
+        } else {
+            ++it;
+        }
+    }
+    return evicted;
+}
+
+//drops the entries whose resource is referred to by the cache's entries alone
+template <typename Resource>
+static size_t EvictUnreferenced(std::map<std::string, std::shared_ptr<Resource> >& entries) {
+    typedef typename std::map<std::string, std::shared_ptr<Resource> >::iterator Iterator;
+    std::map<const void*, long> cacheReferences;
+    for (Iterator it = entries.begin(); it != entries.end(); ++it)
+        cacheReferences[it->second.get()]++;
+
+    size_t evicted = 0;
+    for (Iterator it = entries.begin(); it != entries.end(); ) {
+        if (it->second.use_count() == cacheReferences[it->second.get()]) {
+            entries.erase(it++);
+            evicted++;
+        } else {
+            ++it;
+        }
+    }
+    return evicted;
+}
+
+template <typename Resource>
+static void ForgetExpired(std::map<ContentHash, std::weak_ptr<Resource> >& byContent) {
+    for (typename std::map<ContentHash, std::weak_ptr<Resource> >::iterator it = byContent.begin(); it != byContent.end(); ) {
+        if (it->second.expired())
+            byContent.erase(it++);
+        else
+            ++it;
+    }
+}
+
+AssetCache::AssetCache() :
+    _models(),
+    _textures(),
+    _programs(),
+    _registry(),
+    _modelCacheExtension(),
+    _compressModelCache(false),
+    _mutex()
+{
+    _stats.hits = 0;
+    _stats.misses = 0;
+    _stats.shared = 0;
+    _stats.bytesRead = 0;
+    _stats.modelFiles = 0;
+}
+
+AssetCache::ModelHandle AssetCache::model(const std::string& path, unsigned importFlags) {
+    const std::string resolved = ResolvePath(path);
+    std::ostringstream options;
+    options << "flags " << importFlags;
+    std::string cacheFile;
+    bool compressed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_modelCacheExtension.empty())
+            cacheFile = resolved + _modelCacheExtension;
+        compressed = _compressModelCache;
+    }
+    return _get(_models, resolved, options.str(), [this, &resolved, &cacheFile, compressed, importFlags](ContentHash content) {
+        std::shared_ptr<ModelData> model(new ModelData);
+        if (!cacheFile.empty() && model->load(cacheFile, content)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stats.modelFiles++;
+            return std::shared_ptr<const ModelData>(model);
+        }
+        *model = ImportModel(resolved, importFlags);
+        if (!cacheFile.empty()) {
+            try {
+                model->save(cacheFile, content, compressed);
+            } catch (const std::exception&) {
+                //a resource folder that can not be written to only costs the next run an import
+            }
+        }
+        return std::shared_ptr<const ModelData>(model);
+    });
+}
+
+void AssetCache::setModelCache(const std::string& extension, bool compressed) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _modelCacheExtension = extension;
+    _compressModelCache = compressed;
+}
+
+AssetCache::TextureHandle AssetCache::texture(const std::string& path, GLint minMagFilter, GLint wrapMode) {
+    const std::string resolved = ResolvePath(path);
+    std::ostringstream options;
+    options << "filter " << minMagFilter << " wrap " << wrapMode;
+    return _get(_textures, resolved, options.str(), [&resolved, minMagFilter, wrapMode](ContentHash) {
+        Bitmap bitmap = Bitmap::bitmapFromFile(resolved);
+        bitmap.flipVertically();
+        return std::shared_ptr<Texture>(new Texture(bitmap, minMagFilter, wrapMode));
+    });
+}
+
+ProgramHandle AssetCache::program(const std::string& vertexFile, const std::string& fragmentFile, const std::string& defines) {
+    //programs of identical sources are shared by the registry, which reads the files anyway
+    const std::string key = ResolvePath(vertexFile) + '\0' + ResolvePath(fragmentFile) + '\0' + defines;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::map<std::string, ProgramHandle>::iterator it = _programs.entries.find(key);
+        if (it != _programs.entries.end()) {
+            _stats.hits++;
+            return it->second;
+        }
+        _stats.misses++;
+    }
+    ProgramHandle program = _registry.get(vertexFile, fragmentFile, defines);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _programs.entries[key] = program;
+    return program;
+}
+
+ProgramRegistry& AssetCache::programs() {
+    return _registry;
+}
+
+void AssetCache::evict(const std::string& path) {
+    const std::string resolved = ResolvePath(path);
+    std::lock_guard<std::mutex> lock(_mutex);
+    EvictNamed(_models.entries, resolved);
+    EvictNamed(_textures.entries, resolved);
+    EvictNamed(_programs.entries, resolved);
+}
+
+size_t AssetCache::evictUnused() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t evicted = EvictUnreferenced(_models.entries) + EvictUnreferenced(_textures.entries) +
+                     EvictUnreferenced(_programs.entries);
+    ForgetExpired(_models.byContent);
+    ForgetExpired(_textures.byContent);
+    return evicted;
+}
+
+size_t AssetCache::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _models.entries.size() + _textures.entries.size() + _programs.entries.size();
+}
+
+AssetCache::Stats AssetCache::stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+ContentHash AssetCache::_hashFile(const std::string& path, const std::string& options) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("Failed to open asset: " + path);
+    ContentHash hash = hashBytes(options.c_str(), options.size() + 1);
+    unsigned char buffer[65536];
+    size_t read, total = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = hashBytes(buffer, read, hash);
+        total += read;
+    }
+    fclose(file);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.bytesRead += total;
+    return hash;
+}
+
+template <typename Resource, typename Load>
+std::shared_ptr<Resource> AssetCache::_get(Table<Resource>& table, const std::string& path, const std::string& options, Load load) {
+    const std::string key = path + '\0' + options;
+    typedef typename std::map<std::string, std::shared_ptr<Resource> >::iterator Iterator;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Iterator it = table.entries.find(key);
+        if (it != table.entries.end()) {
+            _stats.hits++;
+            return it->second;
+        }
+        _stats.misses++;
+    }
+
+    //a copy of a file already loaded with the same options shares its resource; the file is
+    //read and loaded unlocked, and a thread loading the same key meanwhile wins the race
+    const ContentHash content = _hashFile(path, options);
+    std::shared_ptr<Resource> resource;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        resource = table.byContent[content].lock();
+    }
+    const bool shared = (bool) resource;
+    if (!shared)
+        resource = load(content);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    Iterator it = table.entries.find(key);
+    if (it != table.entries.end())
+        return it->second;
+    if (shared)
+        _stats.shared++;
+    else
+        table.byContent[content] = resource;
+    table.entries[key] = resource;
+    return resource;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Hash.h"
+#include "ModelImport.h"
+#include "ProgramRegistry.h"
+#include "Texture.h"
+
+namespace gk3d {
+
+    /**
+    * Loads every model, texture and shader program once, and hands out shared handles to it.
+    *
+    * Resources are keyed by their resolved file path and the options they are loaded with,
+    * so asking again for one already cached touches neither the disk nor the decoders nor
+    * the GPU. A file loaded for the first time is also hashed, and a file with the same
+    * content and options as one already cached (a copy under another name) shares its entry.
+    *
+    * The cache holds a handle to every resource until it is evicted. Evicting only drops the
+    * cache's handle: a resource lives on as long as anyone else holds one.
+    *
+    * Imported models can also be cached on disk, in a binary file next to the model that
+    * is mapped back in instead of importing it again (see gk3d::ModelData::save).
+    *
+    * Models can be looked up from any thread, and are imported outside the cache's lock, so
+    * several import at once. Textures and programs create GL objects, and are looked up
+    * from the GL thread only.
+    */
+    class AssetCache {
+    public:
+        typedef std::shared_ptr<const ModelData> ModelHandle;
+        typedef std::shared_ptr<Texture> TextureHandle;
+
+        /** Lookups since the cache was created */
+        struct Stats {
+            unsigned hits;
+            unsigned misses;
+            /** misses answered by an entry with the same content */
+            unsigned shared;
+            /** bytes of files read to hash them */
+            size_t bytesRead;
+            /** models read from their binary cache file instead of imported */
+            unsigned modelFiles;
+        };
+
+        AssetCache();
+
+        /**
+        * The model at `path`, imported with gk3d::ImportModel.
+        *
+        * @throws std::exception if the file can not be imported.
+        */
+        ModelHandle model(const std::string& path, unsigned importFlags);
+
+        /**
+        * Makes `model` read imported models from, and write them to, a binary cache file
+        * named after the model with `extension` appended, e.g. "bench.obj.gkmesh". An empty
+        * extension, the default, turns the cache files off.
+        *
+        * @param compressed  writes the files LZ4 compressed
+        */
+        void setModelCache(const std::string& extension, bool compressed = false);
+
+        /**
+        * A standalone texture of the image at `path`, flipped upright for OpenGL.
+        *
+        * @throws std::exception if the file can not be decoded.
+        */
+        TextureHandle texture(const std::string& path, GLint minMagFilter = GL_LINEAR, GLint wrapMode = GL_CLAMP_TO_EDGE);
+
+        /**
+        * The program linked from the given shader files, through `programs`.
+        *
+        * @throws std::exception if a file can not be read or the program fails to build.
+        */
+        ProgramHandle program(const std::string& vertexFile, const std::string& fragmentFile, const std::string& defines = "");
+
+        /** The registry compiling the programs, which also shares programs of identical sources */
+        ProgramRegistry& programs();
+
+        /** Drops the entries of the file at `path`, with any options */
+        void evict(const std::string& path);
+
+        /**
+        * Drops the entries no handle outside the cache refers to.
+        *
+        * @result the number of entries dropped
+        */
+        size_t evictUnused();
+
+        /** Number of entries, of all kinds */
+        size_t size() const;
+
+        Stats stats() const;
+
+    private:
+        /** Entries of one kind of resource, keyed by resolved path, a zero and the options */
+        template <typename Resource>
+        struct Table {
+            std::map<std::string, std::shared_ptr<Resource> > entries;
+            std::map<ContentHash, std::weak_ptr<Resource> > byContent;
+        };
+
+        Table<const ModelData> _models;
+        Table<Texture> _textures;
+        Table<Program> _programs;
+        ProgramRegistry _registry;
+        std::string _modelCacheExtension;
+        bool _compressModelCache;
+        Stats _stats;
+        mutable std::mutex _mutex;
+
+        ContentHash _hashFile(const std::string& path, const std::string& options);
+
+        /** `load` takes the hash of the file's content and options */
+        template <typename Resource, typename Load>
+        std::shared_ptr<Resource> _get(Table<Resource>& table, const std::string& path, const std::string& options, Load load);
+
+        //copying disabled
+        AssetCache(const AssetCache&);
+        const AssetCache& operator=(const AssetCache&);
+    };
+
+}
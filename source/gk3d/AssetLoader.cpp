@@ -0,0 +1,138 @@
+#include "AssetLoader.h"
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <sstream>
+
+using namespace gk3d;
+
+static double SecondsSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+AssetLoader::AssetLoader(AssetCache& cache, unsigned threadCount) :
+    _cache(cache),
+    _models(),
+    _completions(),
+    _timings(),
+    _pending(0),
+    _completionSeconds(0.0),
+    _pool(threadCount)
+{
+}
+
+AssetLoader::~AssetLoader() {
+    _pool.wait();
+}
+
+AssetLoader::ModelFuture AssetLoader::model(const std::string& path, unsigned importFlags, const ModelCompletion& completion) {
+    std::ostringstream key;
+    key << path << '\0' << importFlags;
+    std::map<std::string, ModelFuture>::iterator it = _models.find(key.str());
+    if (it != _models.end()) {
+        //a worker waits for the load already queued ahead of it, holding a pool thread until
+        //then, so the render thread is never blocked on it
+        ModelFuture future = it->second;
+        _start(std::string(), [future]() { future.wait(); }, [future, completion]() {
+            if (completion)
+                completion(future);
+        });
+        return future;
+    }
+
+    std::shared_ptr<std::promise<AssetCache::ModelHandle> > promise(new std::promise<AssetCache::ModelHandle>);
+    ModelFuture future = promise->get_future().share();
+    _models[key.str()] = future;
+    AssetCache& cache = _cache;
+    _start(path, [promise, &cache, path, importFlags]() {
+        try {
+            promise->set_value(cache.model(path, importFlags));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    }, [future, completion]() {
+        if (completion)
+            completion(future);
+    });
+    return future;
+}
+
+size_t AssetLoader::poll() {
+    std::deque<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        completions.swap(_completions);
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t run = 0;
+    while (!completions.empty()) {
+        Completion completion = completions.front();
+        completions.pop_front();
+        run++;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending--;
+        }
+        try {
+            completion();
+        } catch (...) {
+            //the completions not run yet go back to the front of the queue, for the next poll
+            std::lock_guard<std::mutex> lock(_mutex);
+            _completions.insert(_completions.begin(), completions.begin(), completions.end());
+            _completionSeconds += SecondsSince(start);
+            throw;
+        }
+    }
+    _completionSeconds += SecondsSince(start);
+    return run;
+}
+
+void AssetLoader::finish() {
+    for (;;) {
+        poll();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_pending == 0)
+            return;
+        _completed.wait(lock, [this]() { return !_completions.empty(); });
+    }
+}
+
+size_t AssetLoader::pending() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
+
+unsigned AssetLoader::threads() const {
+    return _pool.size();
+}
+
+std::vector<AssetLoader::Timing> AssetLoader::timings() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _timings;
+}
+
+double AssetLoader::completionSeconds() const {
+    return _completionSeconds;
+}
+
+//`path` is empty for loads sharing another's work, which are not timed
+void AssetLoader::_start(const std::string& path, const std::function<void()>& work, const Completion& completion) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending++;
+    }
+    _pool.run([this, path, work, completion]() {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        work();
+        Timing timing;
+        timing.path = path;
+        timing.seconds = SecondsSince(start);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!path.empty())
+            _timings.push_back(timing);
+        _completions.push_back(completion);
+        _completed.notify_all();
+    });
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AssetCache.h"
+#include "ThreadPool.h"
+
+namespace gk3d {
+
+    /**
+    * Loads assets asynchronously: reading, decoding and processing run on a pool of worker
+    * threads, and only the step creating GL objects is handed back to the GL thread.
+    *
+    * Every load returns a future, and takes a completion: once the worker is done, the
+    * completion is put on a queue the GL thread drains in `poll` or `finish`, in the order
+    * the loads finished. A completion gets the load's future, whose `get` rethrows whatever
+    * the worker failed with.
+    *
+    * A loader is used from the GL thread only; its workers go through the gk3d::AssetCache,
+    * so assets loaded by several loads, or cached already, are processed once.
+    */
+    class AssetLoader {
+    public:
+        typedef std::shared_future<AssetCache::ModelHandle> ModelFuture;
+        typedef std::function<void(const ModelFuture&)> ModelCompletion;
+
+        /** How long one load took on its worker */
+        struct Timing {
+            std::string path;
+            double seconds;
+        };
+
+        /** @param threadCount  0 uses every hardware thread */
+        explicit AssetLoader(AssetCache& cache, unsigned threadCount = 0);
+
+        /** Waits for the workers; completions not run yet are dropped */
+        ~AssetLoader();
+
+        /**
+        * Starts importing the model at `path` through the cache on a worker thread.
+        *
+        * Loads of a model already being loaded share its future.
+        *
+        * @param completion  run on the GL thread once the model is imported, or failed to; may be empty
+        */
+        ModelFuture model(const std::string& path, unsigned importFlags, const ModelCompletion& completion = ModelCompletion());
+
+        /**
+        * Runs the completions of the loads finished so far, without waiting for the others.
+        *
+        * @result the number of completions run
+        */
+        size_t poll();
+
+        /** Runs completions until every load started so far has finished and been completed */
+        void finish();
+
+        /** Number of loads whose completion has not run yet */
+        size_t pending() const;
+
+        /** Number of worker threads */
+        unsigned threads() const;
+
+        /** The loads finished so far, in the order they finished */
+        std::vector<Timing> timings() const;
+
+        /** Seconds the GL thread has spent in completions */
+        double completionSeconds() const;
+
+    private:
+        typedef std::function<void()> Completion;
+
+        AssetCache& _cache;
+        std::map<std::string, ModelFuture> _models;
+        std::deque<Completion> _completions;
+        std::vector<Timing> _timings;
+        size_t _pending;
+        double _completionSeconds;
+        mutable std::mutex _mutex;
+        std::condition_variable _completed;
+        //declared last, so its threads are joined before the members they use are destroyed
+        ThreadPool _pool;
+
+        void _start(const std::string& path, const std::function<void()>& work, const Completion& completion);
+
+        //copying disabled
+        AssetLoader(const AssetLoader&);
+        const AssetLoader& operator=(const AssetLoader&);
+    };
+
+}
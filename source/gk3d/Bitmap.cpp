@@ -17,136 +17,433 @@
  */
 
 #include "Bitmap.h"
+#include "BitmapView.h"
+#include "MappedFile.h"
+#include <climits>
+#include <cstring>
+#include <exception>
 #include <stdexcept>
+#include <utility>
 
 //uses stb_image to try load files
 #define STBI_FAILURE_USERMSG
 #include <stb_image.c>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK3D_BITMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+//SSSE3 and AVX2 rows are compiled for their instruction sets and picked at runtime by the CPU
+#if defined(GK3D_BITMAP_SSE2) && ((defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || defined(_MSC_VER))
+#define GK3D_BITMAP_DISPATCH
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define GK3D_TARGET(isa)
+#else
+#define GK3D_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
 using namespace gk3d;
 
 
-inline unsigned char AverageRGB(unsigned char rgb[3]) {
+inline unsigned char AverageRGB(const unsigned char rgb[3]) {
     return (unsigned char)(((double)rgb[0] + (double)rgb[1] + (double)rgb[2]) / 3.0);
 }
 
-static void Grayscale2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
+static void Grayscale2GrayscaleAlpha(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = 255;
 }
 
-static void Grayscale2RGB(unsigned char* src, unsigned char* dest){
+static void Grayscale2RGB(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = src[0];
     dest[2] = src[0];
 }
 
-static void Grayscale2RGBA(unsigned char* src, unsigned char* dest){
+static void Grayscale2RGBA(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = src[0];
     dest[2] = src[0];
     dest[3] = 255;
 }
 
-static void GrayscaleAlpha2Grayscale(unsigned char* src, unsigned char* dest){
+static void GrayscaleAlpha2Grayscale(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
 }
 
-static void GrayscaleAlpha2RGB(unsigned char* src, unsigned char* dest){
+static void GrayscaleAlpha2RGB(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = src[0];
     dest[2] = src[0];
 }
 
-static void GrayscaleAlpha2RGBA(unsigned char* src, unsigned char* dest){
+static void GrayscaleAlpha2RGBA(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = src[0];
     dest[2] = src[0];
     dest[3] = src[1];
 }
 
-static void RGB2Grayscale(unsigned char* src, unsigned char* dest){
+static void RGB2Grayscale(const unsigned char* src, unsigned char* dest){
     dest[0] = AverageRGB(src);
 }
 
-static void RGB2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
+static void RGB2GrayscaleAlpha(const unsigned char* src, unsigned char* dest){
     dest[0] = AverageRGB(src);
     dest[1] = 255;
 }
 
-static void RGB2RGBA(unsigned char* src, unsigned char* dest){
+static void RGB2RGBA(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = src[1];
     dest[2] = src[2];
     dest[3] = 255;
 }
 
-static void RGBA2Grayscale(unsigned char* src, unsigned char* dest){
+static void RGBA2Grayscale(const unsigned char* src, unsigned char* dest){
     dest[0] = AverageRGB(src);
 }
 
-static void RGBA2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
+static void RGBA2GrayscaleAlpha(const unsigned char* src, unsigned char* dest){
     dest[0] = AverageRGB(src);
     dest[1] = src[3];
 }
 
-static void RGBA2RGB(unsigned char* src, unsigned char* dest){
+static void RGBA2RGB(const unsigned char* src, unsigned char* dest){
     dest[0] = src[0];
     dest[1] = src[1];
     dest[2] = src[2];
 }
 
-typedef void(*FormatConverterFunc)(unsigned char*, unsigned char*);
+typedef void(*FormatConverterFunc)(const unsigned char*, unsigned char*);
+
+/*
+ * Row converters
+ *
+ * Each converts `count` consecutive pixels. The SIMD ones convert as many pixels as
+ * fit their registers and leave the rest of the row to the per-pixel converter.
+ */
+
+typedef void(*RowConverterFunc)(const unsigned char* src, unsigned char* dest, size_t count);
+
+template <FormatConverterFunc Convert, unsigned SrcSize, unsigned DestSize>
+static void ConvertRow(const unsigned char* src, unsigned char* dest, size_t count){
+    for(size_t i = 0; i < count; ++i)
+        Convert(src + i*SrcSize, dest + i*DestSize);
+}
+
+#ifdef GK3D_BITMAP_SSE2
+
+static inline __m128i Load(const unsigned char* p) {
+    return _mm_loadu_si128((const __m128i*) p);
+}
+
+static inline void Store(unsigned char* p, __m128i v) {
+    _mm_storeu_si128((__m128i*) p, v);
+}
+
+//floor(sum / 3) of 16-bit sums up to 765, the same as AverageRGB
+static inline __m128i DivideBy3(__m128i sums) {
+    return _mm_srli_epi16(_mm_mulhi_epu16(sums, _mm_set1_epi16((short) 0xaaab)), 1);
+}
+
+//r + g + b of 4 RGBA pixels, in 32-bit lanes
+static inline __m128i SumRGB(__m128i pixels) {
+    const __m128i low = _mm_set1_epi32(0xff);
+    __m128i sum = _mm_and_si128(pixels, low);
+    sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(pixels, 8), low));
+    return _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(pixels, 16), low));
+}
+
+//averages of 8 RGBA pixels, in 16-bit lanes
+static inline __m128i Gray8(__m128i pixels0, __m128i pixels1) {
+    return DivideBy3(_mm_packs_epi32(SumRGB(pixels0), SumRGB(pixels1)));
+}
+
+static void Grayscale2GrayscaleAlphaSSE2(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i gray = Load(src + i);
+        Store(dest + i*2, _mm_unpacklo_epi8(gray, alpha));
+        Store(dest + i*2 + 16, _mm_unpackhi_epi8(gray, alpha));
+    }
+    ConvertRow<Grayscale2GrayscaleAlpha, 1, 2>(src + i, dest + i*2, count - i);
+}
+
+static void Grayscale2RGBASSE2(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i gray = Load(src + i);
+        __m128i low = _mm_unpacklo_epi8(gray, gray), high = _mm_unpackhi_epi8(gray, gray);
+        Store(dest + i*4, _mm_or_si128(_mm_unpacklo_epi16(low, low), alpha));
+        Store(dest + i*4 + 16, _mm_or_si128(_mm_unpackhi_epi16(low, low), alpha));
+        Store(dest + i*4 + 32, _mm_or_si128(_mm_unpacklo_epi16(high, high), alpha));
+        Store(dest + i*4 + 48, _mm_or_si128(_mm_unpackhi_epi16(high, high), alpha));
+    }
+    ConvertRow<Grayscale2RGBA, 1, 4>(src + i, dest + i*4, count - i);
+}
+
+static void GrayscaleAlpha2GrayscaleSSE2(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i gray0 = _mm_and_si128(Load(src + i*2), low), gray1 = _mm_and_si128(Load(src + i*2 + 16), low);
+        Store(dest + i, _mm_packus_epi16(gray0, gray1));
+    }
+    ConvertRow<GrayscaleAlpha2Grayscale, 2, 1>(src + i*2, dest + i, count - i);
+}
+
+static void GrayscaleAlpha2RGBASSE2(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i pixels = Load(src + i*2);
+        __m128i gray = _mm_and_si128(pixels, low);
+        gray = _mm_or_si128(gray, _mm_slli_epi16(gray, 8));
+        //gray gray in the low half of every 32-bit lane, gray alpha in the high half
+        Store(dest + i*4, _mm_unpacklo_epi16(gray, pixels));
+        Store(dest + i*4 + 16, _mm_unpackhi_epi16(gray, pixels));
+    }
+    ConvertRow<GrayscaleAlpha2RGBA, 2, 4>(src + i*2, dest + i*4, count - i);
+}
+
+static void RGBA2GrayscaleSSE2(const unsigned char* src, unsigned char* dest, size_t count){
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        const unsigned char* in = src + i*4;
+        __m128i gray0 = Gray8(Load(in), Load(in + 16));
+        __m128i gray1 = Gray8(Load(in + 32), Load(in + 48));
+        Store(dest + i, _mm_packus_epi16(gray0, gray1));
+    }
+    ConvertRow<RGBA2Grayscale, 4, 1>(src + i*4, dest + i, count - i);
+}
 
-static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bitmap::Format destFormat){
+static void RGBA2GrayscaleAlphaSSE2(const unsigned char* src, unsigned char* dest, size_t count){
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i pixels0 = Load(src + i*4), pixels1 = Load(src + i*4 + 16);
+        __m128i alpha = _mm_packs_epi32(_mm_srli_epi32(pixels0, 24), _mm_srli_epi32(pixels1, 24));
+        Store(dest + i*2, _mm_or_si128(Gray8(pixels0, pixels1), _mm_slli_epi16(alpha, 8)));
+    }
+    ConvertRow<RGBA2GrayscaleAlpha, 4, 2>(src + i*4, dest + i*2, count - i);
+}
+
+#endif
+
+#ifdef GK3D_BITMAP_DISPATCH
+
+//expands 16 RGB pixels to RGBA, with the fourth byte of every pixel zero
+GK3D_TARGET("ssse3") static inline void ExpandRGB(const unsigned char* src, __m128i pixels[4]) {
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i a = Load(src), b = Load(src + 16), c = Load(src + 32);
+    pixels[0] = _mm_shuffle_epi8(a, expand);
+    pixels[1] = _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), expand);
+    pixels[2] = _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), expand);
+    pixels[3] = _mm_shuffle_epi8(_mm_srli_si128(c, 4), expand);
+}
+
+//spreads 16 gray values to 16 RGB pixels
+GK3D_TARGET("ssse3") static inline void StoreGrayAsRGB(unsigned char* dest, __m128i gray) {
+    Store(dest, _mm_shuffle_epi8(gray, _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5)));
+    Store(dest + 16, _mm_shuffle_epi8(gray, _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10)));
+    Store(dest + 32, _mm_shuffle_epi8(gray, _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15)));
+}
+
+GK3D_TARGET("ssse3") static void RGB2RGBASSSE3(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i pixels[4];
+        ExpandRGB(src + i*3, pixels);
+        for(int k = 0; k < 4; ++k)
+            Store(dest + i*4 + k*16, _mm_or_si128(pixels[k], alpha));
+    }
+    ConvertRow<RGB2RGBA, 3, 4>(src + i*3, dest + i*4, count - i);
+}
+
+GK3D_TARGET("ssse3") static void RGBA2RGBSSSE3(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        const unsigned char* in = src + i*4;
+        //12 bytes in each register, joined into 3 registers
+        __m128i a = _mm_shuffle_epi8(Load(in), pack), b = _mm_shuffle_epi8(Load(in + 16), pack);
+        __m128i c = _mm_shuffle_epi8(Load(in + 32), pack), d = _mm_shuffle_epi8(Load(in + 48), pack);
+        Store(dest + i*3, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        Store(dest + i*3 + 16, _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        Store(dest + i*3 + 32, _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+    }
+    ConvertRow<RGBA2RGB, 4, 3>(src + i*4, dest + i*3, count - i);
+}
+
+GK3D_TARGET("ssse3") static void Grayscale2RGBSSSE3(const unsigned char* src, unsigned char* dest, size_t count){
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+        StoreGrayAsRGB(dest + i*3, Load(src + i));
+    ConvertRow<Grayscale2RGB, 1, 3>(src + i, dest + i*3, count - i);
+}
+
+GK3D_TARGET("ssse3") static void GrayscaleAlpha2RGBSSSE3(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i low = _mm_set1_epi16(0xff);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i gray0 = _mm_and_si128(Load(src + i*2), low), gray1 = _mm_and_si128(Load(src + i*2 + 16), low);
+        StoreGrayAsRGB(dest + i*3, _mm_packus_epi16(gray0, gray1));
+    }
+    ConvertRow<GrayscaleAlpha2RGB, 2, 3>(src + i*2, dest + i*3, count - i);
+}
+
+GK3D_TARGET("ssse3") static void RGB2GrayscaleSSSE3(const unsigned char* src, unsigned char* dest, size_t count){
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i pixels[4];
+        ExpandRGB(src + i*3, pixels);
+        Store(dest + i, _mm_packus_epi16(Gray8(pixels[0], pixels[1]), Gray8(pixels[2], pixels[3])));
+    }
+    ConvertRow<RGB2Grayscale, 3, 1>(src + i*3, dest + i, count - i);
+}
+
+GK3D_TARGET("ssse3") static void RGB2GrayscaleAlphaSSSE3(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m128i alpha = _mm_set1_epi8((char) 0xff);
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i pixels[4];
+        ExpandRGB(src + i*3, pixels);
+        __m128i gray = _mm_packus_epi16(Gray8(pixels[0], pixels[1]), Gray8(pixels[2], pixels[3]));
+        Store(dest + i*2, _mm_unpacklo_epi8(gray, alpha));
+        Store(dest + i*2 + 16, _mm_unpackhi_epi8(gray, alpha));
+    }
+    ConvertRow<RGB2GrayscaleAlpha, 3, 2>(src + i*3, dest + i*2, count - i);
+}
+
+//AVX2 shuffles stay within 128-bit lanes, so 8 pixels are spread over both lanes first
+GK3D_TARGET("avx2") static void RGB2RGBAAVX2(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+    const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int) 0xff000000);
+    size_t i = 0;
+    //the 32 byte load reads 8 bytes past the 8 pixels
+    for(; i + 11 <= count; i += 8){
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) (src + i*3));
+        pixels = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(pixels, spread), expand);
+        _mm256_storeu_si256((__m256i*) (dest + i*4), _mm256_or_si256(pixels, alpha));
+    }
+    RGB2RGBASSSE3(src + i*3, dest + i*4, count - i);
+}
+
+GK3D_TARGET("avx2") static void RGBA2RGBAVX2(const unsigned char* src, unsigned char* dest, size_t count){
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) (src + i*4));
+        pixels = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, pack), join);
+        Store(dest + i*3, _mm256_castsi256_si128(pixels));
+        _mm_storel_epi64((__m128i*) (dest + i*3 + 16), _mm256_extracti128_si256(pixels, 1));
+    }
+    RGBA2RGBSSSE3(src + i*4, dest + i*3, count - i);
+}
+
+struct CpuFeatures {
+    bool ssse3;
+    bool avx2;
+};
+
+static CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.ssse3 = (info[2] & (1 << 9)) != 0;
+    //AVX registers also need saving by the OS
+    const bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    features.avx2 = false;
+    if(maxLeaf >= 7 && osSavesAvx){
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.ssse3 = __builtin_cpu_supports("ssse3") != 0;
+    features.avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+    return features;
+}
+
+#endif
+
+/*
+ * The fastest row converter the CPU runs for every pair of formats, picked once.
+ * Indexed by format - 1; same format pairs are left NULL.
+ */
+struct RowConverters {
+    RowConverterFunc table[4][4];
+
+    RowConverters() {
+        memset(table, 0, sizeof(table));
+        Set(Bitmap::Format_Grayscale, Bitmap::Format_GrayscaleAlpha, ConvertRow<Grayscale2GrayscaleAlpha, 1, 2>);
+        Set(Bitmap::Format_Grayscale, Bitmap::Format_RGB, ConvertRow<Grayscale2RGB, 1, 3>);
+        Set(Bitmap::Format_Grayscale, Bitmap::Format_RGBA, ConvertRow<Grayscale2RGBA, 1, 4>);
+        Set(Bitmap::Format_GrayscaleAlpha, Bitmap::Format_Grayscale, ConvertRow<GrayscaleAlpha2Grayscale, 2, 1>);
+        Set(Bitmap::Format_GrayscaleAlpha, Bitmap::Format_RGB, ConvertRow<GrayscaleAlpha2RGB, 2, 3>);
+        Set(Bitmap::Format_GrayscaleAlpha, Bitmap::Format_RGBA, ConvertRow<GrayscaleAlpha2RGBA, 2, 4>);
+        Set(Bitmap::Format_RGB, Bitmap::Format_Grayscale, ConvertRow<RGB2Grayscale, 3, 1>);
+        Set(Bitmap::Format_RGB, Bitmap::Format_GrayscaleAlpha, ConvertRow<RGB2GrayscaleAlpha, 3, 2>);
+        Set(Bitmap::Format_RGB, Bitmap::Format_RGBA, ConvertRow<RGB2RGBA, 3, 4>);
+        Set(Bitmap::Format_RGBA, Bitmap::Format_Grayscale, ConvertRow<RGBA2Grayscale, 4, 1>);
+        Set(Bitmap::Format_RGBA, Bitmap::Format_GrayscaleAlpha, ConvertRow<RGBA2GrayscaleAlpha, 4, 2>);
+        Set(Bitmap::Format_RGBA, Bitmap::Format_RGB, ConvertRow<RGBA2RGB, 4, 3>);
+
+#ifdef GK3D_BITMAP_SSE2
+        Set(Bitmap::Format_Grayscale, Bitmap::Format_GrayscaleAlpha, Grayscale2GrayscaleAlphaSSE2);
+        Set(Bitmap::Format_Grayscale, Bitmap::Format_RGBA, Grayscale2RGBASSE2);
+        Set(Bitmap::Format_GrayscaleAlpha, Bitmap::Format_Grayscale, GrayscaleAlpha2GrayscaleSSE2);
+        Set(Bitmap::Format_GrayscaleAlpha, Bitmap::Format_RGBA, GrayscaleAlpha2RGBASSE2);
+        Set(Bitmap::Format_RGBA, Bitmap::Format_Grayscale, RGBA2GrayscaleSSE2);
+        Set(Bitmap::Format_RGBA, Bitmap::Format_GrayscaleAlpha, RGBA2GrayscaleAlphaSSE2);
+#endif
+
+#ifdef GK3D_BITMAP_DISPATCH
+        const CpuFeatures cpu = DetectCpuFeatures();
+        if(cpu.ssse3){
+            Set(Bitmap::Format_Grayscale, Bitmap::Format_RGB, Grayscale2RGBSSSE3);
+            Set(Bitmap::Format_GrayscaleAlpha, Bitmap::Format_RGB, GrayscaleAlpha2RGBSSSE3);
+            Set(Bitmap::Format_RGB, Bitmap::Format_Grayscale, RGB2GrayscaleSSSE3);
+            Set(Bitmap::Format_RGB, Bitmap::Format_GrayscaleAlpha, RGB2GrayscaleAlphaSSSE3);
+            Set(Bitmap::Format_RGB, Bitmap::Format_RGBA, RGB2RGBASSSE3);
+            Set(Bitmap::Format_RGBA, Bitmap::Format_RGB, RGBA2RGBSSSE3);
+        }
+        if(cpu.ssse3 && cpu.avx2){
+            Set(Bitmap::Format_RGB, Bitmap::Format_RGBA, RGB2RGBAAVX2);
+            Set(Bitmap::Format_RGBA, Bitmap::Format_RGB, RGBA2RGBAVX2);
+        }
+#endif
+    }
+
+    void Set(Bitmap::Format srcFormat, Bitmap::Format destFormat, RowConverterFunc converter) {
+        table[srcFormat - 1][destFormat - 1] = converter;
+    }
+};
+
+static RowConverterFunc RowConverterForFormats(Bitmap::Format srcFormat, Bitmap::Format destFormat){
     if(srcFormat == destFormat)
         throw std::runtime_error("Just use memcpy if pixel formats are the same");
-    
-    switch(srcFormat){
-            
-        case Bitmap::Format_Grayscale:
-            switch(destFormat){
-                case Bitmap::Format_GrayscaleAlpha: return Grayscale2GrayscaleAlpha;
-                case Bitmap::Format_RGB:            return Grayscale2RGB;
-                case Bitmap::Format_RGBA:           return Grayscale2RGBA;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        case Bitmap::Format_GrayscaleAlpha:
-            switch(destFormat){
-                case Bitmap::Format_Grayscale: return GrayscaleAlpha2Grayscale;
-                case Bitmap::Format_RGB:       return GrayscaleAlpha2RGB;
-                case Bitmap::Format_RGBA:      return GrayscaleAlpha2RGBA;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        case Bitmap::Format_RGB:
-            switch(destFormat){
-                case Bitmap::Format_Grayscale:      return RGB2Grayscale;
-                case Bitmap::Format_GrayscaleAlpha: return RGB2GrayscaleAlpha;
-                case Bitmap::Format_RGBA:           return RGB2RGBA;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        case Bitmap::Format_RGBA:
-            switch(destFormat){
-                case Bitmap::Format_Grayscale:      return RGBA2Grayscale;
-                case Bitmap::Format_GrayscaleAlpha: return RGBA2GrayscaleAlpha;
-                case Bitmap::Format_RGB:            return RGBA2RGB;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        default:
-            throw std::runtime_error("Unhandled bitmap format");
-    }
+    if(srcFormat < Bitmap::Format_Grayscale || srcFormat > Bitmap::Format_RGBA ||
+       destFormat < Bitmap::Format_Grayscale || destFormat > Bitmap::Format_RGBA)
+        throw std::runtime_error("Unhandled bitmap format");
+
+    static const RowConverters converters;
+    return converters.table[srcFormat - 1][destFormat - 1];
 }
 
 
@@ -159,15 +456,10 @@ inline unsigned GetPixelOffset(unsigned col, unsigned row, unsigned width, unsig
 }
 
 inline bool RectsOverlap(unsigned srcCol, unsigned srcRow, unsigned destCol, unsigned destRow, unsigned width, unsigned height){
+    //rectangles overlap only if both their columns and their rows do
     unsigned colDiff = srcCol > destCol ? srcCol - destCol : destCol - srcCol;
-    if(colDiff < width)
-        return true;
-    
     unsigned rowDiff = srcRow > destRow ? srcRow - destRow : destRow - srcRow;
-    if(rowDiff < height)
-        return true;
-    
-    return false;
+    return colDiff < width && rowDiff < height;
 }
 
 
@@ -175,37 +467,188 @@ inline bool RectsOverlap(unsigned srcCol, unsigned srcRow, unsigned destCol, uns
  * Bitmap class
  */
 
+inline void CheckSize(unsigned width, unsigned height, Bitmap::Format format) {
+    if(width == 0) throw std::runtime_error("Zero width bitmap");
+    if(height == 0) throw std::runtime_error("Zero height bitmap");
+    if(format <= 0 || format > 4) throw std::runtime_error("Invalid bitmap format");
+}
+
+static void FreePixels(unsigned char* pixels) {
+    free(pixels);
+}
+
+namespace {
+    //where stb_image hands the rows it decodes
+    struct RowSink {
+        const BitmapView* dest;
+        const Bitmap::DecodeProgress* progress;
+        std::string error;
+        std::exception_ptr exception;
+    };
+}
+
+static int SinkBegin(void* user, int width, int height, int) {
+    RowSink* sink = (RowSink*)user;
+    if((unsigned)width != sink->dest->width || (unsigned)height != sink->dest->height){
+        sink->error = "Image is not the size of the bitmap view it decodes into";
+        return 0;
+    }
+    return 1;
+}
+
+static stbi_uc* SinkRow(void* user, int row) {
+    RowSink* sink = (RowSink*)user;
+    return sink->dest->row((unsigned)row);
+}
+
+static int SinkRowsDone(void* user, int rows) {
+    RowSink* sink = (RowSink*)user;
+    if(!*sink->progress) return 1;
+    
+    //exceptions must not unwind through the decoder, which would leak its buffers
+    try {
+        (*sink->progress)((unsigned)rows);
+    } catch(...) {
+        sink->exception = std::current_exception();
+        return 0;
+    }
+    return 1;
+}
+
+static void MapImageFile(MappedFile& file, const std::string& filePath) {
+    if(!file.open(filePath) || !file.data())
+        throw std::runtime_error("Unable to open image file: " + filePath);
+    if(file.size() > INT_MAX)
+        throw std::runtime_error("Image file too large: " + filePath);
+}
+
 Bitmap::Bitmap(unsigned width, 
                unsigned height, 
                Format format,
                const unsigned char* pixels) :
-    _pixels(NULL)
+    _pixels(NULL),
+    _deleter(),
+    _allocator(NULL)
 {
     _set(width, height, format, pixels);
 }
 
+Bitmap::Bitmap(unsigned width,
+               unsigned height,
+               Format format,
+               BitmapAllocator& allocator,
+               const unsigned char* pixels) :
+    _pixels(NULL),
+    _deleter(),
+    _allocator(&allocator)
+{
+    _set(width, height, format, pixels);
+}
+
+Bitmap::Bitmap(unsigned width,
+               unsigned height,
+               Format format,
+               unsigned char* pixels,
+               Deleter deleter) :
+    _pixels(NULL),
+    _deleter(),
+    _allocator(NULL)
+{
+    try {
+        CheckSize(width, height, format);
+        if(!pixels) throw std::runtime_error("No pixels to adopt");
+    } catch (...) {
+        if(pixels && deleter) deleter(pixels);
+        throw;
+    }
+    _width = width;
+    _height = height;
+    _format = format;
+    _adoptPixels(pixels, deleter);
+}
+
 Bitmap::~Bitmap() {
-    if(_pixels) free(_pixels);
+    _adoptPixels(NULL, Deleter());
 }
 
-Bitmap Bitmap::bitmapFromFile(std::string filePath) {    
+Bitmap Bitmap::bitmapFromFile(std::string filePath) {
+    MappedFile file;
+    MapImageFile(file, filePath);
     int width, height, channels;
-    unsigned char* pixels = stbi_load(filePath.c_str(), &width, &height, &channels, 0);
-    if(!pixels) throw std::runtime_error(stbi_failure_reason());
+    if(!stbi_info_from_memory(file.data(), (int)file.size(), &width, &height, &channels))
+        throw std::runtime_error(stbi_failure_reason());
     
-    Bitmap bmp(width, height, (Format)channels, pixels);
-    stbi_image_free(pixels);
-    return bmp;
+    Bitmap bitmap((unsigned)width, (unsigned)height, (Format)channels);
+    decodeMemory(file.data(), file.size(), bitmap.view());
+    return bitmap;
+}
+
+void Bitmap::decodeFile(const std::string& filePath, const BitmapView& dest, const DecodeProgress& progress) {
+    MappedFile file;
+    MapImageFile(file, filePath);
+    decodeMemory(file.data(), file.size(), dest, progress);
+}
+
+void Bitmap::decodeMemory(const unsigned char* data, size_t size, const BitmapView& dest, const DecodeProgress& progress) {
+    if(size > INT_MAX) throw std::runtime_error("Encoded image too large");
+    
+    static const stbi_row_sink callbacks = {SinkBegin, SinkRow, SinkRowsDone};
+    RowSink sink;
+    sink.dest = &dest;
+    sink.progress = &progress;
+    if(stbi_load_rows_from_memory(data, (int)size, dest.format, &callbacks, &sink)) return;
+    
+    if(sink.exception) std::rethrow_exception(sink.exception);
+    if(!sink.error.empty()) throw std::runtime_error(sink.error);
+    throw std::runtime_error(stbi_failure_reason());
+}
+
+bool Bitmap::infoFromFile(const std::string& filePath, unsigned& width, unsigned& height, Format& format) {
+    int x, y, channels;
+    if(!stbi_info(filePath.c_str(), &x, &y, &channels)) return false;
+    
+    width = (unsigned)x;
+    height = (unsigned)y;
+    format = (Format)channels;
+    return true;
 }
 
 Bitmap::Bitmap(const Bitmap& other) :
-    _pixels(NULL)
+    _pixels(NULL),
+    _deleter(),
+    _allocator(other._allocator)
 {
     _set(other._width, other._height, other._format, other._pixels);
 }
 
 Bitmap& Bitmap::operator = (const Bitmap& other) {
-    _set(other._width, other._height, other._format, other._pixels);
+    if(this != &other)
+        _set(other._width, other._height, other._format, other._pixels);
+    return *this;
+}
+
+Bitmap::Bitmap(Bitmap&& other) noexcept :
+    _format(other._format),
+    _width(other._width),
+    _height(other._height),
+    _pixels(other._pixels),
+    _deleter(std::move(other._deleter)),
+    _allocator(other._allocator)
+{
+    other._pixels = NULL;
+    other._deleter = Deleter();
+}
+
+Bitmap& Bitmap::operator = (Bitmap&& other) noexcept {
+    if(this != &other){
+        _adoptPixels(other._pixels, std::move(other._deleter));
+        _format = other._format;
+        _width = other._width;
+        _height = other._height;
+        _allocator = other._allocator;
+        other._pixels = NULL;
+        other._deleter = Deleter();
+    }
     return *this;
 }
 
@@ -238,35 +681,26 @@ void Bitmap::setPixel(unsigned int column, unsigned int row, const unsigned char
 }
 
 void Bitmap::flipVertically() {
-    unsigned long rowSize = _format*_width;
-    unsigned char* rowBuffer = new unsigned char[rowSize];
-    unsigned halfRows = _height / 2;
-    
-    for(unsigned rowIdx = 0; rowIdx < halfRows; ++rowIdx){
-        unsigned char* row = _pixels + GetPixelOffset(0, rowIdx, _width, _height, _format);
-        unsigned char* oppositeRow = _pixels + GetPixelOffset(0, _height - rowIdx - 1, _width, _height, _format);
-        
-        memcpy(rowBuffer, row, rowSize);
-        memcpy(row, oppositeRow, rowSize);
-        memcpy(oppositeRow, rowBuffer, rowSize);
-    }
-    
-    delete rowBuffer;
+    FlipVertically(view());
 }
 
 void Bitmap::rotate90CounterClockwise() {
-    unsigned char* newPixels = (unsigned char*) malloc(_format*_width*_height);
-    
-    for(unsigned row = 0; row < _height; ++row){
-        for(unsigned col = 0; col < _width; ++col){
-            unsigned srcOffset = GetPixelOffset(col, row, _width, _height, _format);
-            unsigned destOffset = GetPixelOffset(row, _width - col - 1, _height, _width, _format);
-            memcpy(newPixels + destOffset, _pixels + srcOffset, _format); //copy one pixel
-        }
+    //a square turns in place: its transpose, upside down
+    if(_width == _height){
+        TransposePixelsInPlace(view());
+        FlipVertically(view());
+        return;
     }
     
-    free(_pixels);
-    _pixels = newPixels;
+    Deleter deleter;
+    unsigned char* newPixels = _allocatePixels((size_t)_format*_width*_height, deleter);
+    try {
+        RotatePixelsCounterClockwise(view(), BitmapView(newPixels, _height, _width, _format));
+    } catch (...) {
+        deleter(newPixels);
+        throw;
+    }
+    _adoptPixels(newPixels, deleter);
     
     unsigned swapTmp = _height;
     _height = _width;
@@ -289,31 +723,48 @@ void Bitmap::copyRectFromBitmap(const Bitmap& src,
     if(width == 0 || height == 0)
         throw std::runtime_error("Can't copy zero height/width rectangle");
     
-    if(srcCol + width >= src.width() || srcRow + height >= src.height())
+    if(srcCol > src.width() || width > src.width() - srcCol || srcRow > src.height() || height > src.height() - srcRow)
         throw std::runtime_error("Rectangle doesn't fit within source bitmap");
 
-    if(destCol + width >= _width || destRow + height >= _height)
+    if(destCol > _width || width > _width - destCol || destRow > _height || height > _height - destRow)
         throw std::runtime_error("Rectangle doesn't fit within destination bitmap");
     
     if(_pixels == src._pixels && RectsOverlap(srcCol, srcRow, destCol, destRow, width, height))
         throw std::runtime_error("Source and destination are the same bitmap, and rects overlap. Not allowed!");
     
-    FormatConverterFunc converter = NULL;
-    if(_format != src._format)
-        converter = ConverterFuncForFormats(_format, src._format);
+    //whole rows at a time: a memcpy for the same format, a row converter otherwise
+    ConvertPixels(src.view(srcCol, srcRow, width, height), view(destCol, destRow, width, height));
+}
+
+BitmapView Bitmap::view() const {
+    return BitmapView(_pixels, _width, _height, _format);
+}
+
+BitmapView Bitmap::view(unsigned column, unsigned row, unsigned width, unsigned height) const {
+    return view().subView(column, row, width, height);
+}
+
+void Bitmap::convert(Format format) {
+    if(format == _format)
+        return;
+    
+    const size_t pixels = (size_t)_width * _height;
+    Deleter deleter;
+    unsigned char* newPixels = _allocatePixels(pixels * format, deleter);
     
-    for(unsigned row = 0; row < height; ++row){
-        for(unsigned col = 0; col < width; ++col){
-            unsigned char* srcPixel = src._pixels + GetPixelOffset(srcCol + col, srcRow + row, src._width, src._height, src._format);
-            unsigned char* destPixel = _pixels + GetPixelOffset(destCol + col, destRow + row, _width, _height, _format);
-            
-            if(converter){
-                converter(srcPixel, destPixel);
-            } else {
-                memcpy(destPixel, srcPixel, _format);
-            }
-        }
+    //the rows are contiguous, so the whole bitmap converts as one row
+    convertPixels(_pixels, _format, newPixels, format, pixels);
+    
+    _adoptPixels(newPixels, deleter);
+    _format = format;
+}
+
+void Bitmap::convertPixels(const unsigned char* src, Format srcFormat, unsigned char* dest, Format destFormat, size_t count) {
+    if(srcFormat == destFormat){
+        memcpy(dest, src, count * srcFormat);
+        return;
     }
+    RowConverterForFormats(srcFormat, destFormat)(src, dest, count);
 }
 
 void Bitmap::_set(unsigned width, 
@@ -321,32 +772,42 @@ void Bitmap::_set(unsigned width,
                   Format format, 
                   const unsigned char* pixels)
 {
-    if(width == 0) throw std::runtime_error("Zero width bitmap");
-    if(height == 0) throw std::runtime_error("Zero height bitmap");
-    if(format <= 0 || format > 4) throw std::runtime_error("Invalid bitmap format");
-
+    CheckSize(width, height, format);
+    
+    //the buffer is kept if it has the right size already
+    size_t newSize = (size_t)width * height * format;
+    if(!_pixels || newSize != (size_t)_width * _height * _format){
+        Deleter deleter;
+        unsigned char* newPixels = _allocatePixels(newSize, deleter);
+        _adoptPixels(newPixels, deleter);
+    }
+    
     _width = width;
     _height = height;
     _format = format;
     
-    size_t newSize = _width * _height * _format;
-    if(_pixels){
-        _pixels = (unsigned char*)realloc(_pixels, newSize);
-    } else {
-        _pixels = (unsigned char*)malloc(newSize);
-    }
-    
     if(pixels)
         memcpy(_pixels, pixels, newSize);
 }
 
+unsigned char* Bitmap::_allocatePixels(size_t size, Deleter& deleter) const {
+    if(_allocator){
+        BitmapAllocator* allocator = _allocator;
+        unsigned char* pixels = allocator->allocate(size);
+        deleter = [allocator, size](unsigned char* p) { allocator->deallocate(p, size); };
+        return pixels;
+    }
+    
+    unsigned char* pixels = (unsigned char*)malloc(size);
+    if(!pixels)
+        throw std::runtime_error("Out of memory allocating bitmap");
+    deleter = FreePixels;
+    return pixels;
+}
 
-
-
-
-
-
-
-
-
-
+void Bitmap::_adoptPixels(unsigned char* pixels, Deleter deleter) {
+    if(_pixels && _deleter)
+        _deleter(_pixels);
+    _pixels = pixels;
+    _deleter = std::move(deleter);
+}
@@ -18,15 +18,24 @@
 
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include "BitmapAllocator.h"
 
 namespace gk3d {
     
+    struct BitmapView;
+    
     /**
      A bitmap image (i.e. a grid of pixels).
      
      This is not really related to OpenGL, but can be used to make OpenGL textures using
      gk3d::Texture.
+     
+     Bitmaps own their pixel buffer: by default it comes from malloc, but it can come from
+     a gk3d::BitmapAllocator, or be adopted from whoever allocated it. Moving a bitmap moves
+     the buffer; copying one copies the pixels.
      */
     class Bitmap {
     public:
@@ -42,6 +51,9 @@ namespace gk3d {
             Format_RGBA = 4 /**< four channels: red, green, blue, alpha */
         };
         
+        /** Frees a pixel buffer adopted by a bitmap */
+        typedef std::function<void(unsigned char*)> Deleter;
+        
         /**
          Creates a new image with the specified width, height and format.
          
@@ -52,12 +64,77 @@ namespace gk3d {
                unsigned height, 
                Format format,
                const unsigned char* pixels = NULL);
+        
+        /**
+         Creates a new image whose buffer comes from `allocator`, as do the buffers of its
+         conversions and rotations. The allocator must outlive the bitmap.
+         */
+        Bitmap(unsigned width,
+               unsigned height,
+               Format format,
+               BitmapAllocator& allocator,
+               const unsigned char* pixels = NULL);
+        
+        /**
+         Creates a new image that takes ownership of `pixels` without copying them, and
+         calls `deleter` on them once it no longer needs them.
+         
+         If the size or format is invalid, the pixels are deleted before the exception
+         is thrown.
+         */
+        Bitmap(unsigned width,
+               unsigned height,
+               Format format,
+               unsigned char* pixels,
+               Deleter deleter);
+        
         ~Bitmap();
         
+        /**
+         Called from the decoding thread with the number of rows, from the top, decoded so
+         far, each time more rows are finished.
+         */
+        typedef std::function<void(unsigned rowsDone)> DecodeProgress;
+        
         /**
          Tries to load the given file into a gk3d::Bitmap.
+         
+         The file is mapped rather than read, and decoded straight into the bitmap's buffer
+         as decodeFile does.
          */
         static Bitmap bitmapFromFile(std::string filePath);
+        
+        /**
+         Decodes the image file at `filePath` into `dest`, converting it to the format of
+         `dest`, e.g. straight into a mapped pixel unpack buffer.
+         
+         The file is mapped, so its pages are read as the decoder gets to them. Baseline JPEGs
+         are decoded a row of MCUs at a time and non-interlaced PNGs a deflate block at a time,
+         each batch of rows resampled or unfiltered straight into `dest` and reported to
+         `progress`, so they can be uploaded while the rest decodes. Besides `dest`, the
+         decoder holds at most about one image: the component planes of a JPEG, or the
+         inflated rows of a PNG. Other formats, and interlaced PNGs, are decoded whole first
+         and then copied, reporting progress once.
+         
+         @throws std::exception if the file can not be decoded, is not the size of `dest`,
+                 or `progress` throws.
+         */
+        static void decodeFile(const std::string& filePath,
+                               const BitmapView& dest,
+                               const DecodeProgress& progress = DecodeProgress());
+        
+        /** As decodeFile, for an encoded image already in memory */
+        static void decodeMemory(const unsigned char* data,
+                                 size_t size,
+                                 const BitmapView& dest,
+                                 const DecodeProgress& progress = DecodeProgress());
+
+        /**
+         Reads the size and format of an image file without decoding its pixels.
+         
+         @result false if the file can not be read or is not an image
+         */
+        static bool infoFromFile(const std::string& filePath, unsigned& width, unsigned& height, Format& format);
                 
         /** width in pixels */
         unsigned width() const;
@@ -78,6 +155,19 @@ namespace gk3d {
          */
         unsigned char* pixelBuffer() const;
         
+        /**
+         A view of all the pixels of the bitmap, valid until the buffer is replaced.
+         */
+        BitmapView view() const;
+        
+        /**
+         A view of the rectangle with its top left at the given coordinates, which refers to
+         the bitmap's pixels rather than copying them.
+         
+         Will throw an exception if the rectangle doesn't fit within the bitmap.
+         */
+        BitmapView view(unsigned column, unsigned row, unsigned width, unsigned height) const;
+        
         /**
          Returns a pointer to the start of the pixel at the given coordinates. 
          
@@ -123,19 +213,45 @@ namespace gk3d {
                                 unsigned width,
                                 unsigned height);
         
-        /** Copy constructor */
+        /**
+         Converts the pixels of the bitmap to the given format.
+         
+         Dropped color channels are averaged into gray, and an added alpha channel is
+         opaque. Does nothing if the bitmap already has the format.
+         */
+        void convert(Format format);
+        
+        /**
+         Converts `count` consecutive pixels from one format to another, as `convert` does.
+         
+         Whole rows are converted at a time, with SSE2, SSSE3 or AVX2 shuffles depending on
+         what the CPU supports. Pixels of the same format are copied.
+         */
+        static void convertPixels(const unsigned char* src, Format srcFormat, unsigned char* dest, Format destFormat, size_t count);
+        
+        /** Copy constructor; the copy allocates from the same allocator, or with malloc */
         Bitmap(const Bitmap& other);
         
-        /** Assignment operator */
+        /** Assignment operator; reuses the buffer if it has the size of the other one's */
         Bitmap& operator = (const Bitmap& other);
         
+        /** Move constructor; `other` is left without pixels, fit only to be assigned or destroyed */
+        Bitmap(Bitmap&& other) noexcept;
+        
+        /** Move assignment operator */
+        Bitmap& operator = (Bitmap&& other) noexcept;
+        
     private:
         Format _format;
         unsigned _width;
         unsigned _height;
         unsigned char* _pixels;
+        Deleter _deleter;
+        BitmapAllocator* _allocator;
         
         void _set(unsigned width, unsigned height, Format format, const unsigned char* pixels);
+        unsigned char* _allocatePixels(size_t size, Deleter& deleter) const;
+        void _adoptPixels(unsigned char* pixels, Deleter deleter);
         static void _getPixelOffset(unsigned col, unsigned row, unsigned width, unsigned height, Format format);
     };
     
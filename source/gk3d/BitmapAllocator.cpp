@@ -0,0 +1,92 @@
+#include "BitmapAllocator.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+
+using namespace gk3d;
+
+AlignedBitmapAllocator::AlignedBitmapAllocator(size_t alignment) :
+    _alignment(alignment)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        throw std::runtime_error("Bitmap alignment must be a power of two");
+}
+
+unsigned char* AlignedBitmapAllocator::allocate(size_t size) {
+    //the offset to the start of the malloc'd block is kept just before the aligned buffer
+    const size_t padding = _alignment - 1 + sizeof(size_t);
+    unsigned char* block = (unsigned char*) malloc(size + padding);
+    if (!block)
+        throw std::bad_alloc();
+    uintptr_t aligned = ((uintptr_t) block + padding) & ~(uintptr_t) (_alignment - 1);
+    unsigned char* pixels = (unsigned char*) aligned;
+    const size_t offset = (size_t) (pixels - block);
+    memcpy(pixels - sizeof(size_t), &offset, sizeof(offset));
+    return pixels;
+}
+
+void AlignedBitmapAllocator::deallocate(unsigned char* pixels, size_t) {
+    if (!pixels)
+        return;
+    size_t offset;
+    memcpy(&offset, pixels - sizeof(size_t), sizeof(offset));
+    free(pixels - offset);
+}
+
+PooledBitmapAllocator::PooledBitmapAllocator(size_t maxBytes) :
+    _mutex(),
+    _free(),
+    _pooledBytes(0),
+    _maxBytes(maxBytes)
+{
+}
+
+PooledBitmapAllocator::~PooledBitmapAllocator() {
+    trim();
+}
+
+unsigned char* PooledBitmapAllocator::allocate(size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::multimap<size_t, unsigned char*>::iterator it = _free.find(size);
+        if (it != _free.end()) {
+            unsigned char* pixels = it->second;
+            _free.erase(it);
+            _pooledBytes -= size;
+            return pixels;
+        }
+    }
+    unsigned char* pixels = (unsigned char*) malloc(size);
+    if (!pixels)
+        throw std::bad_alloc();
+    return pixels;
+}
+
+void PooledBitmapAllocator::deallocate(unsigned char* pixels, size_t size) {
+    if (!pixels)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_pooledBytes + size <= _maxBytes) {
+            _free.insert(std::make_pair(size, pixels));
+            _pooledBytes += size;
+            return;
+        }
+    }
+    free(pixels);
+}
+
+void PooledBitmapAllocator::trim() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (std::multimap<size_t, unsigned char*>::iterator it = _free.begin(); it != _free.end(); ++it)
+        free(it->second);
+    _free.clear();
+    _pooledBytes = 0;
+}
+
+size_t PooledBitmapAllocator::pooledBytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pooledBytes;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+namespace gk3d {
+
+    /**
+    * Where a gk3d::Bitmap gets its pixel buffer from.
+    *
+    * A bitmap created with an allocator returns its buffer to it when it is destroyed,
+    * or when a conversion or rotation replaces the buffer, so the allocator must outlive
+    * the bitmap. Allocators are called from whichever thread owns the bitmap.
+    */
+    class BitmapAllocator {
+    public:
+        virtual ~BitmapAllocator() {}
+
+        /**
+        * @result a buffer of at least `size` bytes
+        *
+        * @throws std::exception if no memory is left.
+        */
+        virtual unsigned char* allocate(size_t size) = 0;
+
+        /** Takes back a buffer `allocate` returned for `size` bytes */
+        virtual void deallocate(unsigned char* pixels, size_t size) = 0;
+    };
+
+    /**
+    * Allocates buffers starting at a multiple of `alignment` bytes, e.g. for aligned SIMD
+    * loads or a cache-line aligned upload.
+    */
+    class AlignedBitmapAllocator : public BitmapAllocator {
+    public:
+        /** @param alignment  a power of two */
+        explicit AlignedBitmapAllocator(size_t alignment = 64);
+
+        unsigned char* allocate(size_t size);
+        void deallocate(unsigned char* pixels, size_t size);
+
+    private:
+        size_t _alignment;
+    };
+
+    /**
+    * Keeps the buffers of destroyed bitmaps for the next bitmaps of the same size, so
+    * decoding many images of one size allocates only as many buffers as are alive at once.
+    *
+    * Thread safe. Buffers kept beyond `maxBytes` are freed instead.
+    */
+    class PooledBitmapAllocator : public BitmapAllocator {
+    public:
+        explicit PooledBitmapAllocator(size_t maxBytes = 64 << 20);
+        ~PooledBitmapAllocator();
+
+        unsigned char* allocate(size_t size);
+        void deallocate(unsigned char* pixels, size_t size);
+
+        /** Frees every buffer kept */
+        void trim();
+
+        /** Bytes of the buffers kept for reuse */
+        size_t pooledBytes() const;
+
+    private:
+        mutable std::mutex _mutex;
+        std::multimap<size_t, unsigned char*> _free;
+        size_t _pooledBytes;
+        size_t _maxBytes;
+
+        //copying disabled
+        PooledBitmapAllocator(const PooledBitmapAllocator&);
+        const PooledBitmapAllocator& operator=(const PooledBitmapAllocator&);
+    };
+
+}
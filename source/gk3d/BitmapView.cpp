@@ -0,0 +1,365 @@
+#include "BitmapView.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK3D_VIEW_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace gk3d;
+
+//side of the square tiles transposes work through, in pixels, so the rows of a tile stay in cache
+static const unsigned TileSize = 64;
+
+//images of fewer bytes are transformed on one thread
+static const size_t ParallelBytes = 1 << 20;
+
+//threads to use for `view` when the caller asked for `threadCount`, 0 meaning all of them
+static unsigned ThreadsFor(const BitmapView& view, unsigned threadCount) {
+    if (threadCount != 0)
+        return threadCount;
+    if (view.rowBytes() * view.height < ParallelBytes)
+        return 1;
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+//runs `work(first, end)` over `count` items split between up to `threadCount` threads
+template <typename Work>
+static void ParallelRanges(unsigned count, unsigned threadCount, Work work) {
+    threadCount = std::max(std::min(threadCount, count), 1u);
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.push_back(std::thread(work, count * t / threadCount, count * (t + 1) / threadCount));
+    work(0, count / threadCount);
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+/*
+ * Transposes one square block of Block x Block pixels of PixelSize bytes: pixel (column, row)
+ * of `src` goes to (row, column) of `dest`. Strides are in bytes and may be negative.
+ * Every pixel is read before any is written.
+ */
+template <unsigned PixelSize>
+struct BlockTranspose {
+    static const unsigned Block = 4;
+
+    static void run(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dest, ptrdiff_t destStride) {
+        unsigned char block[Block * Block * PixelSize];
+        for (unsigned row = 0; row < Block; ++row)
+            memcpy(block + row * Block * PixelSize, src + row * srcStride, Block * PixelSize);
+        for (unsigned row = 0; row < Block; ++row) {
+            for (unsigned col = 0; col < Block; ++col)
+                memcpy(dest + col * destStride + row * PixelSize, block + (row * Block + col) * PixelSize, PixelSize);
+        }
+    }
+};
+
+#ifdef GK3D_VIEW_SSE2
+
+static inline __m128i Load(const unsigned char* p) {
+    return _mm_loadu_si128((const __m128i*) p);
+}
+
+static inline void Store(unsigned char* p, __m128i v) {
+    _mm_storeu_si128((__m128i*) p, v);
+}
+
+//8 x 8 bytes, through three rounds of interleaving
+template <>
+struct BlockTranspose<1> {
+    static const unsigned Block = 8;
+
+    static void run(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dest, ptrdiff_t destStride) {
+        __m128i r[8];
+        for (int i = 0; i < 8; ++i)
+            r[i] = _mm_loadl_epi64((const __m128i*) (src + i * srcStride));
+        __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]), a1 = _mm_unpacklo_epi8(r[2], r[3]);
+        __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]), a3 = _mm_unpacklo_epi8(r[6], r[7]);
+        __m128i b0 = _mm_unpacklo_epi16(a0, a1), b1 = _mm_unpackhi_epi16(a0, a1);
+        __m128i b2 = _mm_unpacklo_epi16(a2, a3), b3 = _mm_unpackhi_epi16(a2, a3);
+        //two columns of 8 rows in each register
+        __m128i c[4] = {_mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+                        _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)};
+        for (int i = 0; i < 4; ++i) {
+            _mm_storel_epi64((__m128i*) (dest + (2 * i) * destStride), c[i]);
+            _mm_storel_epi64((__m128i*) (dest + (2 * i + 1) * destStride), _mm_srli_si128(c[i], 8));
+        }
+    }
+};
+
+//8 x 8 pixels of 2 bytes
+template <>
+struct BlockTranspose<2> {
+    static const unsigned Block = 8;
+
+    static void run(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dest, ptrdiff_t destStride) {
+        __m128i r[8];
+        for (int i = 0; i < 8; ++i)
+            r[i] = Load(src + i * srcStride);
+        __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]), a1 = _mm_unpackhi_epi16(r[0], r[1]);
+        __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]), a3 = _mm_unpackhi_epi16(r[2], r[3]);
+        __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]), a5 = _mm_unpackhi_epi16(r[4], r[5]);
+        __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]), a7 = _mm_unpackhi_epi16(r[6], r[7]);
+        __m128i b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);
+        __m128i b2 = _mm_unpacklo_epi32(a1, a3), b3 = _mm_unpackhi_epi32(a1, a3);
+        __m128i b4 = _mm_unpacklo_epi32(a4, a6), b5 = _mm_unpackhi_epi32(a4, a6);
+        __m128i b6 = _mm_unpacklo_epi32(a5, a7), b7 = _mm_unpackhi_epi32(a5, a7);
+        Store(dest, _mm_unpacklo_epi64(b0, b4));
+        Store(dest + destStride, _mm_unpackhi_epi64(b0, b4));
+        Store(dest + 2 * destStride, _mm_unpacklo_epi64(b1, b5));
+        Store(dest + 3 * destStride, _mm_unpackhi_epi64(b1, b5));
+        Store(dest + 4 * destStride, _mm_unpacklo_epi64(b2, b6));
+        Store(dest + 5 * destStride, _mm_unpackhi_epi64(b2, b6));
+        Store(dest + 6 * destStride, _mm_unpacklo_epi64(b3, b7));
+        Store(dest + 7 * destStride, _mm_unpackhi_epi64(b3, b7));
+    }
+};
+
+//4 x 4 pixels of 4 bytes
+template <>
+struct BlockTranspose<4> {
+    static const unsigned Block = 4;
+
+    static void run(const unsigned char* src, ptrdiff_t srcStride, unsigned char* dest, ptrdiff_t destStride) {
+        __m128i r0 = Load(src), r1 = Load(src + srcStride), r2 = Load(src + 2 * srcStride), r3 = Load(src + 3 * srcStride);
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+        Store(dest, _mm_unpacklo_epi64(t0, t1));
+        Store(dest + destStride, _mm_unpackhi_epi64(t0, t1));
+        Store(dest + 2 * destStride, _mm_unpacklo_epi64(t2, t3));
+        Store(dest + 3 * destStride, _mm_unpackhi_epi64(t2, t3));
+    }
+};
+
+#endif
+
+/*
+ * Transposes the source rows [firstRow, endRow) tile by tile: pixel (column, row) of `src`
+ * goes to `dest + column * destStride + row * PixelSize`.
+ */
+template <unsigned PixelSize>
+static void TransposeRows(const BitmapView& src, unsigned char* dest, ptrdiff_t destStride, unsigned firstRow, unsigned endRow) {
+    typedef BlockTranspose<PixelSize> Kernel;
+    const unsigned B = Kernel::Block;
+    const ptrdiff_t srcStride = (ptrdiff_t) src.rowStride;
+
+    for (unsigned tileRow = firstRow; tileRow < endRow; tileRow += TileSize) {
+        const unsigned rowEnd = std::min(tileRow + TileSize, endRow);
+        for (unsigned tileCol = 0; tileCol < src.width; tileCol += TileSize) {
+            const unsigned colEnd = std::min(tileCol + TileSize, src.width);
+            unsigned row = tileRow;
+            for (; row + B <= rowEnd; row += B) {
+                unsigned col = tileCol;
+                for (; col + B <= colEnd; col += B)
+                    Kernel::run(src.pixel(col, row), srcStride, dest + col * destStride + row * PixelSize, destStride);
+                for (; col < colEnd; ++col) {
+                    for (unsigned k = row; k < row + B; ++k)
+                        memcpy(dest + col * destStride + k * PixelSize, src.pixel(col, k), PixelSize);
+                }
+            }
+            for (; row < rowEnd; ++row) {
+                for (unsigned col = tileCol; col < colEnd; ++col)
+                    memcpy(dest + col * destStride + row * PixelSize, src.pixel(col, row), PixelSize);
+            }
+        }
+    }
+}
+
+template <unsigned PixelSize>
+static void TransposeTo(const BitmapView& src, unsigned char* dest, ptrdiff_t destStride, unsigned threadCount) {
+    const unsigned tileRows = (src.height + TileSize - 1) / TileSize;
+    ParallelRanges(tileRows, threadCount, [&src, dest, destStride](unsigned first, unsigned end) {
+        TransposeRows<PixelSize>(src, dest, destStride, first * TileSize, std::min(end * TileSize, src.height));
+    });
+}
+
+static void TransposeFormat(const BitmapView& src, unsigned char* dest, ptrdiff_t destStride, unsigned threadCount) {
+    switch (src.format) {
+        case Bitmap::Format_Grayscale: TransposeTo<1>(src, dest, destStride, threadCount); break;
+        case Bitmap::Format_GrayscaleAlpha: TransposeTo<2>(src, dest, destStride, threadCount); break;
+        case Bitmap::Format_RGB: TransposeTo<3>(src, dest, destStride, threadCount); break;
+        case Bitmap::Format_RGBA: TransposeTo<4>(src, dest, destStride, threadCount); break;
+        default: throw std::runtime_error("Unhandled bitmap format");
+    }
+}
+
+static void CheckTransposed(const BitmapView& src, const BitmapView& dest) {
+    if (src.format != dest.format)
+        throw std::runtime_error("Bitmap views differ in format");
+    if (src.width != dest.height || src.height != dest.width)
+        throw std::runtime_error("Destination view is not the size of the transposed source");
+}
+
+//swaps the block at (column, row) with the one at (row, column); both are the same block on the diagonal
+template <unsigned PixelSize>
+static void SwapBlocks(const BitmapView& view, unsigned column, unsigned row) {
+    typedef BlockTranspose<PixelSize> Kernel;
+    const unsigned B = Kernel::Block;
+    const ptrdiff_t stride = (ptrdiff_t) view.rowStride;
+    unsigned char block[B * B * PixelSize];
+    for (unsigned k = 0; k < B; ++k)
+        memcpy(block + k * B * PixelSize, view.pixel(column, row + k), B * PixelSize);
+    if (column != row)
+        Kernel::run(view.pixel(row, column), stride, view.pixel(column, row), stride);
+    Kernel::run(block, B * PixelSize, view.pixel(row, column), stride);
+}
+
+//transposes in place the tiles of the square view on and to the right of the diagonal in tile row `tileRow`
+template <unsigned PixelSize>
+static void TransposeTileRow(const BitmapView& view, unsigned tileRow) {
+    const unsigned B = BlockTranspose<PixelSize>::Block;
+    const unsigned size = view.width;
+    //pixels past the last whole block are swapped one by one
+    const unsigned whole = size - size % B;
+    unsigned char pixel[PixelSize];
+
+    const unsigned rowStart = tileRow * TileSize, rowEnd = std::min(rowStart + TileSize, size);
+    for (unsigned colStart = rowStart; colStart < size; colStart += TileSize) {
+        const unsigned colEnd = std::min(colStart + TileSize, size);
+        for (unsigned row = rowStart; row + B <= std::min(rowEnd, whole); row += B) {
+            for (unsigned col = std::max(colStart, row); col + B <= std::min(colEnd, whole); col += B)
+                SwapBlocks<PixelSize>(view, col, row);
+        }
+        for (unsigned row = rowStart; row < rowEnd; ++row) {
+            for (unsigned col = std::max(colStart, row + 1); col < colEnd; ++col) {
+                if (row < whole && col < whole)
+                    continue;
+                memcpy(pixel, view.pixel(col, row), PixelSize);
+                memcpy(view.pixel(col, row), view.pixel(row, col), PixelSize);
+                memcpy(view.pixel(row, col), pixel, PixelSize);
+            }
+        }
+    }
+}
+
+template <unsigned PixelSize>
+static void TransposeInPlace(const BitmapView& view, unsigned threadCount) {
+    //tile row i has a tile for each tile row below it, so threads take rows from both ends in pairs
+    const unsigned tileRows = (view.height + TileSize - 1) / TileSize;
+    ParallelRanges((tileRows + 1) / 2, threadCount, [&view, tileRows](unsigned first, unsigned end) {
+        for (unsigned pair = first; pair < end; ++pair) {
+            TransposeTileRow<PixelSize>(view, pair);
+            if (tileRows - 1 - pair != pair)
+                TransposeTileRow<PixelSize>(view, tileRows - 1 - pair);
+        }
+    });
+}
+
+BitmapView::BitmapView() :
+    pixels(NULL),
+    width(0),
+    height(0),
+    format(Bitmap::Format_RGBA),
+    rowStride(0)
+{
+}
+
+BitmapView::BitmapView(unsigned char* pixels, unsigned width, unsigned height, Bitmap::Format format, size_t rowStride) :
+    pixels(pixels),
+    width(width),
+    height(height),
+    format(format),
+    rowStride(rowStride != 0 ? rowStride : (size_t) width * format)
+{
+    if (this->rowStride < rowBytes())
+        throw std::runtime_error("Bitmap view rows overlap");
+}
+
+size_t BitmapView::rowBytes() const {
+    return (size_t) width * format;
+}
+
+bool BitmapView::isContiguous() const {
+    return rowStride == rowBytes() || height <= 1;
+}
+
+unsigned char* BitmapView::row(unsigned row) const {
+    return pixels + row * rowStride;
+}
+
+unsigned char* BitmapView::pixel(unsigned column, unsigned row) const {
+    return pixels + row * rowStride + (size_t) column * format;
+}
+
+BitmapView BitmapView::subView(unsigned column, unsigned row, unsigned width, unsigned height) const {
+    if (column > this->width || width > this->width - column || row > this->height || height > this->height - row)
+        throw std::runtime_error("Rectangle doesn't fit within bitmap view");
+    return BitmapView(pixel(column, row), width, height, format, rowStride);
+}
+
+void gk3d::CopyPixels(const BitmapView& src, const BitmapView& dest) {
+    if (src.format != dest.format)
+        throw std::runtime_error("Bitmap views differ in format");
+    ConvertPixels(src, dest);
+}
+
+void gk3d::ConvertPixels(const BitmapView& src, const BitmapView& dest) {
+    if (src.width != dest.width || src.height != dest.height)
+        throw std::runtime_error("Bitmap views differ in size");
+    if (src.width == 0 || src.height == 0)
+        return;
+
+    //contiguous views are one long row
+    if (src.isContiguous() && dest.isContiguous()) {
+        Bitmap::convertPixels(src.pixels, src.format, dest.pixels, dest.format, (size_t) src.width * src.height);
+        return;
+    }
+    for (unsigned row = 0; row < src.height; ++row)
+        Bitmap::convertPixels(src.row(row), src.format, dest.row(row), dest.format, src.width);
+}
+
+void gk3d::BlitPixels(const BitmapView& src, const BitmapView& dest, unsigned destColumn, unsigned destRow) {
+    if (destColumn >= dest.width || destRow >= dest.height)
+        return;
+    const unsigned width = std::min(src.width, dest.width - destColumn);
+    const unsigned height = std::min(src.height, dest.height - destRow);
+    ConvertPixels(src.subView(0, 0, width, height), dest.subView(destColumn, destRow, width, height));
+}
+
+void gk3d::FlipVertically(const BitmapView& view, unsigned threadCount) {
+    ParallelRanges(view.height / 2, ThreadsFor(view, threadCount), [&view](unsigned first, unsigned end) {
+        unsigned char buffer[4096];
+        const size_t rowBytes = view.rowBytes();
+        for (unsigned row = first; row < end; ++row) {
+            unsigned char* top = view.row(row);
+            unsigned char* bottom = view.row(view.height - row - 1);
+            for (size_t offset = 0; offset < rowBytes; offset += sizeof(buffer)) {
+                const size_t size = std::min(sizeof(buffer), rowBytes - offset);
+                memcpy(buffer, top + offset, size);
+                memcpy(top + offset, bottom + offset, size);
+                memcpy(bottom + offset, buffer, size);
+            }
+        }
+    });
+}
+
+void gk3d::TransposePixels(const BitmapView& src, const BitmapView& dest, unsigned threadCount) {
+    CheckTransposed(src, dest);
+    TransposeFormat(src, dest.pixels, (ptrdiff_t) dest.rowStride, ThreadsFor(src, threadCount));
+}
+
+void gk3d::RotatePixelsCounterClockwise(const BitmapView& src, const BitmapView& dest, unsigned threadCount) {
+    CheckTransposed(src, dest);
+    if (src.width == 0 || src.height == 0)
+        return;
+    //a transpose that writes the destination rows from the bottom up
+    TransposeFormat(src, dest.row(dest.height - 1), -(ptrdiff_t) dest.rowStride, ThreadsFor(src, threadCount));
+}
+
+void gk3d::TransposePixelsInPlace(const BitmapView& view, unsigned threadCount) {
+    if (view.width != view.height)
+        throw std::runtime_error("Only square bitmap views can be transposed in place");
+    threadCount = ThreadsFor(view, threadCount);
+    switch (view.format) {
+        case Bitmap::Format_Grayscale: TransposeInPlace<1>(view, threadCount); break;
+        case Bitmap::Format_GrayscaleAlpha: TransposeInPlace<2>(view, threadCount); break;
+        case Bitmap::Format_RGB: TransposeInPlace<3>(view, threadCount); break;
+        case Bitmap::Format_RGBA: TransposeInPlace<4>(view, threadCount); break;
+        default: throw std::runtime_error("Unhandled bitmap format");
+    }
+}
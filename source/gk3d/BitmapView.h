@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include "Bitmap.h"
+
+namespace gk3d {
+
+    /**
+    * Pixels of some image in memory it does not own: a gk3d::Bitmap, a rectangle of one,
+    * a mapped pixel buffer or a mapped file.
+    *
+    * Rows are `rowStride` bytes apart, which may be more than `width` pixels, so a view
+    * of a rectangle references the pixels where they are rather than copying them. The
+    * memory must outlive the view. Views of read-only memory may only be read from.
+    */
+    struct BitmapView {
+        /** the top left pixel */
+        unsigned char* pixels;
+        unsigned width;
+        unsigned height;
+        Bitmap::Format format;
+        /** bytes from the start of one row to the start of the next */
+        size_t rowStride;
+
+        /** An empty view */
+        BitmapView();
+
+        /**
+        * @param rowStride  0 for rows of exactly `width` pixels
+        */
+        BitmapView(unsigned char* pixels, unsigned width, unsigned height, Bitmap::Format format, size_t rowStride = 0);
+
+        /** Bytes of the pixels of one row */
+        size_t rowBytes() const;
+
+        /** true if the rows follow each other without gaps */
+        bool isContiguous() const;
+
+        /** The first pixel of `row` */
+        unsigned char* row(unsigned row) const;
+
+        /** The pixel at the given coordinates; not bounds checked */
+        unsigned char* pixel(unsigned column, unsigned row) const;
+
+        /**
+        * The rectangle of `width` x `height` pixels with its top left at (column, row).
+        *
+        * @throws std::exception if the rectangle does not fit within the view.
+        */
+        BitmapView subView(unsigned column, unsigned row, unsigned width, unsigned height) const;
+    };
+
+    /**
+    * Copies the pixels of `src` to `dest`, a row at a time, or with a single memcpy if both
+    * views are contiguous. The views must not overlap.
+    *
+    * @throws std::exception if the views differ in size or format.
+    */
+    void CopyPixels(const BitmapView& src, const BitmapView& dest);
+
+    /**
+    * Converts the pixels of `src` to the format of `dest`, as gk3d::Bitmap::convert does, a row
+    * at a time. Views of the same format are copied. The views must not overlap.
+    *
+    * @throws std::exception if the views differ in size.
+    */
+    void ConvertPixels(const BitmapView& src, const BitmapView& dest);
+
+    /**
+    * Converts `src` into the rectangle of `dest` with its top left at (destColumn, destRow),
+    * clipped to `dest`. The views must not overlap.
+    */
+    void BlitPixels(const BitmapView& src, const BitmapView& dest, unsigned destColumn, unsigned destRow);
+
+    /**
+    * Reverses the row order of the pixels in place, swapping rows through a small buffer
+    * on the stack.
+    *
+    * @param threadCount  threads sharing the rows; 0 uses every hardware thread for images
+    *                     of a megabyte or more, and one thread for smaller ones
+    */
+    void FlipVertically(const BitmapView& view, unsigned threadCount = 0);
+
+    /**
+    * Writes pixel (column, row) of `src` to (row, column) of `dest`.
+    *
+    * The image is walked in tiles of 64 x 64 pixels, so rows of both views stay in cache,
+    * and each tile in blocks transposed within SSE2 registers: 8 x 8 pixels of 1 and 2
+    * bytes, 4 x 4 of 4 bytes. RGB pixels go through a portable kernel instead: each 4 x 4
+    * block is copied a row at a time into a buffer on the stack and written out from it.
+    * The views must not overlap.
+    *
+    * @param threadCount  threads sharing the rows of tiles, as for FlipVertically
+    *
+    * @throws std::exception if the formats differ, or `dest` is not `src.height` x `src.width`.
+    */
+    void TransposePixels(const BitmapView& src, const BitmapView& dest, unsigned threadCount = 0);
+
+    /**
+    * Writes `src` rotated by 90 degrees counter clockwise to `dest`: a transpose that fills
+    * `dest` from its bottom row up. Requirements as for TransposePixels.
+    */
+    void RotatePixelsCounterClockwise(const BitmapView& src, const BitmapView& dest, unsigned threadCount = 0);
+
+    /**
+    * Transposes a square view in place, swapping pairs of blocks across the diagonal.
+    *
+    * @throws std::exception if the view is not square.
+    */
+    void TransposePixelsInPlace(const BitmapView& view, unsigned threadCount = 0);
+
+}
@@ -0,0 +1,273 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK3D_BLOCK_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace gk3d;
+
+//copies the 4x4 pixels at block (bx, by), repeating the last column and row past the edges
+static void LoadBlock(const unsigned char *rgba, unsigned width, unsigned height, unsigned bx, unsigned by, unsigned char block[64]) {
+    for (unsigned y = 0; y < 4; ++y) {
+        unsigned row = std::min(by * 4 + y, height - 1);
+        for (unsigned x = 0; x < 4; ++x) {
+            unsigned col = std::min(bx * 4 + x, width - 1);
+            memcpy(block + (y * 4 + x) * 4, rgba + ((size_t) row * width + col) * 4, 4);
+        }
+    }
+}
+
+static inline unsigned short Pack565(const int color[3]) {
+    int r = (color[0] * 31 + 127) / 255;
+    int g = (color[1] * 63 + 127) / 255;
+    int b = (color[2] * 31 + 127) / 255;
+    return (unsigned short) ((r << 11) | (g << 5) | b);
+}
+
+static inline void Unpack565(unsigned short packed, int color[3]) {
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+//per channel minimum and maximum of the 16 pixels
+static void ColorBounds(const unsigned char block[64], unsigned char minColor[4], unsigned char maxColor[4]) {
+#ifdef GK3D_BLOCK_SSE2
+    __m128i p0 = _mm_loadu_si128((const __m128i *) block);
+    __m128i p1 = _mm_loadu_si128((const __m128i *) (block + 16));
+    __m128i p2 = _mm_loadu_si128((const __m128i *) (block + 32));
+    __m128i p3 = _mm_loadu_si128((const __m128i *) (block + 48));
+    __m128i mn = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+    __m128i mx = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+    mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+    mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+    mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+    mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+    int packedMin = _mm_cvtsi128_si32(mn);
+    int packedMax = _mm_cvtsi128_si32(mx);
+    memcpy(minColor, &packedMin, 4);
+    memcpy(maxColor, &packedMax, 4);
+#else
+    memcpy(minColor, block, 4);
+    memcpy(maxColor, block, 4);
+    for (int i = 1; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+            maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+        }
+    }
+#endif
+}
+
+//index of the nearest of the 4 palette colours for every pixel, alpha ignored
+static void NearestColors(const unsigned char block[64], const int palette[4][3], unsigned indices[16]) {
+#ifdef GK3D_BLOCK_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i colors[4];
+    for (int k = 0; k < 4; ++k)
+        colors[k] = _mm_set_epi16(0, (short) palette[k][2], (short) palette[k][1], (short) palette[k][0],
+                                  0, (short) palette[k][2], (short) palette[k][1], (short) palette[k][0]);
+
+    for (int group = 0; group < 4; ++group) {
+        __m128i pixels = _mm_and_si128(_mm_loadu_si128((const __m128i *) (block + group * 16)), rgbMask);
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        __m128i best = _mm_setzero_si128();
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int k = 0; k < 4; ++k) {
+            //squared distances, summed from the (r, g) and (b, a) pairs madd leaves per pixel
+            __m128i dlo = _mm_sub_epi16(lo, colors[k]);
+            __m128i dhi = _mm_sub_epi16(hi, colors[k]);
+            dlo = _mm_madd_epi16(dlo, dlo);
+            dhi = _mm_madd_epi16(dhi, dhi);
+            dlo = _mm_add_epi32(dlo, _mm_shuffle_epi32(dlo, _MM_SHUFFLE(2, 3, 0, 1)));
+            dhi = _mm_add_epi32(dhi, _mm_shuffle_epi32(dhi, _MM_SHUFFLE(2, 3, 0, 1)));
+            __m128i distance = _mm_unpacklo_epi64(_mm_shuffle_epi32(dlo, _MM_SHUFFLE(3, 1, 2, 0)),
+                                                  _mm_shuffle_epi32(dhi, _MM_SHUFFLE(3, 1, 2, 0)));
+            if (k == 0) {
+                best = distance;
+                continue;
+            }
+            __m128i closer = _mm_cmplt_epi32(distance, best);
+            best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+            bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+        }
+        _mm_storeu_si128((__m128i *) (indices + group * 4), bestIndex);
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        int best = 0x7FFFFFFF;
+        for (unsigned k = 0; k < 4; ++k) {
+            int dr = block[i * 4] - palette[k][0];
+            int dg = block[i * 4 + 1] - palette[k][1];
+            int db = block[i * 4 + 2] - palette[k][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < best) {
+                best = distance;
+                indices[i] = k;
+            }
+        }
+    }
+#endif
+}
+
+//a BC1 colour block, always in the 4 colour mode
+static void EncodeColorBlock(const unsigned char block[64], unsigned char *output) {
+    unsigned char minColor[4], maxColor[4];
+    ColorBounds(block, minColor, maxColor);
+
+    //inset the box, so the endpoints sit closer to the colours they stand for
+    int low[3], high[3];
+    for (int c = 0; c < 3; ++c) {
+        int inset = (maxColor[c] - minColor[c]) >> 4;
+        low[c] = minColor[c] + inset;
+        high[c] = maxColor[c] - inset;
+    }
+
+    //the box diagonal is min -> max in every channel; flip the channels that run against green
+    int center[3] = {(low[0] + high[0]) / 2, (low[1] + high[1]) / 2, (low[2] + high[2]) / 2};
+    int covarianceRG = 0, covarianceBG = 0;
+    for (int i = 0; i < 16; ++i) {
+        int g = block[i * 4 + 1] - center[1];
+        covarianceRG += (block[i * 4] - center[0]) * g;
+        covarianceBG += (block[i * 4 + 2] - center[2]) * g;
+    }
+    if (covarianceRG < 0)
+        std::swap(low[0], high[0]);
+    if (covarianceBG < 0)
+        std::swap(low[2], high[2]);
+
+    unsigned short color0 = Pack565(high);
+    unsigned short color1 = Pack565(low);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    unsigned bits = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        Unpack565(color0, palette[0]);
+        Unpack565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        unsigned indices[16];
+        NearestColors(block, palette, indices);
+        for (int i = 0; i < 16; ++i)
+            bits |= indices[i] << (2 * i);
+    }
+
+    output[0] = (unsigned char) (color0 & 0xFF);
+    output[1] = (unsigned char) (color0 >> 8);
+    output[2] = (unsigned char) (color1 & 0xFF);
+    output[3] = (unsigned char) (color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        output[4 + i] = (unsigned char) (bits >> (8 * i));
+}
+
+//a BC4 block of one channel, in the 8 value mode
+static void EncodeChannelBlock(const unsigned char block[64], int channel, unsigned char *output) {
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; ++i) {
+        low = std::min(low, (int) block[i * 4 + channel]);
+        high = std::max(high, (int) block[i * 4 + channel]);
+    }
+
+    //palette position p holds ((7 - p) * high + p * low) / 7; positions 0 and 7 are indices 0 and 1
+    unsigned long long bits = 0;
+    const int range = high - low;
+    if (range > 0) {
+        for (int i = 0; i < 16; ++i) {
+            int position = ((high - block[i * 4 + channel]) * 14 + range) / (2 * range);
+            unsigned long long index = position == 0 ? 0 : position == 7 ? 1 : position + 1;
+            bits |= index << (3 * i);
+        }
+    }
+
+    output[0] = (unsigned char) high;
+    output[1] = (unsigned char) low;
+    for (int i = 0; i < 6; ++i)
+        output[2 + i] = (unsigned char) (bits >> (8 * i));
+}
+
+static void EncodeBlock(const unsigned char block[64], BlockFormat format, unsigned char *output) {
+    switch (format) {
+        case BlockFormat_BC1:
+            EncodeColorBlock(block, output);
+            break;
+        case BlockFormat_BC3:
+            EncodeChannelBlock(block, 3, output);
+            EncodeColorBlock(block, output + 8);
+            break;
+        case BlockFormat_BC4:
+            EncodeChannelBlock(block, 0, output);
+            break;
+        case BlockFormat_BC5:
+            EncodeChannelBlock(block, 0, output);
+            EncodeChannelBlock(block, 1, output + 8);
+            break;
+    }
+}
+
+static void EncodeRows(const unsigned char *rgba, unsigned width, unsigned height, BlockFormat format,
+                       unsigned char *output, unsigned firstRow, unsigned endRow) {
+    const unsigned blocksX = (width + 3) / 4;
+    const size_t blockSize = BlockSize(format);
+    unsigned char block[64];
+    for (unsigned by = firstRow; by < endRow; ++by) {
+        unsigned char *row = output + (size_t) by * blocksX * blockSize;
+        for (unsigned bx = 0; bx < blocksX; ++bx) {
+            LoadBlock(rgba, width, height, bx, by, block);
+            EncodeBlock(block, format, row + bx * blockSize);
+        }
+    }
+}
+
+size_t gk3d::BlockSize(BlockFormat format) {
+    return format == BlockFormat_BC1 || format == BlockFormat_BC4 ? 8 : 16;
+}
+
+size_t gk3d::CompressedSize(BlockFormat format, unsigned width, unsigned height) {
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * BlockSize(format);
+}
+
+GLenum gk3d::CompressedInternalFormat(BlockFormat format) {
+    switch (format) {
+        case BlockFormat_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BlockFormat_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case BlockFormat_BC5: return GL_COMPRESSED_RG_RGTC2;
+        default: throw std::runtime_error("Unrecognised BlockFormat");
+    }
+}
+
+void gk3d::CompressBlocks(const unsigned char *rgba, unsigned width, unsigned height, BlockFormat format,
+                          unsigned char *output, unsigned threadCount) {
+    if (width == 0 || height == 0)
+        return;
+
+    const unsigned blocksY = (height + 3) / 4;
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = std::min(threadCount, blocksY);
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t) {
+        threads.push_back(std::thread(EncodeRows, rgba, width, height, format, output,
+                                      blocksY * t / threadCount, blocksY * (t + 1) / threadCount));
+    }
+    EncodeRows(rgba, width, height, format, output, 0, blocksY / threadCount);
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+
+namespace gk3d {
+
+    /**
+    * Block-compressed texture formats. Each encodes 4x4 pixel blocks at a fixed size.
+    */
+    enum BlockFormat {
+        /** S3TC DXT1: RGB at 4 bits per pixel */
+        BlockFormat_BC1,
+        /** S3TC DXT5: RGB as BC1 plus alpha as BC4, 8 bits per pixel */
+        BlockFormat_BC3,
+        /** RGTC1: the red channel at 4 bits per pixel */
+        BlockFormat_BC4,
+        /** RGTC2: the red and green channels as two BC4 blocks, 8 bits per pixel */
+        BlockFormat_BC5
+    };
+
+    /** Bytes per 4x4 block of `format` */
+    size_t BlockSize(BlockFormat format);
+
+    /** Bytes of a `width` x `height` image in `format`; partial blocks at the edges count whole */
+    size_t CompressedSize(BlockFormat format, unsigned width, unsigned height);
+
+    /** The internal format glCompressedTexImage* takes for `format` */
+    GLenum CompressedInternalFormat(BlockFormat format);
+
+    /**
+    * Encodes RGBA pixels into blocks of `format`, in rows of blocks from the top left.
+    *
+    * Endpoints are the corners of each block's colour bounding box, inset by 1/16 of its
+    * size and flipped onto the diagonal the colours correlate along; every pixel then
+    * takes the nearest palette entry. Pixels of partial blocks at the right and bottom
+    * edges repeat the last column and row. Colour palette searches use SSE2 where available.
+    *
+    * @param rgba         `width` x `height` pixels of 4 bytes, rows from the top
+    * @param output       receives CompressedSize(format, width, height) bytes
+    * @param threadCount  threads sharing the rows of blocks; 0 uses every hardware thread
+    */
+    void CompressBlocks(const unsigned char *rgba, unsigned width, unsigned height, BlockFormat format,
+                        unsigned char *output, unsigned threadCount = 0);
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+
+namespace gk3d {
+
+    /**
+    * Local-space bounding volumes of a mesh: an axis aligned box and a sphere around
+    * the box centre.
+    */
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+        glm::vec3 center;
+        float radius;
+
+        /** Empty bounds, which `merge` treats as nothing */
+        Bounds() :
+                min(FLT_MAX),
+                max(-FLT_MAX),
+                center(),
+                radius(-1.0f) {
+        }
+
+        bool isEmpty() const {
+            return radius < 0.0f;
+        }
+
+        /** Half the size of the box along each axis */
+        glm::vec3 extent() const {
+            return (max - min) * 0.5f;
+        }
+
+        /**
+        * Bounds of `count` vertices whose first three of `floatsPerVertex` floats are the position.
+        */
+        static Bounds fromVertices(const GLfloat *vertices, size_t count, size_t floatsPerVertex) {
+            Bounds bounds;
+            if (count == 0)
+                return bounds;
+
+            for (size_t i = 0; i < count; ++i) {
+                glm::vec3 p(vertices[i * floatsPerVertex], vertices[i * floatsPerVertex + 1], vertices[i * floatsPerVertex + 2]);
+                bounds.min = glm::min(bounds.min, p);
+                bounds.max = glm::max(bounds.max, p);
+            }
+            bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+            float radiusSquared = 0.0f;
+            for (size_t i = 0; i < count; ++i) {
+                glm::vec3 p(vertices[i * floatsPerVertex], vertices[i * floatsPerVertex + 1], vertices[i * floatsPerVertex + 2]);
+                glm::vec3 d = p - bounds.center;
+                radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+            }
+            bounds.radius = glm::sqrt(radiusSquared);
+            return bounds;
+        }
+
+        /**
+        * Grows the bounds to enclose `other` as well.
+        */
+        void merge(const Bounds &other) {
+            if (other.isEmpty())
+                return;
+            if (isEmpty()) {
+                *this = other;
+                return;
+            }
+
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+
+            //smallest sphere enclosing both spheres
+            glm::vec3 offset = other.center - center;
+            float distance = glm::length(offset);
+            if (distance + other.radius <= radius)
+                return;
+            if (distance + radius <= other.radius) {
+                center = other.center;
+                radius = other.radius;
+                return;
+            }
+            float newRadius = (distance + radius + other.radius) * 0.5f;
+            center += offset * ((newRadius - radius) / distance);
+            radius = newRadius;
+        }
+    };
+
+}
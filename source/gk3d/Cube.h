@@ -102,156 +102,3 @@ static GLfloat CUBE[] = {
         1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 0.0f,
         1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f
 };
-
-GLfloat CUBE_UV[] = {
-        // U     V
-        // bottom
-        0.0f, 0.0f,
-        1.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 0.0f,
-        1.0f, 1.0f,
-        0.0f, 1.0f,
-
-        // top
-        0.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 0.0f,
-        1.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-
-        // front
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-
-        // back
-        0.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 0.0f,
-        1.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-
-        // left
-        0.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-
-        // right
-        1.0f, 1.0f,
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-        0.0f, 1.0f
-};
-
-GLfloat LOGO_UV[] = {
-        // U     V
-        // bottom
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // top
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // front
-        1.0f, 0.0f,
-        0.0f, 0.0f,
-        1.0f, 1.0f,
-        0.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-
-        // back
-        0.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 0.0f,
-        1.0f, 0.0f,
-        0.0f, 1.0f,
-        1.0f, 1.0f,
-
-        // left
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // right
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f
-};
-
-GLfloat COURT_UV[] = {
-        // U     V
-        // bottom
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // top
-        0.0f, 0.0f,
-        0.0f, 10.0f,
-        10.0f, 0.0f,
-        10.0f, 0.0f,
-        0.0f, 10.0f,
-        10.0f, 10.0f,
-
-        // front
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // back
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // left
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-
-        // right
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 0.0f
-};
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "FrameState.h"
+#include <algorithm>
+#include <cstddef>
+
+using namespace gk3d;
+
+namespace {
+    //std140 image of the `Frame` block
+    struct FrameBlock {
+        glm::mat4 camera;
+        glm::vec3 cameraPosition;
+        float _padding;
+        Fog fog;
+    };
+
+    //std140 image of the `Lights` block
+    struct LightsBlock {
+        GLint numLights;
+        GLint _padding[3];
+        Light lights[FrameState::MaxLights];
+    };
+
+    static_assert(sizeof(Fog) == 32, "Fog must match its std140 layout");
+    static_assert(sizeof(Light) == 64, "Light must match its std140 layout");
+    static_assert(offsetof(FrameBlock, fog) == 80, "Frame must match its std140 layout");
+    static_assert(offsetof(LightsBlock, lights) == 16, "Lights must match its std140 layout");
+}
+
+FrameState::FrameState() :
+    _frameBuffer(0),
+    _lightsBuffer(0),
+    _fog(),
+    _lights()
+{
+    glGenBuffers(1, &_frameBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _frameBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &_lightsBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _lightsBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, FrameBlockBinding, _frameBuffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LightsBlockBinding, _lightsBuffer);
+}
+
+FrameState::~FrameState() {
+    glDeleteBuffers(1, &_frameBuffer);
+    glDeleteBuffers(1, &_lightsBuffer);
+}
+
+Fog& FrameState::fog() {
+    return _fog;
+}
+
+std::vector<Light>& FrameState::lights() {
+    return _lights;
+}
+
+void FrameState::upload(const Camera& camera) {
+    FrameBlock frame;
+    frame.camera = camera.matrix();
+    frame.cameraPosition = camera.position();
+    frame._padding = 0.0f;
+    frame.fog = _fog;
+
+    LightsBlock lights;
+    lights.numLights = (GLint)std::min(_lights.size(), (size_t)MaxLights);
+    std::copy(_lights.begin(), _lights.begin() + lights.numLights, lights.lights);
+
+    //orphan the previous contents, the GPU may still be reading them
+    glBindBuffer(GL_UNIFORM_BUFFER, _frameBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), &frame, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, _lightsBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), &lights, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameState::bindBlocks(const Program& program) {
+    program.bindUniformBlock("Frame", FrameBlockBinding);
+    program.bindUniformBlock("Lights", LightsBlockBinding);
+}
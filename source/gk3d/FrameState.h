@@ -0,0 +1,100 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Camera.h"
+#include "Program.h"
+
+namespace gk3d {
+
+    /**
+    * Fog parameters, laid out as the std140 `Fog` struct of the scene shaders.
+    */
+    struct Fog {
+        glm::vec4 color;
+        float density;
+        float start;
+        float end;
+        /**
+        * 0 - exp
+        * 1 - exp2
+        * 2 - linear
+        */
+        int eq;
+    };
+
+    /**
+    * A light, laid out as the std140 `Light` struct of the scene shaders.
+    */
+    struct Light {
+        glm::vec4 position;
+        glm::vec3 intensities; //a.k.a. the color of the light
+        float attenuation;
+        glm::vec3 coneDirection;
+        float coneAngle;
+        float ambientCoefficient;
+        float _padding[3];
+
+        Light() :
+                position(),
+                intensities(),
+                attenuation(0.0f),
+                coneDirection(),
+                coneAngle(0.0f),
+                ambientCoefficient(0.0f) {
+        }
+    };
+
+    /**
+    * Scene-wide shader state that is the same for every draw of a frame.
+    *
+    * The camera, fog and lights are packed into the std140 uniform blocks `Frame` and
+    * `Lights`, uploaded once per frame and bound to fixed binding points shared by every
+    * gk3d::Program (see `bindBlocks`).
+    */
+    class FrameState {
+    public:
+        static const GLuint FrameBlockBinding = 0;
+        static const GLuint LightsBlockBinding = 1;
+
+        /** Must match MAX_LIGHTS in the scene shaders */
+        static const int MaxLights = 10;
+
+        /**
+        * Creates the uniform buffers. Requires a current OpenGL context.
+        */
+        FrameState();
+        ~FrameState();
+
+        /** The fog of the scene */
+        Fog& fog();
+
+        /** The lights of the scene, at most MaxLights of them are uploaded */
+        std::vector<Light>& lights();
+
+        /**
+        * Packs the camera, fog and lights into the uniform buffers.
+        *
+        * Call once per frame, before any draw.
+        */
+        void upload(const Camera& camera);
+
+        /**
+        * Assigns the program's `Frame` and `Lights` blocks, if it has them, to the shared
+        * binding points.
+        */
+        static void bindBlocks(const Program& program);
+
+    private:
+        GLuint _frameBuffer;
+        GLuint _lightsBuffer;
+        Fog _fog;
+        std::vector<Light> _lights;
+
+        //copying disabled
+        FrameState(const FrameState&);
+        const FrameState& operator=(const FrameState&);
+    };
+
+}
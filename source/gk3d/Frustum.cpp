@@ -0,0 +1,95 @@
+#include "Frustum.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK3D_FRUSTUM_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace gk3d;
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+    //Gribb & Hartmann: each plane is the last row of the matrix plus or minus another row
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r)
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    _planes[0] = rows[3] + rows[0]; //left
+    _planes[1] = rows[3] - rows[0]; //right
+    _planes[2] = rows[3] + rows[1]; //bottom
+    _planes[3] = rows[3] - rows[1]; //top
+    _planes[4] = rows[3] + rows[2]; //near
+    _planes[5] = rows[3] - rows[2]; //far
+
+    for (int p = 0; p < 6; ++p) {
+        float length = glm::length(glm::vec3(_planes[p]));
+        if (length > 0.0f)
+            _planes[p] /= length;
+    }
+}
+
+bool Frustum::intersects(const glm::vec4& sphere) const {
+    for (int p = 0; p < 6; ++p) {
+        if (glm::dot(glm::vec3(_planes[p]), glm::vec3(sphere)) + _planes[p].w < -sphere.w)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersects(const Bounds& bounds, const glm::mat4& transform) const {
+    if (bounds.isEmpty())
+        return false;
+
+    //the transformed box is enclosed by a world-space box of this centre and extent
+    glm::vec3 center = glm::vec3(transform * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    glm::vec3 extent = bounds.extent();
+    glm::vec3 worldExtent = glm::abs(glm::vec3(transform[0])) * extent.x +
+                            glm::abs(glm::vec3(transform[1])) * extent.y +
+                            glm::abs(glm::vec3(transform[2])) * extent.z;
+
+    for (int p = 0; p < 6; ++p) {
+        glm::vec3 normal(_planes[p]);
+        float distance = glm::dot(normal, center) + _planes[p].w;
+        float reach = glm::dot(glm::abs(normal), worldExtent);
+        if (distance + reach < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void Frustum::intersects(const glm::vec4* spheres, size_t count, unsigned char* visible) const {
+    size_t i = 0;
+
+#ifdef GK3D_FRUSTUM_SSE2
+    for (; i + 4 <= count; i += 4) {
+        //four spheres, transposed to x, y, z and radius vectors
+        __m128 x = _mm_loadu_ps(&spheres[i].x);
+        __m128 y = _mm_loadu_ps(&spheres[i + 1].x);
+        __m128 z = _mm_loadu_ps(&spheres[i + 2].x);
+        __m128 radius = _mm_loadu_ps(&spheres[i + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, radius);
+
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(_planes[p].x)), _mm_mul_ps(y, _mm_set1_ps(_planes[p].y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(_planes[p].z)), _mm_set1_ps(_planes[p].w)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; ++k)
+            visible[i + k] = (unsigned char) !((mask >> k) & 1);
+    }
+#endif
+
+    for (; i < count; ++i)
+        visible[i] = (unsigned char) intersects(spheres[i]);
+}
+
+glm::vec4 Frustum::worldSphere(const Bounds& bounds, const glm::mat4& transform) {
+    glm::vec3 center = glm::vec3(transform * glm::vec4(bounds.center, 1.0f));
+    float scale = glm::max(glm::length(glm::vec3(transform[0])),
+                           glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    return glm::vec4(center, bounds.radius * scale);
+}
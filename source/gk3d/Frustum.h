@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "Bounds.h"
+
+namespace gk3d {
+
+    /**
+    * Objects rejected and accepted by culling, counted over a frame.
+    */
+    struct CullStats {
+        unsigned instancesCulled;
+        unsigned meshesCulled;
+        unsigned meshesDrawn;
+
+        CullStats() :
+                instancesCulled(0),
+                meshesCulled(0),
+                meshesDrawn(0) {
+        }
+    };
+
+    /**
+    * The six clip planes of a camera, in world space.
+    *
+    * Tests are conservative: an object reported visible may still be outside the
+    * frustum near its corners, an object reported invisible never is inside.
+    */
+    class Frustum {
+    public:
+        /**
+        * Extracts the planes from a combined projection * view matrix, e.g. Camera::matrix().
+        */
+        explicit Frustum(const glm::mat4& viewProjection = glm::mat4());
+
+        /**
+        * true if the sphere (xyz centre, w radius) is at least partly inside.
+        */
+        bool intersects(const glm::vec4& sphere) const;
+
+        /**
+        * true if the box of `bounds`, transformed by `transform`, is at least partly inside.
+        */
+        bool intersects(const Bounds& bounds, const glm::mat4& transform) const;
+
+        /**
+        * Tests `count` spheres (xyz centre, w radius) at once, setting `visible[i]` to 1 if
+        * sphere `i` intersects the frustum, or to 0.
+        *
+        * Groups of four spheres are tested with SSE2 where available.
+        */
+        void intersects(const glm::vec4* spheres, size_t count, unsigned char* visible) const;
+
+        /**
+        * World-space bounding sphere (xyz centre, w radius) of `bounds` transformed by `transform`.
+        */
+        static glm::vec4 worldSphere(const Bounds& bounds, const glm::mat4& transform);
+
+    private:
+        //normal in xyz, pointing inside, and distance in w
+        glm::vec4 _planes[6];
+    };
+
+}
@@ -0,0 +1,140 @@
+#include "GeometryPool.h"
+#include "Model.h"
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace gk3d;
+
+GeometryPool::GeometryPool() :
+    _vertices(),
+    _materials(),
+    _indices(),
+    _blocks(),
+    _ranges(),
+    _stride(0),
+    _largestRange(0),
+    _indexType(GL_UNSIGNED_SHORT),
+    _vbo(0),
+    _ibo(0),
+    _vao(0)
+{
+}
+
+GeometryPool::~GeometryPool() {
+    if (_vao != 0) {
+        glDeleteVertexArrays(1, &_vao);
+        glDeleteBuffers(1, &_vbo);
+        glDeleteBuffers(1, &_ibo);
+    }
+}
+
+GLint GeometryPool::add(Mesh* mesh, const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices, GLuint material) {
+    const GLint baseVertex = (GLint) _materials.size();
+    add(mesh, baseVertex, indices);
+
+    Block block;
+    block.mesh = mesh;
+    block.baseVertex = baseVertex;
+    _blocks.push_back(block);
+
+    const size_t vertexCount = vertices.size() / 6;
+    _vertices.insert(_vertices.end(), vertices.begin(), vertices.begin() + vertexCount * 6);
+    _materials.insert(_materials.end(), vertexCount, material);
+    _largestRange = std::max(_largestRange, vertexCount);
+    return baseVertex;
+}
+
+void GeometryPool::add(Mesh* mesh, GLint baseVertex, const std::vector<GLuint>& indices) {
+    if (_vao != 0)
+        throw std::runtime_error("Geometry pool was already uploaded");
+    if (!_ranges.empty() && _ranges[0].mesh->shaders != mesh->shaders)
+        throw std::runtime_error("All meshes of a geometry pool must use the same program");
+
+    Range range;
+    range.mesh = mesh;
+    range.firstIndex = (GLint) _indices.size();
+    range.indexCount = (GLsizei) indices.size();
+    range.baseVertex = baseVertex;
+    _ranges.push_back(range);
+    _indices.insert(_indices.end(), indices.begin(), indices.end());
+}
+
+//the block holding `vertex`; blocks are sorted by their base vertex
+static size_t FindBlock(const std::vector<GLint>& baseVertices, GLint vertex) {
+    return (size_t) (std::upper_bound(baseVertices.begin(), baseVertices.end(), vertex) - baseVertices.begin()) - 1;
+}
+
+void GeometryPool::upload(const VertexFormat& format) {
+    if (_vao != 0 || _ranges.empty())
+        return;
+
+    _stride = format.stride();
+    std::vector<unsigned char> encoded((size_t) _stride * _materials.size());
+    std::vector<GLint> baseVertices(_blocks.size());
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        const size_t first = (size_t) _blocks[i].baseVertex;
+        const size_t end = i + 1 < _blocks.size() ? (size_t) _blocks[i + 1].baseVertex : _materials.size();
+        if (end > first) {
+            format.encode(&_vertices[first * 6], end - first, _blocks[i].mesh->bounds, &_materials[first],
+                          &encoded[first * _stride]);
+        }
+        baseVertices[i] = _blocks[i].baseVertex;
+    }
+
+    const Program& program = *_ranges[0].mesh->shaders;
+    _indexType = _largestRange <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+    glGenBuffers(1, &_ibo);
+
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, encoded.size(), encoded.empty() ? NULL : &encoded[0], GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ibo);
+    if (_indexType == GL_UNSIGNED_SHORT) {
+        std::vector<GLushort> shortIndices(_indices.begin(), _indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * shortIndices.size(), &shortIndices[0], GL_STATIC_DRAW);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * _indices.size(), &_indices[0], GL_STATIC_DRAW);
+    }
+
+    format.setupAttributes(program, true);
+
+    RenderQueue::setupInstanceAttributes(program);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    const size_t indexSize = _indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    for (size_t i = 0; i < _ranges.size(); ++i) {
+        Mesh* mesh = _ranges[i].mesh;
+        mesh->vao = _vao;
+        mesh->vbo = _vbo;
+        mesh->ibo = _ibo;
+        mesh->indexType = _indexType;
+        mesh->material = Mesh::PerVertexMaterial;
+        mesh->drawCounts.push_back(_ranges[i].indexCount);
+        mesh->drawOffsets.push_back((const GLvoid *) (_ranges[i].firstIndex * indexSize));
+        mesh->baseVertices.push_back(_ranges[i].baseVertex);
+
+        //a mesh drawing the vertices of another, like a level of detail, dequantises them as that one does
+        const Mesh* owner = _blocks[FindBlock(baseVertices, _ranges[i].baseVertex)].mesh;
+        format.dequantization(owner->bounds, mesh->positionScale, mesh->positionOffset);
+        mesh->octahedralNormals = format.normal == NormalFormat_Octahedral16;
+    }
+
+    //the encoded buffer replaces the floats
+    std::vector<GLfloat>().swap(_vertices);
+}
+
+size_t GeometryPool::vertexBytes() const {
+    return (size_t) _stride * _materials.size();
+}
+
+size_t GeometryPool::indexBytes() const {
+    return (_largestRange <= 65536 ? sizeof(GLushort) : sizeof(GLuint)) * _indices.size();
+}
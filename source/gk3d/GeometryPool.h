@@ -0,0 +1,98 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+#include "VertexFormat.h"
+
+namespace gk3d {
+
+    struct Mesh;
+
+    /**
+    * One vertex buffer, index buffer and VAO shared by the sub-meshes of many models.
+    *
+    * Sub-meshes are appended on the CPU while models load; `upload` then creates the
+    * buffers once and points every mesh at its ranges. A mesh may own several ranges,
+    * which gk3d::RenderQueue issues with a single glMultiDrawElementsBaseVertex. Each
+    * vertex carries the index of its material in the gk3d::MaterialTable, so the ranges
+    * of a mesh need not share a material.
+    *
+    * Indices are stored relative to the first vertex of their sub-mesh, 16-bit wide
+    * unless a sub-mesh has more than 65536 vertices. Vertices are kept as floats until
+    * `upload` encodes them in its gk3d::VertexFormat, quantising the positions of each
+    * sub-mesh within the bounds of the mesh that added it.
+    */
+    class GeometryPool {
+    public:
+        GeometryPool();
+        ~GeometryPool();
+
+        /**
+        * Appends a sub-mesh to `mesh`.
+        *
+        * @param vertices  position + normal vertices, 6 floats each
+        * @param indices   triangle list indexing `vertices`
+        * @param material  index in the gk3d::MaterialTable, stored with every vertex
+        *
+        * @result the base vertex of the sub-mesh, for adding more index ranges over its vertices
+        *
+        * @throws std::exception if the pool was already uploaded, or if `mesh` does not use
+        *         the same program as the meshes added before it.
+        */
+        GLint add(Mesh* mesh, const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices, GLuint material);
+
+        /**
+        * Appends an index range to `mesh` over vertices added before, e.g. a coarser level
+        * of detail of a sub-mesh.
+        *
+        * @param baseVertex  as returned by the `add` that added the vertices
+        */
+        void add(Mesh* mesh, GLint baseVertex, const std::vector<GLuint>& indices);
+
+        /**
+        * Creates the buffers and the VAO in `format` and makes the meshes draw from them.
+        * Meshes given index ranges over the vertices of another mesh dequantise them
+        * the same way. Requires a current OpenGL context.
+        */
+        void upload(const VertexFormat& format);
+
+        /** Size of the vertex buffer in bytes */
+        size_t vertexBytes() const;
+
+        /** Size of the index buffer in bytes */
+        size_t indexBytes() const;
+
+    private:
+        //vertices added by one `add`, quantised within the bounds of their mesh
+        struct Block {
+            Mesh* mesh;
+            GLint baseVertex;
+        };
+
+        struct Range {
+            Mesh* mesh;
+            GLint firstIndex;
+            GLsizei indexCount;
+            GLint baseVertex;
+        };
+
+        //position + normal, 6 floats per vertex
+        std::vector<GLfloat> _vertices;
+        std::vector<GLuint> _materials;
+        std::vector<GLuint> _indices;
+        std::vector<Block> _blocks;
+        std::vector<Range> _ranges;
+        GLsizei _stride;
+        size_t _largestRange;
+        GLenum _indexType;
+        GLuint _vbo;
+        GLuint _ibo;
+        GLuint _vao;
+
+        //copying disabled
+        GeometryPool(const GeometryPool&);
+        const GeometryPool& operator=(const GeometryPool&);
+    };
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace gk3d {
+
+    /**
+    * 32-bit FNV-1a hash of a GLSL identifier.
+    */
+    typedef uint32_t NameHash;
+
+    static const NameHash NameHashBasis = 2166136261u;
+    static const NameHash NameHashPrime = 16777619u;
+
+    /**
+    * Appends a single character to the FNV-1a hash `basis`.
+    */
+    constexpr NameHash hashChar(char c, NameHash basis) {
+        return (basis ^ (NameHash) (unsigned char) c) * NameHashPrime;
+    }
+
+    /**
+    * FNV-1a hash of a zero-terminated string, continuing from `basis`.
+    *
+    * Being constexpr, the hash of a string literal is computed by the compiler.
+    */
+    constexpr NameHash hashName(const char *str, NameHash basis = NameHashBasis) {
+        return *str ? hashName(str + 1, hashChar(*str, basis)) : basis;
+    }
+
+    /**
+    * Appends the decimal digits of `n` to the hash `basis`.
+    */
+    constexpr NameHash hashDecimal(unsigned n, NameHash basis) {
+        return n < 10 ? hashChar((char) ('0' + n), basis) : hashChar((char) ('0' + n % 10), hashDecimal(n / 10, basis));
+    }
+
+    /**
+    * Identifier of a uniform or attribute, addressed by its hashed name.
+    *
+    * Names of array elements and struct members are built by continuing the hash,
+    * so `Name("lights").element(3).member("coneAngle")` equals `Name("lights[3].coneAngle")`
+    * without ever building the string.
+    */
+    class Name {
+    public:
+        constexpr explicit Name(const char *str) :
+                _hash(hashName(str)) {
+        }
+
+        /** The name of element `index` of this array: `name[index]` */
+        constexpr Name element(unsigned index) const {
+            return Name(hashChar(']', hashDecimal(index, hashChar('[', _hash))), 0);
+        }
+
+        /** The name of struct member `member`: `name.member` */
+        constexpr Name member(const char *member) const {
+            return Name(hashName(member, hashChar('.', _hash)), 0);
+        }
+
+        constexpr NameHash hash() const {
+            return _hash;
+        }
+
+    private:
+        NameHash _hash;
+
+        constexpr Name(NameHash hash, int) :
+                _hash(hash) {
+        }
+    };
+
+    /**
+    * 64-bit FNV-1a hash, used to key cached resources by their content.
+    */
+    typedef uint64_t ContentHash;
+
+    static const ContentHash ContentHashBasis = 14695981039346656037ull;
+
+    /**
+    * Hashes `size` bytes, continuing from `basis`.
+    */
+    inline ContentHash hashBytes(const void *data, size_t size, ContentHash basis = ContentHashBasis) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; ++i) {
+            basis = (basis ^ bytes[i]) * 1099511628211ull;
+        }
+        return basis;
+    }
+
+}
@@ -0,0 +1,149 @@
+#include "LzCompression.h"
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+using namespace gk3d;
+
+//shortest back reference
+static const size_t MinMatch = 4;
+//the last bytes of a block are always literals, and no match starts this close to the end
+static const size_t LastLiterals = 5;
+static const size_t MatchLimit = 12;
+static const size_t MaxOffset = 65535;
+static const unsigned HashBits = 12;
+
+static uint32_t Read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+//writes the part of a length that does not fit its 4 bits of the token
+static unsigned char *WriteLength(unsigned char *output, size_t length) {
+    for (length -= 15; length >= 255; length -= 255)
+        *output++ = 255;
+    *output++ = (unsigned char) length;
+    return output;
+}
+
+static unsigned char *WriteLiterals(unsigned char *output, unsigned char *token, const unsigned char *literals, size_t count) {
+    *token = (unsigned char) ((count < 15 ? count : 15) << 4);
+    if (count >= 15)
+        output = WriteLength(output, count);
+    if (count > 0)
+        memcpy(output, literals, count);
+    return output + count;
+}
+
+size_t gk3d::LzCompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t gk3d::LzCompress(const unsigned char *input, size_t size, unsigned char *output) {
+    unsigned char *out = output;
+    size_t anchor = 0;
+    if (size > MatchLimit) {
+        std::vector<uint32_t> table((size_t) 1 << HashBits, 0);
+        const size_t matchEnd = size - LastLiterals;
+        size_t position = 0;
+        unsigned misses = 0;
+        while (position < size - MatchLimit) {
+            const uint32_t sequence = Read32(input + position);
+            const uint32_t h = Hash(sequence);
+            const size_t candidate = table[h];
+            table[h] = (uint32_t) position;
+            if (candidate >= position || position - candidate > MaxOffset || Read32(input + candidate) != sequence) {
+                //skip ahead faster through data that does not compress
+                position += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            size_t length = MinMatch;
+            while (position + length < matchEnd && input[candidate + length] == input[position + length])
+                length++;
+
+            unsigned char *token = out++;
+            out = WriteLiterals(out, token, input + anchor, position - anchor);
+            const size_t offset = position - candidate;
+            *out++ = (unsigned char) (offset & 0xff);
+            *out++ = (unsigned char) (offset >> 8);
+            *token |= (unsigned char) (length - MinMatch < 15 ? length - MinMatch : 15);
+            if (length - MinMatch >= 15)
+                out = WriteLength(out, length - MinMatch);
+
+            position += length;
+            anchor = position;
+        }
+    }
+
+    unsigned char *token = out++;
+    out = WriteLiterals(out, token, input + anchor, size - anchor);
+    return (size_t) (out - output);
+}
+
+bool gk3d::LzDecompress(const unsigned char *input, size_t size, unsigned char *output, size_t outputSize) {
+    const unsigned char *in = input, *inEnd = input + size;
+    unsigned char *out = output, *outEnd = output + outputSize;
+    while (in < inEnd) {
+        const unsigned token = *in++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned char byte;
+            do {
+                if (in == inEnd)
+                    return false;
+                byte = *in++;
+                literals += byte;
+            } while (byte == 255);
+        }
+        if ((size_t) (inEnd - in) < literals || (size_t) (outEnd - out) < literals)
+            return false;
+        if (literals > 0)
+            memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        //the last sequence has literals only
+        if (in == inEnd)
+            break;
+
+        if (inEnd - in < 2)
+            return false;
+        const size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (size_t) (out - output))
+            return false;
+
+        size_t length = token & 15;
+        if (length == 15) {
+            unsigned char byte;
+            do {
+                if (in == inEnd)
+                    return false;
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+        }
+        length += MinMatch;
+        if ((size_t) (outEnd - out) < length)
+            return false;
+
+        //a reference may overlap the bytes it produces, repeating them
+        const unsigned char *match = out - offset;
+        if (offset >= length) {
+            memcpy(out, match, length);
+            out += length;
+        } else {
+            for (size_t i = 0; i < length; ++i)
+                *out++ = match[i];
+        }
+    }
+    return out == outEnd;
+}
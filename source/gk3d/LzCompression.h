@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace gk3d {
+
+    /**
+    * Most bytes LzCompress writes for `size` bytes of input, for data that does not compress.
+    */
+    size_t LzCompressBound(size_t size);
+
+    /**
+    * Compresses `size` bytes in the LZ4 block format: runs of literals and back references
+    * of at least 4 bytes up to 64 KB back, found through a hash of the next 4 bytes. Favours
+    * speed over ratio; decompression is little more than memcpy.
+    *
+    * @param output  receives at most LzCompressBound(size) bytes
+    *
+    * @result the number of bytes written
+    */
+    size_t LzCompress(const unsigned char *input, size_t size, unsigned char *output);
+
+    /**
+    * Decompresses an LZ4 block of `size` bytes that expands to exactly `outputSize` bytes.
+    *
+    * @result false if the block is damaged or does not expand to `outputSize` bytes
+    */
+    bool LzDecompress(const unsigned char *input, size_t size, unsigned char *output, size_t outputSize);
+
+}
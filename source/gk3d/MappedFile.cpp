@@ -0,0 +1,98 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace gk3d;
+
+MappedFile::MappedFile() :
+    _data(NULL),
+    _size(0)
+#ifdef _WIN32
+    , _file(INVALID_HANDLE_VALUE),
+    _mapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size)) {
+        close();
+        return false;
+    }
+    _size = (size_t) size.QuadPart;
+    if (_size == 0)
+        return true;
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping)
+        _data = (const unsigned char*) MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!_data) {
+        close();
+        return false;
+    }
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        ::close(file);
+        return false;
+    }
+    _size = (size_t) info.st_size;
+    if (_size > 0) {
+        void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            ::close(file);
+            _size = 0;
+            return false;
+        }
+        _data = (const unsigned char*) data;
+    }
+    //the mapping keeps the file open
+    ::close(file);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mapping)
+        CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+#else
+    if (_data)
+        munmap((void*) _data, _size);
+#endif
+    _data = NULL;
+    _size = 0;
+}
+
+const unsigned char* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
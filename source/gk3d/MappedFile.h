@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace gk3d {
+
+    /**
+    * A file mapped read-only into memory, so its pages are read on first touch straight
+    * from the OS file cache, without copying them into a buffer first.
+    */
+    class MappedFile {
+    public:
+        MappedFile();
+
+        /** Unmaps the file */
+        ~MappedFile();
+
+        /**
+        * Maps the file at `path`, unmapping the one mapped before.
+        *
+        * @result false if the file does not exist or can not be mapped
+        */
+        bool open(const std::string& path);
+
+        void close();
+
+        /** The bytes of the file; NULL if none is mapped or it is empty */
+        const unsigned char* data() const;
+
+        size_t size() const;
+
+    private:
+        const unsigned char* _data;
+        size_t _size;
+#ifdef _WIN32
+        void* _file;
+        void* _mapping;
+#endif
+
+        //copying disabled
+        MappedFile(const MappedFile&);
+        const MappedFile& operator=(const MappedFile&);
+    };
+
+}
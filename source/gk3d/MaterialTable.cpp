@@ -0,0 +1,65 @@
+#include "MaterialTable.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace gk3d;
+
+static_assert(sizeof(Material) == 64, "Material must match its std140 layout");
+
+MaterialTable::MaterialTable() :
+    _materials(),
+    _uploaded(0),
+    _buffer(0)
+{
+}
+
+MaterialTable::~MaterialTable() {
+    if (_buffer != 0)
+        glDeleteBuffers(1, &_buffer);
+}
+
+GLuint MaterialTable::add(const Material& material) {
+    for (size_t i = 0; i < _materials.size(); ++i) {
+        if (memcmp(&_materials[i], &material, sizeof(Material)) == 0)
+            return (GLuint) i;
+    }
+
+    if (_materials.size() >= MaxMaterials)
+        throw std::runtime_error("Too many materials");
+
+    _materials.push_back(material);
+    return (GLuint) (_materials.size() - 1);
+}
+
+const Material& MaterialTable::get(GLuint index) const {
+    return _materials.at(index);
+}
+
+size_t MaterialTable::size() const {
+    return _materials.size();
+}
+
+void MaterialTable::upload() {
+    if (_buffer == 0) {
+        //sized for the whole block, as the shaders declare it
+        glGenBuffers(1, &_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Material) * MaxMaterials, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, MaterialsBlockBinding, _buffer);
+        _uploaded = 0;
+    }
+
+    if (_uploaded == _materials.size())
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(Material) * _uploaded, sizeof(Material) * (_materials.size() - _uploaded),
+                    &_materials[_uploaded]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _uploaded = _materials.size();
+}
+
+void MaterialTable::bindBlock(const Program& program) {
+    program.bindUniformBlock("Materials", MaterialsBlockBinding);
+}
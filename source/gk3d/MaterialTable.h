@@ -0,0 +1,84 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Program.h"
+
+namespace gk3d {
+
+    /**
+    * Surface colours of a mesh, laid out as the std140 `Material` struct of the scene shaders.
+    */
+    struct Material {
+        glm::vec4 specularColor;
+        glm::vec4 diffuseColor;
+        glm::vec4 ambientColor;
+        float shininess;
+        float _padding[3];
+
+        Material() :
+                specularColor(1.0f, 1.0f, 1.0f, 1.0f),
+                diffuseColor(1.0f, 1.0f, 1.0f, 1.0f),
+                ambientColor(1.0f, 1.0f, 1.0f, 1.0f),
+                shininess(1.0f) {
+            _padding[0] = _padding[1] = _padding[2] = 0.0f;
+        }
+
+        /** true if the material has to be drawn with blending */
+        bool isTranslucent() const {
+            return diffuseColor.a < 1.0f;
+        }
+    };
+
+    /**
+    * All materials of the scene, in the std140 uniform block `Materials`.
+    *
+    * Draws select their material by index, either per vertex (the `vertMaterial`
+    * attribute) or for the whole draw through the attribute's current value, so meshes
+    * with different materials need no uniform changes between them.
+    */
+    class MaterialTable {
+    public:
+        static const GLuint MaterialsBlockBinding = 2;
+
+        /** Must match MAX_MATERIALS in the scene shaders */
+        static const unsigned MaxMaterials = 64;
+
+        MaterialTable();
+        ~MaterialTable();
+
+        /**
+        * Returns the index of `material`, adding it if no identical material is in the table.
+        *
+        * @throws std::exception if the table is full.
+        */
+        GLuint add(const Material& material);
+
+        /** The material at `index` */
+        const Material& get(GLuint index) const;
+
+        /** Number of materials in the table */
+        size_t size() const;
+
+        /**
+        * Uploads the materials added since the last call. Requires a current OpenGL context.
+        */
+        void upload();
+
+        /**
+        * Assigns the program's `Materials` block, if it has one, to the shared binding point.
+        */
+        static void bindBlock(const Program& program);
+
+    private:
+        std::vector<Material> _materials;
+        size_t _uploaded;
+        GLuint _buffer;
+
+        //copying disabled
+        MaterialTable(const MaterialTable&);
+        const MaterialTable& operator=(const MaterialTable&);
+    };
+
+}
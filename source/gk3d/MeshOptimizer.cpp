@@ -0,0 +1,558 @@
+#include "MeshOptimizer.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <glm/glm.hpp>
+
+using namespace gk3d;
+
+/*
+ * FIFO cache simulation, shared by the optimisers and the analysis.
+ *
+ * A vertex is in the cache if fewer than `size` misses happened since it was last
+ * loaded; advancing `time` by size + 1 empties the cache.
+ */
+struct FifoCache {
+    std::vector<unsigned> loadedAt;
+    unsigned time;
+    unsigned size;
+
+    FifoCache(size_t vertexCount, unsigned size) :
+        loadedAt(vertexCount, 0),
+        time(size + 1),
+        size(size) {
+    }
+
+    //returns true on a miss
+    bool access(GLuint vertex) {
+        if (time - loadedAt[vertex] > size) {
+            loadedAt[vertex] = time++;
+            return true;
+        }
+        return false;
+    }
+
+    unsigned accessTriangle(const GLuint *triangle) {
+        return (unsigned) access(triangle[0]) + (unsigned) access(triangle[1]) + (unsigned) access(triangle[2]);
+    }
+
+    void flush() {
+        time += size + 1;
+    }
+};
+
+void gk3d::IndexVertices(const GLfloat *vertices, size_t vertexCount, size_t floatsPerVertex,
+                         std::vector<GLfloat> &uniqueVertices, std::vector<GLuint> &indices) {
+    const size_t vertexSize = floatsPerVertex * sizeof(GLfloat);
+    uniqueVertices.clear();
+    uniqueVertices.reserve(vertexCount * floatsPerVertex);
+    indices.resize(vertexCount);
+
+    //open addressing table of unique vertex numbers + 1, 0 is an empty slot
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+    std::vector<GLuint> table(tableSize, 0);
+
+    GLuint uniqueCount = 0;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const GLfloat *vertex = vertices + i * floatsPerVertex;
+        size_t slot = (size_t) hashBytes(vertex, vertexSize) & (tableSize - 1);
+        for (;;) {
+            GLuint entry = table[slot];
+            if (entry == 0) {
+                table[slot] = ++uniqueCount;
+                uniqueVertices.insert(uniqueVertices.end(), vertex, vertex + floatsPerVertex);
+                indices[i] = uniqueCount - 1;
+                break;
+            }
+            if (memcmp(&uniqueVertices[(entry - 1) * floatsPerVertex], vertex, vertexSize) == 0) {
+                indices[i] = entry - 1;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+}
+
+void gk3d::OptimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    //vertex -> triangle adjacency, and the number of not yet emitted triangles per vertex
+    std::vector<unsigned> live(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+        live[indices[i]]++;
+
+    std::vector<unsigned> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<unsigned> adjacency(indices.size());
+    std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = (unsigned) (i / 3);
+
+    const unsigned cacheSize = VertexCacheSize;
+    std::vector<unsigned> cacheTime(vertexCount, 0);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<GLuint> deadEnds;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    unsigned timestamp = cacheSize + 1;
+    size_t cursor = 0;
+
+    //returns a vertex with live triangles: a recently used one if possible, else the next in input order
+    struct {
+        long operator()(std::vector<GLuint> &deadEnds, const std::vector<unsigned> &live, size_t &cursor) const {
+            while (!deadEnds.empty()) {
+                GLuint vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[vertex] > 0)
+                    return vertex;
+            }
+            for (; cursor < live.size(); ++cursor) {
+                if (live[cursor] > 0)
+                    return (long) cursor;
+            }
+            return -1;
+        }
+    } skipDeadEnd;
+
+    long fanning = skipDeadEnd(deadEnds, live, cursor);
+    while (fanning >= 0) {
+        //emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+            unsigned triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            for (unsigned k = 0; k < 3; ++k) {
+                GLuint vertex = indices[triangle * 3 + k];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+                if (timestamp - cacheTime[vertex] > cacheSize)
+                    cacheTime[vertex] = timestamp++;
+            }
+            emitted[triangle] = 1;
+        }
+
+        //continue with the candidate that stays in the cache the longest while its fan is emitted
+        long next = -1;
+        long bestPriority = -1;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            GLuint vertex = candidates[c];
+            if (live[vertex] == 0)
+                continue;
+            long priority = 0;
+            if (timestamp - cacheTime[vertex] + 2 * live[vertex] <= cacheSize)
+                priority = timestamp - cacheTime[vertex];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        if (next == -1)
+            next = skipDeadEnd(deadEnds, live, cursor);
+        fanning = next;
+    }
+
+    indices.swap(result);
+}
+
+void gk3d::OptimizeOverdraw(std::vector<GLuint> &indices, const GLfloat *positions, size_t vertexCount,
+                            size_t floatsPerVertex, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    //hard boundaries: triangles missing the cache on all three vertices
+    std::vector<size_t> hardClusters;
+    FifoCache cache(vertexCount, VertexCacheSize);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (cache.accessTriangle(&indices[t * 3]) == 3)
+            hardClusters.push_back(t);
+    }
+    if (hardClusters.empty() || hardClusters[0] != 0)
+        hardClusters.insert(hardClusters.begin(), 0);
+    hardClusters.push_back(triangleCount);
+
+    //soft boundaries: split each cluster where the prefix ACMR is within the threshold
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); ++c) {
+        size_t start = hardClusters[c];
+        size_t end = hardClusters[c + 1];
+
+        cache.flush();
+        unsigned clusterMisses = 0;
+        for (size_t t = start; t < end; ++t)
+            clusterMisses += cache.accessTriangle(&indices[t * 3]);
+        float clusterThreshold = threshold * (float) clusterMisses / (float) (end - start);
+
+        cache.flush();
+        clusters.push_back(start);
+        unsigned misses = 0;
+        for (size_t t = start; t < end; ++t) {
+            misses += cache.accessTriangle(&indices[t * 3]);
+            if (t + 1 < end && (float) misses / (float) (t - start + 1) <= clusterThreshold) {
+                clusters.push_back(t + 1);
+                cache.flush();
+                start = t + 1;
+                misses = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    //sort key: how far the cluster sits out along its own normal
+    glm::vec3 meshCentroid(0.0f);
+    for (size_t v = 0; v < vertexCount; ++v)
+        meshCentroid += glm::vec3(positions[v * floatsPerVertex], positions[v * floatsPerVertex + 1], positions[v * floatsPerVertex + 2]);
+    meshCentroid /= (float) std::max(vertexCount, (size_t) 1);
+
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<std::pair<float, size_t> > order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            glm::vec3 corners[3];
+            for (unsigned k = 0; k < 3; ++k) {
+                const GLfloat *p = positions + indices[t * 3 + k] * floatsPerVertex;
+                corners[k] = glm::vec3(p[0], p[1], p[2]);
+            }
+            glm::vec3 cross = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            float triangleArea = glm::length(cross);
+            centroid += (corners[0] + corners[1] + corners[2]) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        float normalLength = glm::length(normal);
+        if (normalLength > 0.0f)
+            normal /= normalLength;
+        order[c] = std::make_pair(-glm::dot(centroid - meshCentroid, normal), c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    for (size_t i = 0; i < clusterCount; ++i) {
+        size_t c = order[i].second;
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+    indices.swap(result);
+}
+
+size_t gk3d::OptimizeVertexFetch(std::vector<GLfloat> &vertices, size_t floatsPerVertex, std::vector<GLuint> &indices) {
+    const size_t vertexCount = vertices.size() / floatsPerVertex;
+    const GLuint unused = ~0u;
+    std::vector<GLuint> remap(vertexCount, unused);
+    std::vector<GLfloat> result;
+    result.reserve(vertices.size());
+
+    GLuint next = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        GLuint &target = remap[indices[i]];
+        if (target == unused) {
+            target = next++;
+            const GLfloat *vertex = &vertices[indices[i] * floatsPerVertex];
+            result.insert(result.end(), vertex, vertex + floatsPerVertex);
+        }
+        indices[i] = target;
+    }
+
+    vertices.swap(result);
+    return next;
+}
+
+//symmetric 4x4 matrix of a sum of squared plane distances
+struct Quadric {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+    Quadric() :
+        a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0) {
+    }
+
+    void addPlane(const glm::vec3 &normal, float distance, float weight) {
+        double a = normal.x, b = normal.y, c = normal.z, d = distance;
+        a00 += weight * a * a; a01 += weight * a * b; a02 += weight * a * c; a03 += weight * a * d;
+        a11 += weight * b * b; a12 += weight * b * c; a13 += weight * b * d;
+        a22 += weight * c * c; a23 += weight * c * d;
+        a33 += weight * d * d;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+    }
+
+    double error(const glm::vec3 &p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                   a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                   a22 * z * z + 2 * a23 * z +
+                   a33;
+        return e > 0 ? e : 0;
+    }
+};
+
+struct Collapse {
+    float cost;
+    GLuint from;
+    GLuint to;
+
+    bool operator<(const Collapse &other) const {
+        return cost < other.cost;
+    }
+};
+
+//weight of the planes holding open borders in place, relative to the surface planes
+static const float BorderWeight = 10.0f;
+
+float gk3d::SimplifyMesh(const GLfloat *vertices, size_t vertexCount, size_t floatsPerVertex,
+                         const std::vector<GLuint> &indices, size_t targetIndexCount, float maxError,
+                         std::vector<GLuint> &result) {
+    result = indices;
+    if (result.size() <= targetIndexCount || vertexCount == 0)
+        return 0.0f;
+
+    //vertices sharing a position form a class, represented by its first vertex; wedges of a class are linked in a ring
+    std::vector<GLuint> classOf(vertexCount);
+    std::vector<GLuint> nextWedge(vertexCount);
+    {
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize *= 2;
+        std::vector<GLuint> table(tableSize, 0);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            const GLfloat *position = vertices + v * floatsPerVertex;
+            size_t slot = (size_t) hashBytes(position, 3 * sizeof(GLfloat)) & (tableSize - 1);
+            for (;;) {
+                GLuint entry = table[slot];
+                if (entry == 0) {
+                    table[slot] = (GLuint) v + 1;
+                    classOf[v] = (GLuint) v;
+                    nextWedge[v] = (GLuint) v;
+                    break;
+                }
+                if (memcmp(vertices + (entry - 1) * floatsPerVertex, position, 3 * sizeof(GLfloat)) == 0) {
+                    classOf[v] = entry - 1;
+                    nextWedge[v] = nextWedge[entry - 1];
+                    nextWedge[entry - 1] = (GLuint) v;
+                    break;
+                }
+                slot = (slot + 1) & (tableSize - 1);
+            }
+        }
+    }
+
+    struct {
+        const GLfloat *vertices;
+        size_t stride;
+        glm::vec3 operator()(GLuint v) const {
+            return glm::vec3(vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2]);
+        }
+    } position = {vertices, floatsPerVertex};
+
+    //a quadric per class: the planes of its triangles, and of the border edges it is on
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<uint64_t> edges;
+    for (size_t t = 0; t + 2 < result.size(); t += 3) {
+        GLuint c[3] = {classOf[result[t]], classOf[result[t + 1]], classOf[result[t + 2]]};
+        for (unsigned k = 0; k < 3; ++k)
+            edges.push_back(((uint64_t) c[k] << 32) | c[(k + 1) % 3]);
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t t = 0; t + 2 < result.size(); t += 3) {
+        GLuint c[3] = {classOf[result[t]], classOf[result[t + 1]], classOf[result[t + 2]]};
+        glm::vec3 p[3] = {position(c[0]), position(c[1]), position(c[2])};
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        float length = glm::length(normal);
+        if (length == 0.0f)
+            continue;
+        normal /= length;
+        for (unsigned k = 0; k < 3; ++k)
+            quadrics[c[k]].addPlane(normal, -glm::dot(normal, p[0]), 1.0f);
+
+        //an edge no other triangle walks the opposite way is on a border
+        for (unsigned k = 0; k < 3; ++k) {
+            uint64_t reverse = ((uint64_t) c[(k + 1) % 3] << 32) | c[k];
+            if (std::binary_search(edges.begin(), edges.end(), reverse))
+                continue;
+            glm::vec3 edge = p[(k + 1) % 3] - p[k];
+            glm::vec3 borderNormal = glm::cross(edge, normal);
+            float borderLength = glm::length(borderNormal);
+            if (borderLength == 0.0f)
+                continue;
+            borderNormal /= borderLength;
+            float distance = -glm::dot(borderNormal, p[k]);
+            quadrics[c[k]].addPlane(borderNormal, distance, BorderWeight);
+            quadrics[c[(k + 1) % 3]].addPlane(borderNormal, distance, BorderWeight);
+        }
+    }
+
+    const double maxCost = (double) maxError * maxError;
+    double reachedCost = 0.0;
+    std::vector<GLuint> remap(vertexCount);
+    std::vector<char> locked(vertexCount);
+    std::vector<Collapse> collapses;
+    std::vector<GLuint> offsets(vertexCount + 1);
+    std::vector<GLuint> adjacency;
+
+    while (result.size() > targetIndexCount) {
+        const size_t triangleCount = result.size() / 3;
+
+        //class -> triangle adjacency of the current mesh
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (size_t i = 0; i < result.size(); ++i)
+            offsets[classOf[result[i]] + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(result.size());
+        {
+            std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i)
+                adjacency[fill[classOf[result[i]]]++] = (GLuint) (i / 3);
+        }
+
+        //every edge once, collapsed in its cheaper direction
+        edges.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (unsigned k = 0; k < 3; ++k) {
+                GLuint a = classOf[result[i + k]], b = classOf[result[i + (k + 1) % 3]];
+                edges.push_back(a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.clear();
+        for (size_t e = 0; e < edges.size(); ++e) {
+            GLuint a = (GLuint) (edges[e] >> 32), b = (GLuint) edges[e];
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+            double toB = q.error(position(b)), toA = q.error(position(a));
+            Collapse collapse;
+            collapse.cost = (float) std::min(toA, toB);
+            collapse.from = toB <= toA ? a : b;
+            collapse.to = toB <= toA ? b : a;
+            if (collapse.cost <= maxCost)
+                collapses.push_back(collapse);
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        //collapse the cheapest edges whose neighbourhoods don't overlap
+        for (size_t v = 0; v < vertexCount; ++v)
+            remap[v] = (GLuint) v;
+        std::fill(locked.begin(), locked.end(), 0);
+        size_t removeBudget = (result.size() - targetIndexCount) / 3 + 1;
+        size_t removed = 0;
+        size_t done = 0;
+
+        for (size_t i = 0; i < collapses.size() && removed < removeBudget; ++i) {
+            const Collapse &collapse = collapses[i];
+            GLuint from = collapse.from, to = collapse.to;
+            if (locked[from] || locked[to])
+                continue;
+
+            //reject collapses that fold a remaining triangle over
+            bool flips = false;
+            size_t shared = 0;
+            glm::vec3 target = position(to);
+            for (GLuint a = offsets[from]; a < offsets[from + 1] && !flips; ++a) {
+                const GLuint *triangle = &result[adjacency[a] * 3];
+                GLuint c[3] = {classOf[triangle[0]], classOf[triangle[1]], classOf[triangle[2]]};
+                if (c[0] == to || c[1] == to || c[2] == to) {
+                    shared++;
+                    continue;
+                }
+                glm::vec3 before[3], after[3];
+                for (unsigned k = 0; k < 3; ++k) {
+                    before[k] = position(c[k]);
+                    after[k] = c[k] == from ? target : before[k];
+                }
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(normalBefore, normalAfter) < 0.25f * glm::length(normalBefore) * glm::length(normalAfter))
+                    flips = true;
+            }
+            if (flips)
+                continue;
+
+            //every wedge of `from` goes to the wedge of `to` with the closest normal
+            GLuint wedge = from;
+            do {
+                GLuint best = to;
+                if (floatsPerVertex >= 6) {
+                    glm::vec3 normal(vertices[wedge * floatsPerVertex + 3], vertices[wedge * floatsPerVertex + 4], vertices[wedge * floatsPerVertex + 5]);
+                    float bestDot = -FLT_MAX;
+                    GLuint candidate = to;
+                    do {
+                        glm::vec3 candidateNormal(vertices[candidate * floatsPerVertex + 3], vertices[candidate * floatsPerVertex + 4],
+                                                  vertices[candidate * floatsPerVertex + 5]);
+                        float dot = glm::dot(normal, candidateNormal);
+                        if (dot > bestDot) {
+                            bestDot = dot;
+                            best = candidate;
+                        }
+                        candidate = nextWedge[candidate];
+                    } while (candidate != to);
+                }
+                remap[wedge] = best;
+                wedge = nextWedge[wedge];
+            } while (wedge != from);
+
+            quadrics[to].add(quadrics[from]);
+            reachedCost = std::max(reachedCost, (double) collapse.cost);
+            removed += shared;
+            done++;
+
+            //the triangles around `from` change, so nothing touching them may collapse again in this pass
+            for (GLuint a = offsets[from]; a < offsets[from + 1]; ++a) {
+                const GLuint *triangle = &result[adjacency[a] * 3];
+                for (unsigned k = 0; k < 3; ++k)
+                    locked[classOf[triangle[k]]] = 1;
+            }
+        }
+
+        if (done == 0)
+            break;
+
+        //apply the collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            GLuint a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+            if (classOf[a] == classOf[b] || classOf[b] == classOf[c] || classOf[c] == classOf[a])
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    return (float) sqrt(reachedCost);
+}
+
+float gk3d::AnalyzeVertexCache(const std::vector<GLuint> &indices, size_t vertexCount, unsigned cacheSize) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return 0.0f;
+
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t)
+        misses += cache.accessTriangle(&indices[t * 3]);
+    return (float) misses / (float) triangleCount;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+namespace gk3d {
+
+    /**
+    * Post-transform vertex cache size the optimisers target.
+    */
+    static const unsigned VertexCacheSize = 16;
+
+    /**
+    * Merges bitwise identical vertices.
+    *
+    * @param vertices        `vertexCount` vertices of `floatsPerVertex` floats each
+    * @param uniqueVertices  receives the distinct vertices, in order of first appearance
+    * @param indices         receives one index into `uniqueVertices` per input vertex
+    */
+    void IndexVertices(const GLfloat *vertices, size_t vertexCount, size_t floatsPerVertex,
+                       std::vector<GLfloat> &uniqueVertices, std::vector<GLuint> &indices);
+
+    /**
+    * Reorders triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007).
+    */
+    void OptimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount);
+
+    /**
+    * Reorders clusters of cache-optimised triangles so that outward facing clusters are
+    * drawn first, which reduces overdraw from most view directions.
+    *
+    * Clusters are split at cache cold starts and wherever a prefix keeps the cache miss
+    * ratio within `threshold` times that of the whole cluster, so the vertex cache
+    * efficiency degrades by at most that factor.
+    *
+    * @param positions  the first three floats of every `floatsPerVertex` are the position
+    */
+    void OptimizeOverdraw(std::vector<GLuint> &indices, const GLfloat *positions, size_t vertexCount,
+                          size_t floatsPerVertex, float threshold = 1.05f);
+
+    /**
+    * Renumbers vertices in the order the index buffer first references them, so vertex
+    * fetches walk the buffer linearly. Unreferenced vertices are dropped.
+    *
+    * @result the new number of vertices
+    */
+    size_t OptimizeVertexFetch(std::vector<GLfloat> &vertices, size_t floatsPerVertex, std::vector<GLuint> &indices);
+
+    /**
+    * Simplifies a triangle mesh by quadric error edge collapses (Garland & Heckbert 1997),
+    * writing a coarser index list over the same vertices.
+    *
+    * Vertices are collapsed onto one another, never moved, so every level of detail can
+    * share one vertex buffer. Vertices at the same position but with different normals
+    * collapse together, each onto the wedge of the target with the closest normal. Open
+    * borders are held in place by extra planes through their edges.
+    *
+    * @param vertices          `vertexCount` vertices of `floatsPerVertex` floats; the position
+    *                          comes first, followed by the normal if `floatsPerVertex` >= 6
+    * @param targetIndexCount  stops once the result has no more indices than this
+    * @param maxError          stops before a collapse would move the surface further than this
+    * @result the largest error of the collapses done, in model units
+    */
+    float SimplifyMesh(const GLfloat *vertices, size_t vertexCount, size_t floatsPerVertex,
+                       const std::vector<GLuint> &indices, size_t targetIndexCount, float maxError,
+                       std::vector<GLuint> &result);
+
+    /**
+    * Average cache miss ratio: transformed vertices per triangle, for a FIFO cache of
+    * `cacheSize` entries. 3 is the worst case, 0.5 the best for large regular meshes.
+    */
+    float AnalyzeVertexCache(const std::vector<GLuint> &indices, size_t vertexCount, unsigned cacheSize = VertexCacheSize);
+
+}
@@ -0,0 +1,256 @@
+#include "MipGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK3D_MIP_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace gk3d;
+
+static const float Pi = 3.14159265358979f;
+
+static float Sinc(float x) {
+    if (std::fabs(x) < 1e-6f)
+        return 1.0f;
+    return std::sin(Pi * x) / (Pi * x);
+}
+
+//zeroth order modified Bessel function of the first kind, by its power series
+static float BesselI0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+        if (term < sum * 1e-7f)
+            break;
+    }
+    return sum;
+}
+
+//half width of the kernel, in pixels of the smaller image
+static float KernelRadius(MipFilter filter) {
+    return filter == MipFilter_Box ? 0.5f : 3.0f;
+}
+
+static float Kernel(MipFilter filter, float x) {
+    const float radius = KernelRadius(filter);
+    if (std::fabs(x) >= radius)
+        return 0.0f;
+    switch (filter) {
+        case MipFilter_Box:
+            return 1.0f;
+        case MipFilter_Kaiser: {
+            const float alpha = 4.0f;
+            float t = x / radius;
+            return Sinc(x) * BesselI0(alpha * std::sqrt(1.0f - t * t)) / BesselI0(alpha);
+        }
+        case MipFilter_Lanczos:
+        default:
+            return Sinc(x) * Sinc(x / radius);
+    }
+}
+
+/*
+ * Source pixels and weights of every output pixel along one axis, `count` taps each.
+ * Taps past the edges are clamped onto the edge pixels.
+ */
+struct Taps {
+    int count;
+    std::vector<int> sources;
+    std::vector<float> weights;
+
+    Taps(MipFilter filter, unsigned srcSize, unsigned dstSize) {
+        const float scale = (float) srcSize / dstSize;
+        const float support = KernelRadius(filter) * std::max(scale, 1.0f);
+        count = (int) std::ceil(support * 2.0f) + 1;
+        sources.resize((size_t) dstSize * count);
+        weights.resize((size_t) dstSize * count);
+
+        for (unsigned i = 0; i < dstSize; ++i) {
+            //centre of output pixel i in source pixel coordinates
+            float center = (i + 0.5f) * scale - 0.5f;
+            int first = (int) std::floor(center - support + 0.5f);
+            float sum = 0.0f;
+            for (int t = 0; t < count; ++t) {
+                int source = first + t;
+                float weight = Kernel(filter, (source - center) / std::max(scale, 1.0f));
+                sources[i * count + t] = std::min(std::max(source, 0), (int) srcSize - 1);
+                weights[i * count + t] = weight;
+                sum += weight;
+            }
+            if (sum == 0.0f) {
+                //kernel narrower than the tap spacing: take the nearest pixel
+                int nearest = (int) std::floor(center + 0.5f) - first;
+                weights[i * count + std::min(std::max(nearest, 0), count - 1)] = 1.0f;
+                sum = 1.0f;
+            }
+            for (int t = 0; t < count; ++t)
+                weights[i * count + t] /= sum;
+        }
+    }
+};
+
+static float SrgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static const int EncodeTableSize = 4096;
+
+//conversions between bytes and the floats filtered, per channel
+struct Encoding {
+    float decode[256];
+    unsigned char encode[EncodeTableSize + 1];
+
+    explicit Encoding(bool srgb) {
+        for (int i = 0; i < 256; ++i)
+            decode[i] = srgb ? SrgbToLinear(i / 255.0f) : i / 255.0f;
+        for (int i = 0; i <= EncodeTableSize; ++i) {
+            float c = (float) i / EncodeTableSize;
+            encode[i] = (unsigned char) (255.0f * (srgb ? LinearToSrgb(c) : c) + 0.5f);
+        }
+    }
+
+    unsigned char toByte(float value) const {
+        int index = (int) (value * EncodeTableSize + 0.5f);
+        return encode[std::min(std::max(index, 0), EncodeTableSize)];
+    }
+};
+
+//filters rows [firstRow, endRow) of `src` horizontally into `dst`
+static void FilterRows(const float *src, unsigned srcWidth, float *dst, unsigned dstWidth, unsigned channels,
+                       const Taps *taps, unsigned firstRow, unsigned endRow) {
+    for (unsigned row = firstRow; row < endRow; ++row) {
+        const float *in = src + (size_t) row * srcWidth * channels;
+        float *out = dst + (size_t) row * dstWidth * channels;
+        for (unsigned x = 0; x < dstWidth; ++x) {
+            const int *sources = &taps->sources[x * taps->count];
+            const float *weights = &taps->weights[x * taps->count];
+#ifdef GK3D_MIP_SSE2
+            if (channels == 4) {
+                __m128 sum = _mm_setzero_ps();
+                for (int t = 0; t < taps->count; ++t)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(in + sources[t] * 4), _mm_set1_ps(weights[t])));
+                _mm_storeu_ps(out + x * 4, sum);
+                continue;
+            }
+#endif
+            for (unsigned c = 0; c < channels; ++c) {
+                float sum = 0.0f;
+                for (int t = 0; t < taps->count; ++t)
+                    sum += in[sources[t] * channels + c] * weights[t];
+                out[x * channels + c] = sum;
+            }
+        }
+    }
+}
+
+//filters the columns of `src` vertically into rows [firstRow, endRow) of `dst`
+static void FilterColumns(const float *src, float *dst, size_t rowFloats, const Taps *taps,
+                          unsigned firstRow, unsigned endRow) {
+    for (unsigned row = firstRow; row < endRow; ++row) {
+        const int *sources = &taps->sources[row * taps->count];
+        const float *weights = &taps->weights[row * taps->count];
+        float *out = dst + row * rowFloats;
+        size_t i = 0;
+#ifdef GK3D_MIP_SSE2
+        for (; i + 4 <= rowFloats; i += 4) {
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < taps->count; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + sources[t] * rowFloats + i), _mm_set1_ps(weights[t])));
+            _mm_storeu_ps(out + i, sum);
+        }
+#endif
+        for (; i < rowFloats; ++i) {
+            float sum = 0.0f;
+            for (int t = 0; t < taps->count; ++t)
+                sum += src[sources[t] * rowFloats + i] * weights[t];
+            out[i] = sum;
+        }
+    }
+}
+
+//runs `work(firstRow, endRow)` over `rows` split between up to `threadCount` threads
+template <typename Work>
+static void ParallelRows(unsigned rows, unsigned threadCount, Work work) {
+    threadCount = std::max(std::min(threadCount, rows), 1u);
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t)
+        threads.push_back(std::thread(work, rows * t / threadCount, rows * (t + 1) / threadCount));
+    work(0, rows / threadCount);
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+}
+
+unsigned gk3d::MipLevelCount(unsigned width, unsigned height) {
+    unsigned levels = 1;
+    for (unsigned size = std::max(width, height); size > 1; size /= 2)
+        levels++;
+    return levels;
+}
+
+void gk3d::GenerateMips(const unsigned char *pixels, unsigned width, unsigned height, unsigned channels,
+                        MipFilter filter, bool srgb, std::vector<std::vector<unsigned char> > &levels,
+                        unsigned threadCount, size_t rowStride) {
+    levels.clear();
+    if (width == 0 || height == 0)
+        return;
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    const Encoding colorEncoding(srgb), alphaEncoding(false);
+    const bool hasAlpha = channels == 2 || channels == 4;
+    const Encoding *encodings[4];
+    for (unsigned c = 0; c < channels; ++c)
+        encodings[c] = hasAlpha && c == channels - 1 ? &alphaEncoding : &colorEncoding;
+
+    //the base level is packed from the source rows
+    const size_t rowBytes = (size_t) width * channels;
+    if (rowStride == 0)
+        rowStride = rowBytes;
+    levels.push_back(std::vector<unsigned char>(rowBytes * height));
+    std::vector<unsigned char> &base = levels.back();
+    for (unsigned row = 0; row < height; ++row)
+        memcpy(&base[row * rowBytes], pixels + row * rowStride, rowBytes);
+
+    std::vector<float> current((size_t) width * height * channels);
+    for (size_t i = 0; i < current.size(); ++i)
+        current[i] = encodings[i % channels]->decode[base[i]];
+
+    std::vector<float> horizontal, next;
+    while (width > 1 || height > 1) {
+        const unsigned dstWidth = std::max(width / 2, 1u);
+        const unsigned dstHeight = std::max(height / 2, 1u);
+        const Taps columnTaps(filter, width, dstWidth);
+        const Taps rowTaps(filter, height, dstHeight);
+
+        horizontal.resize((size_t) dstWidth * height * channels);
+        const float *src = &current[0];
+        float *mid = &horizontal[0];
+        ParallelRows(height, threadCount, [=, &columnTaps](unsigned first, unsigned end) {
+            FilterRows(src, width, mid, dstWidth, channels, &columnTaps, first, end);
+        });
+
+        next.resize((size_t) dstWidth * dstHeight * channels);
+        float *dst = &next[0];
+        ParallelRows(dstHeight, threadCount, [=, &rowTaps](unsigned first, unsigned end) {
+            FilterColumns(mid, dst, (size_t) dstWidth * channels, &rowTaps, first, end);
+        });
+
+        std::vector<unsigned char> level(next.size());
+        for (size_t i = 0; i < next.size(); ++i)
+            level[i] = encodings[i % channels]->toByte(next[i]);
+        levels.push_back(level);
+
+        current.swap(next);
+        width = dstWidth;
+        height = dstHeight;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace gk3d {
+
+    /**
+    * Reconstruction kernels for downsampling.
+    */
+    enum MipFilter {
+        /** 2x2 average; blurs little but aliases */
+        MipFilter_Box,
+        /** sinc windowed by a Kaiser window (alpha 4) over 3 output pixels; sharp with little ringing */
+        MipFilter_Kaiser,
+        /** Lanczos-3; the sharpest, with some ringing at hard edges */
+        MipFilter_Lanczos
+    };
+
+    /** Number of levels of a full mip chain, down to 1x1 */
+    unsigned MipLevelCount(unsigned width, unsigned height);
+
+    /**
+    * Builds the full mip chain of an image.
+    *
+    * Every level is filtered from the one above it, kept in floating point between levels.
+    * Both passes of the separable filter run over precomputed taps, with SSE2 where
+    * available, and split their rows between threads. Sizes need not be powers of two:
+    * each level is half the one above, rounded down, and at least 1.
+    *
+    * @param pixels       `width` x `height` pixels of `channels` bytes (1 - 4), rows from the top
+    * @param srgb         true to filter colour channels in linear light, decoding and
+    *                     re-encoding sRGB; the alpha of 2 and 4 channel images is always linear
+    * @param levels       receives every level, the base level first, in the layout of `pixels`
+    * @param threadCount  0 uses every hardware thread
+    * @param rowStride    bytes from one row of `pixels` to the next; 0 for rows of exactly `width` pixels.
+    *                     The levels are always tightly packed.
+    */
+    void GenerateMips(const unsigned char *pixels, unsigned width, unsigned height, unsigned channels,
+                      MipFilter filter, bool srgb, std::vector<std::vector<unsigned char> > &levels,
+                      unsigned threadCount = 0, size_t rowStride = 0);
+
+}
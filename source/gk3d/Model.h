@@ -1,12 +1,30 @@
 #pragma once
 
+#include "../Helper.h"
 #include "Shader.h"
 #include "Program.h"
+#include "ProgramRegistry.h"
+#include "AssetCache.h"
+#include "AssetLoader.h"
+#include "Texture.h"
+#include "Camera.h"
+#include "Hash.h"
+#include "FrameState.h"
+#include "RenderQueue.h"
+#include "MeshOptimizer.h"
+#include "MaterialTable.h"
+#include "GeometryPool.h"
+#include "VertexFormat.h"
+#include "TextureArray.h"
+#include "Bounds.h"
+#include "Frustum.h"
 #include "Cube.h"
 
-#include <sstream>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
 #include <assimp/postprocess.h>
 #include <vector>
 #include <GL/glext.h>
@@ -14,78 +32,160 @@
 
 namespace gk3d {
 
-    struct Fog{
-        float density;
-        /**
-        * 0 - exp
-        * 1 - exp2
-        * 2 - linear
-        */
-        int eq;
-        glm::vec4 color;
-        float start;
-        float end;
-    };
+    /**
+    * Names of the scene shader's uniforms, hashed at compile time.
+    */
+    namespace uniforms {
+        constexpr Name useTexture("useTexture");
+        constexpr Name numTextures("numTextures");
+        constexpr Name layers("layers");
+        constexpr Name textureLayers("textureLayers");
+        constexpr Name textureWraps("textureWraps");
+        constexpr Name positionScale("positionScale");
+        constexpr Name positionOffset("positionOffset");
+        constexpr Name octahedralNormals("octahedralNormals");
+    }
+
+    /**
+    * Names of the scene shader's vertex attributes.
+    */
+    namespace attributes {
+        constexpr Name vertMaterial("vertMaterial");
+    }
 
     struct RenderParams {
         GLint magTextureFilter;
         GLint minTextureFilter;
         GLfloat bias;
-        Fog* fog;
+        /** maximum anisotropy of texture filtering, 1 for none */
+        GLfloat anisotropy;
+        /** added to the level of detail of every instance; positive values draw coarser meshes */
+        GLfloat lodBias;
     };
 
     struct Mesh {
+        /** Value of `material` for meshes whose vertices carry their own material index */
+        static const GLuint PerVertexMaterial = ~0u;
+
+        /** Small unique number, used as the material part of gk3d::RenderQueue keys */
+        unsigned id;
         GLuint vbo;
+        GLuint ibo;
         GLuint vao;
         GLuint texVbo;
-        glm::vec4 ambientColor;
-        glm::vec4 diffuseColor;
-        glm::vec4 specularColor;
-        gk3d::Program *shaders;
+        /** index in the gk3d::MaterialTable used for the whole mesh, or PerVertexMaterial */
+        GLuint material;
+        /** true if any material of the mesh is translucent */
+        bool translucent;
+        /** local-space bounds of all the mesh's vertices */
+        Bounds bounds;
+        /** turn the stored positions back into local space: `positionOffset + vert * positionScale` */
+        glm::vec3 positionScale;
+        glm::vec3 positionOffset;
+        /** true if the normals are stored as NormalFormat_Octahedral16 */
+        bool octahedralNormals;
+        ProgramHandle shaders;
         std::vector<Texture *> textures;
         Texture* swap;
         int swap_ind;
-        float shininess;
         GLenum drawType;
-        GLint drawStart;
-        GLint drawCount;
+        /** GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+        GLenum indexType;
+        /**
+        * Index ranges drawn together, as the parallel arrays glMultiDrawElementsBaseVertex takes:
+        * the number of indices, the byte offset of the first index and the vertex index 0 stands for.
+        */
+        std::vector<GLsizei> drawCounts;
+        std::vector<const GLvoid *> drawOffsets;
+        std::vector<GLint> baseVertices;
+        /**
+        * Coarser versions of the mesh, each with about half the triangles of the one before.
+        * They share the buffers, program and bounds of the mesh and are owned by it.
+        */
+        std::vector<Mesh *> lods;
 
         Mesh() :
+                id(nextId()),
                 vao(0),
                 vbo(0),
-                ambientColor(glm::vec4(1.0f, 1.0f, 1.0f,1.0f)),
-                diffuseColor(glm::vec4(1.0f, 1.0f, 1.0f,1.0f)),
-                specularColor(glm::vec4(1.0f, 1.0f, 1.0f,1.0f)),
-                shininess(1),
+                ibo(0),
+                material(0),
+                translucent(false),
+                bounds(),
+                positionScale(1.0f),
+                positionOffset(0.0f),
+                octahedralNormals(false),
                 textures(),
                 swap(NULL),
                 swap_ind(0),
-                shaders(NULL),
-                drawStart(0),
-                drawCount(0),
-                drawType(GL_TRIANGLES) {
+                shaders(),
+                drawType(GL_TRIANGLES),
+                indexType(GL_UNSIGNED_INT),
+                drawCounts(),
+                drawOffsets(),
+                baseVertices(),
+                lods() {
+        }
+
+        /** The mesh to draw at level of detail `level`, 0 being the full mesh */
+        const Mesh *lod(unsigned level) const {
+            if (level == 0 || lods.empty())
+                return this;
+            return lods[std::min<size_t>(level, lods.size()) - 1];
+        }
+
+        /** true if the mesh is translucent and has to be drawn with blending */
+        bool isBlended() const {
+            if (translucent)
+                return true;
+            for (size_t i = 0; i < textures.size(); ++i) {
+                if (textures[i]->hasAlpha())
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        static unsigned nextId() {
+            static unsigned lastId = 0;
+            return ++lastId;
         }
     };
 
     struct ModelAsset {
+        /** Number of coarser levels of detail built for imported models */
+        static const unsigned LodLevels = ModelData::LodLevels;
+
+        /** Assimp post-processing of imported models */
+        static const unsigned ImportFlags = aiProcess_Triangulate | aiProcess_GenNormals;
+
         std::vector<Mesh *> meshes;
+        /** local-space bounds of all meshes */
+        Bounds bounds;
+        /** number of triangles of all meshes */
+        unsigned triangles;
 
         ModelAsset() :
-                meshes() {
+                meshes(),
+                bounds(),
+                triangles(0) {
         }
 
         void init_cube_inward(const char *vertexFile, const char *fragmentFile, glm::vec4 materialDiffuseColor=glm::vec4(1.0f,1.0f,1.0f,1.0f)) {
-            Mesh *aMesh = create_mesh(vertexFile, fragmentFile, 36, sizeof(CUBE_INWARD), CUBE_INWARD,materialDiffuseColor);
+            Mesh *aMesh = create_cube_mesh(vertexFile, fragmentFile, CUBE_INWARD, materialDiffuseColor);
             this->meshes.push_back(aMesh);
+            this->bounds.merge(aMesh->bounds);
+            this->triangles += 12;
         }
 
         /**
         * Added texture from file @filename to mesh at the index @index(defaut 0).
+        * The texture becomes a layer of the shared texture array, decoded when the array streams in;
+        * filtering is set by the render parameters.
         */
-        void add_texture(const char* filename, GLfloat uv[], GLsizeiptr ptrSize, int index =0, GLint minMagFiler = GL_LINEAR, GLint wrapMode = GL_CLAMP_TO_EDGE) {
+        void add_texture(const char* filename, GLfloat uv[], GLsizeiptr ptrSize, int index =0, GLint wrapMode = GL_CLAMP_TO_EDGE) {
             assert(this->meshes.size()>0);
-            Bitmap bitmap=Bitmap::bitmapFromFile(ResourcePath(filename));
-            Texture *texture=new Texture(bitmap,minMagFiler,wrapMode);
+            Texture *texture=Textures().add(ResourcePath(filename),wrapMode);
             Mesh *aMesh=this->meshes[index];
             aMesh->textures.push_back(texture);
             load_textures(aMesh,uv,ptrSize);
@@ -113,77 +213,151 @@ namespace gk3d {
         }
 
         void init(const char *vertexFile, const char *fragmentFile, glm::vec4 materialDiffuseColor=glm::vec4(1.0f,1.0f,1.0f,1.0f)) {
-            Mesh *aMesh = create_mesh(vertexFile, fragmentFile, 36, sizeof(CUBE), CUBE,materialDiffuseColor);
+            Mesh *aMesh = create_cube_mesh(vertexFile, fragmentFile, CUBE, materialDiffuseColor);
             this->meshes.push_back(aMesh);
+            this->bounds.merge(aMesh->bounds);
+            this->triangles += 12;
         }
 
         void init(const char *modelFile, const char *vertexFile, const char *fragmentFile) {
+            AssetCache::ModelHandle model;
+            try {
+                model = Assets().model(ResourcePath(modelFile), ImportFlags);
+            } catch (const std::exception &e) {
+                std::cout << "Failed! Error: " << e.what() << std::endl;
+                return;
+            }
+            init(*model, modelFile, vertexFile, fragmentFile);
+        }
 
-            Assimp::Importer importer;
-            const aiScene *scene = importer.ReadFile(ResourcePath(modelFile),
-                    aiProcess_Triangulate |
-                            aiProcess_GenNormals);
-            if (scene) {
-
-                std::vector<GLfloat> vertexList;
-
-                unsigned int nMeshes = scene->mNumMeshes;
-                for (int i = 0; i < nMeshes; ++i) {
-                    aiMesh *ai_mesh = scene->mMeshes[i];
-                    get_vertices(ai_mesh, vertexList);
-
-                    aiMaterial *material = scene->mMaterials[ai_mesh->mMaterialIndex];
-
-                    Mesh *aMesh = create_mesh(vertexFile, fragmentFile, vertexList.size() / 3, sizeof(float) * vertexList.size(), &vertexList.front());
-                    aMesh->ambientColor = get_material_color(material, AI_MATKEY_COLOR_AMBIENT);
-                    aMesh->diffuseColor = get_material_color(material, AI_MATKEY_COLOR_DIFFUSE);
-                    aMesh->specularColor = get_material_color(material, AI_MATKEY_COLOR_SPECULAR);
-
-                    float shininess;
-                    unsigned int max = 1;
-                    aiGetMaterialFloatArray(material, AI_MATKEY_SHININESS, &shininess, &max);
+        /**
+        * Starts importing the model on a worker thread of `loader`; its meshes are created
+        * on the GL thread once the loader runs the completion.
+        */
+        void init(AssetLoader &loader, const char *modelFile, const char *vertexFile, const char *fragmentFile) {
+            loader.model(ResourcePath(modelFile), ImportFlags, [this, modelFile, vertexFile, fragmentFile](const AssetLoader::ModelFuture &future) {
+                AssetCache::ModelHandle model;
+                try {
+                    model = future.get();
+                } catch (const std::exception &e) {
+                    std::cout << "Failed! Error: " << e.what() << std::endl;
+                    return;
+                }
+                this->init(*model, modelFile, vertexFile, fragmentFile);
+            });
+        }
 
-                    if (shininess != 0) {
-                        aMesh->shininess = shininess;
+        /** Creates the meshes of an imported model; `modelFile` only names it in the report */
+        void init(const ModelData &model, const char *modelFile, const char *vertexFile, const char *fragmentFile) {
+            // sub-meshes go to the shared geometry pool, merged into one opaque and one translucent mesh
+            Mesh *opaque = NULL, *translucent = NULL;
+            for (size_t i = 0; i < model.subMeshes.size(); ++i) {
+                const SubMesh &subMesh = model.subMeshes[i];
+                Mesh *&aMesh = subMesh.material.isTranslucent() ? translucent : opaque;
+                if (aMesh == NULL) {
+                    aMesh = new Mesh;
+                    aMesh->shaders = LoadShaders(vertexFile, fragmentFile);
+                    aMesh->translucent = subMesh.material.isTranslucent();
+                    this->meshes.push_back(aMesh);
+                }
+                GLint baseVertex = Geometry().add(aMesh, subMesh.vertices, subMesh.indices, Materials().add(subMesh.material));
+                aMesh->bounds.merge(subMesh.bounds);
+
+                for (unsigned level = 0; level < subMesh.lods.size(); ++level) {
+                    if (aMesh->lods.size() <= level) {
+                        Mesh *lodMesh = new Mesh;
+                        lodMesh->shaders = aMesh->shaders;
+                        lodMesh->translucent = aMesh->translucent;
+                        aMesh->lods.push_back(lodMesh);
                     }
+                    Geometry().add(aMesh->lods[level], baseVertex, subMesh.lods[level]);
+                }
+                this->bounds.merge(subMesh.bounds);
+                this->triangles += (unsigned) (subMesh.indices.size() / 3);
+            }
 
-                    vertexList.clear();
-                    this->meshes.push_back(aMesh);
+            // level meshes cover the same sub-meshes as the full mesh
+            for (size_t i = 0; i < this->meshes.size(); ++i) {
+                for (size_t level = 0; level < this->meshes[i]->lods.size(); ++level)
+                    this->meshes[i]->lods[level]->bounds = this->meshes[i]->bounds;
+            }
 
-                }
-            } else {
-                std::cout << "Failed! Error: " << importer.GetErrorString() << std::endl;
+            const ModelData::Stats &stats = model.stats;
+            if (stats.triangles > 0) {
+                std::cout << modelFile << ": " << stats.verticesBefore << " -> " << stats.verticesAfter << " vertices, ACMR "
+                        << std::fixed << std::setprecision(2) << 3.0f << " -> " << stats.acmr
+                        << ", " << stats.bytesBefore << " -> " << stats.bytesAfter << " buffer bytes" << std::endl;
+                std::cout << modelFile << ": LOD triangles " << stats.triangles;
+                for (unsigned level = 0; level < LodLevels; ++level)
+                    std::cout << " / " << stats.lodTriangles[level];
+                std::cout << std::endl;
+                std::cout.unsetf(std::ios::floatfield);
             }
         }
 
-        Mesh *create_mesh(char const *vertexFile, char const *fragmentFile, int size, GLsizeiptr ptrSize, GLfloat *array,glm::vec4 materialDiffuseColor=glm::vec4(1.0f,1.0f,1.0f,1.0f)) {
+        /**
+        * Creates a 36 vertex cube mesh. Its vertices are not merged, as every one of them gets its own
+        * texture coordinates from add_texture.
+        */
+        Mesh *create_cube_mesh(char const *vertexFile, char const *fragmentFile, const GLfloat *array, glm::vec4 materialDiffuseColor) {
+            std::vector<GLfloat> vertices(array, array + 36 * 6);
+            std::vector<GLuint> indices(36);
+            for (GLuint i = 0; i < 36; ++i)
+                indices[i] = i;
+            return create_mesh(vertexFile, fragmentFile, vertices, indices, materialDiffuseColor);
+        }
+
+        /**
+        * Creates a mesh from position + normal vertices (6 floats each) and a triangle list indexing them.
+        * Vertices are stored in Format(), indices as 16-bit values when the vertex count allows it.
+        */
+        Mesh *create_mesh(char const *vertexFile, char const *fragmentFile, const std::vector<GLfloat> &vertices, const std::vector<GLuint> &indices, glm::vec4 materialDiffuseColor=glm::vec4(1.0f,1.0f,1.0f,1.0f)) {
+            Material material;
+            material.diffuseColor = materialDiffuseColor;
+
             Mesh *aMesh = new Mesh;
-            aMesh->diffuseColor=materialDiffuseColor;
+            aMesh->material = Materials().add(material);
+            aMesh->translucent = material.isTranslucent();
             aMesh->shaders = LoadShaders(vertexFile, fragmentFile);
+            aMesh->bounds = Bounds::fromVertices(vertices.empty() ? NULL : &vertices.front(), vertices.size() / 6, 6);
+            Format().dequantization(aMesh->bounds, aMesh->positionScale, aMesh->positionOffset);
+            aMesh->octahedralNormals = Format().normal == NormalFormat_Octahedral16;
             aMesh->drawType = GL_TRIANGLES;
-            aMesh->drawStart = 0;
-            aMesh->drawCount = size;
+            aMesh->drawCounts.push_back((GLsizei) indices.size());
+            aMesh->drawOffsets.push_back(NULL);
+            aMesh->baseVertices.push_back(0);
             glGenBuffers(1, &aMesh->vbo);
+            glGenBuffers(1, &aMesh->ibo);
             glGenVertexArrays(1, &aMesh->vao);
 
             glBindVertexArray(aMesh->vao);
             glBindBuffer(GL_ARRAY_BUFFER, aMesh->vbo);
+            std::vector<unsigned char> encoded(Format().stride() * (vertices.size() / 6));
+            if (!encoded.empty())
+                Format().encode(&vertices.front(), vertices.size() / 6, aMesh->bounds, NULL, &encoded.front());
+            glBufferData(GL_ARRAY_BUFFER, encoded.size(), encoded.empty() ? NULL : &encoded.front(), GL_STATIC_DRAW);
+
+            // the element array binding is part of the VAO state
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aMesh->ibo);
+            if (IndexSize(vertices.size() / 6) == sizeof(GLushort)) {
+                std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * shortIndices.size(), shortIndices.empty() ? NULL : &shortIndices.front(), GL_STATIC_DRAW);
+                aMesh->indexType = GL_UNSIGNED_SHORT;
+            } else {
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.empty() ? NULL : &indices.front(), GL_STATIC_DRAW);
+                aMesh->indexType = GL_UNSIGNED_INT;
+            }
 
-            glBindVertexArray(aMesh->vao);
-            glBindBuffer(GL_ARRAY_BUFFER, aMesh->vbo);
-
-            glBufferData(GL_ARRAY_BUFFER, ptrSize, array, GL_STATIC_DRAW);
-
-            // connect the xyz to the "vert" attribute of the vertex shader
-            glEnableVertexAttribArray(aMesh->shaders->attrib("vert"));
-            glVertexAttribPointer(aMesh->shaders->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), NULL);
+            // connect the positions and normals to the "vert" and "vertNormal" attributes of the vertex shader
+            Format().setupAttributes(*aMesh->shaders, false);
 
-            glEnableVertexAttribArray(aMesh->shaders->attrib("vertNormal"));
-            glVertexAttribPointer(aMesh->shaders->attrib("vertNormal"), 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (const GLvoid *) (3 * sizeof(GLfloat)));
+            // per-instance model and normal matrices, streamed by the render queue
+            RenderQueue::setupInstanceAttributes(*aMesh->shaders);
 
-            // unbind the VAO
+            // unbind the VAO before the element array buffer, which would otherwise be detached from it
             glBindVertexArray(0);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
             return aMesh;
         }
 
@@ -193,41 +367,20 @@ namespace gk3d {
             glBindVertexArray(mesh->vao);
             glBindBuffer(GL_ARRAY_BUFFER,mesh->texVbo);
 
-            glBufferData(GL_ARRAY_BUFFER,ptrSize,uv, GL_STATIC_DRAW);
-            glEnableVertexAttribArray(mesh->shaders->attrib("vertTexCoord"));
-            glVertexAttribPointer(mesh->shaders->attrib("vertTexCoord"), 2, GL_FLOAT, GL_FALSE, 2* sizeof(GLfloat), NULL);
+            const size_t count = ptrSize / (2 * sizeof(GLfloat));
+            std::vector<unsigned char> encoded(Format().texCoordSize() * count);
+            if (count > 0)
+                Format().encodeTexCoords(uv, count, &encoded.front());
+            glBufferData(GL_ARRAY_BUFFER,encoded.size(),encoded.empty() ? NULL : &encoded.front(), GL_STATIC_DRAW);
+            Format().setupTexCoordAttribute(*mesh->shaders);
 
             glBindVertexArray(0);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
 
-        void get_vertices(const aiMesh *mesh, std::vector<GLfloat> &vertices) {
-
-            int nFaces = mesh->mNumFaces;
-            for (int j = 0; j < nFaces; ++j) {
-                const aiFace &face = mesh->mFaces[j];
-                for (int k = 0; k < 3; ++k) {
-                    aiVector3D pos = mesh->mVertices[face.mIndices[k]];
-                    aiVector3D normal = mesh->mNormals[face.mIndices[k]];
-//                            aiVector3D uv =mesh->mTextureCoords[0][face.mIndices[k]];
-                    vertices.push_back(pos.x);
-                    vertices.push_back(pos.y);
-                    vertices.push_back(pos.z);
-                    vertices.push_back(normal.x);
-                    vertices.push_back(normal.y);
-                    vertices.push_back(normal.z);
-//                            vertexList.push_back(uv.x);
-//                            vertexList.push_back(uv.y);
-//                            vertexList.push_back(uv.z);
-//                            aiVector3D uv = mesh->mTextureCoords[0][face.mIndices[k]];
-                }
-            }
-        }
-
-        glm::vec4 get_material_color(const aiMaterial *material, char const *pKey, unsigned int type, unsigned int index) {
-            aiColor4D color;
-            aiGetMaterialColor(material, pKey, type, index, &color);
-            return glm::vec4(color.r, color.g, color.b,color.a);
+        // bytes per index of a mesh with `vertexCount` vertices
+        static size_t IndexSize(size_t vertexCount) {
+            return vertexCount <= 65536 ? sizeof(GLushort) : sizeof(GLuint);
         }
 
         // returns the full path to the file `fileName` in the resources directory of the app bundle
@@ -235,196 +388,127 @@ namespace gk3d {
             return GetProcessPath() + "/resources/" + fileName;
         }
 
-        // loads the vertex shader and fragment shader, and links them to make the global gProgram
-        static gk3d::Program *LoadShaders(const char *vertexFilename, const char *fragmentFilename) {
-            std::vector<gk3d::Shader> shaders;
-            shaders.push_back(gk3d::Shader::shaderFromFile(ResourcePath(vertexFilename), GL_VERTEX_SHADER));
-            shaders.push_back(gk3d::Shader::shaderFromFile(ResourcePath(fragmentFilename), GL_FRAGMENT_SHADER));
-            return new gk3d::Program(shaders);
+        // the models, textures and programs loaded, so every asset using the same file shares one copy
+        static AssetCache &Assets() {
+            static AssetCache assets;
+            return assets;
+        }
+
+        // the registry shared by all assets, so every mesh using the same shaders gets the same program
+        static ProgramRegistry &Programs() {
+            return Assets().programs();
+        }
+
+        // the materials of every asset, indexed by the meshes and by the vertices of the geometry pool
+        static MaterialTable &Materials() {
+            static MaterialTable materials;
+            return materials;
+        }
+
+        // how the vertices of every mesh are stored: quantised positions, packed normals and half float texture coordinates
+        static VertexFormat &Format() {
+            static VertexFormat format;
+            return format;
+        }
+
+        // the vertex and index buffers shared by all imported models, uploaded once loading is done
+        static GeometryPool &Geometry() {
+            static GeometryPool geometry;
+            return geometry;
+        }
+
+        // the textures of every asset, uploaded once loading is done
+        static TextureArray &Textures() {
+            static TextureArray textures;
+            return textures;
         }
 
-        // loads the content from file `filename` into gTexture
-        static gk3d::Texture *LoadTexture(const char *filename) {
-            gk3d::Bitmap bmp = gk3d::Bitmap::bitmapFromFile(ResourcePath(filename));
-            bmp.flipVertically();
-            return new gk3d::Texture(bmp);
+        // returns the program made of the vertex shader and fragment shader, linking it on first use
+        static ProgramHandle LoadShaders(const char *vertexFilename, const char *fragmentFilename) {
+            return Assets().program(ResourcePath(vertexFilename), ResourcePath(fragmentFilename));
+        }
+
+        // returns a standalone texture of the file `filename`, decoded on first use
+        static AssetCache::TextureHandle LoadTexture(const char *filename) {
+            return Assets().texture(ResourcePath(filename));
         }
 
     };
 
     struct ModelInstance {
 
-        struct Light {
-            glm::vec4 position;
-            glm::vec3 intensities; //a.k.a. the color of the light
-            float attenuation;
-            float ambientCoefficient;
-            float coneAngle;
-            glm::vec3 coneDirection;
-        };
-
         ModelAsset *asset;
         glm::mat4 transform;
-        std::vector<Light> lights;
-        int currColor;
+        /** level of detail drawn, as last chosen by selectLod */
+        unsigned lod;
 
         ModelInstance() :
                 asset(NULL),
-                transform() {
-
-            Light spotlight_exit;
-            spotlight_exit.intensities = glm::vec3(0, 1, 0);
-            spotlight_exit.position = glm::vec4(-70.0, 8.5, 0.0,1);
-            spotlight_exit.attenuation = 0.1f;
-            spotlight_exit.ambientCoefficient = 0.0f;
-            spotlight_exit.coneAngle=360.0f;
-            spotlight_exit.coneDirection=glm::vec3(-10,0,0);
-
-            Light spotlight1;
-            spotlight1.intensities = glm::vec3(1, 1, 0);
-            spotlight1.position = glm::vec4(18.0, 9.5, -27.0,1);
-            spotlight1.attenuation = 0.0f;
-            spotlight1.ambientCoefficient = 0.0f;
-            spotlight1.coneAngle=10.0f;
-            spotlight1.coneDirection=glm::vec3(-1,-1,1);
-
-            Light spotlight2;
-            spotlight2.intensities = glm::vec3(1, 1, 0);
-            spotlight2.position = glm::vec4(18.0, 9.5, 27.0,1);
-            spotlight2.attenuation = 0.0f;
-            spotlight2.ambientCoefficient = 0.0f;
-            spotlight2.coneAngle=10.0f;
-            spotlight2.coneDirection=glm::vec3(-1,-1,-1);
-
-            Light spotlight3;
-            spotlight3.intensities = glm::vec3(1, 0, 1);
-            spotlight3.position = glm::vec4(-20.0, 9.5, -27.0,1);
-            spotlight3.attenuation = 0.0f;
-            spotlight3.ambientCoefficient = 0.0f;
-            spotlight3.coneAngle=10.0f;
-            spotlight3.coneDirection=glm::vec3(1,-1,1);
-
-            Light spotlight4;
-            spotlight4.intensities = glm::vec3(0, 1, 1);
-            spotlight4.position = glm::vec4(-20.0, 9.5, 27.0,1);
-            spotlight4.attenuation = 0.0f;
-            spotlight4.ambientCoefficient = 0.0f;
-            spotlight4.coneAngle=10.0f;
-            spotlight4.coneDirection=glm::vec3(1,-1,-1);
-
-            Light directional_light1;
-            directional_light1.intensities = glm::vec3(0.1, 0.1, 0.1);
-            directional_light1.position = glm::vec4(18.0, 9.5, 27.0,0);
-            directional_light1.attenuation = 0.5f;
-            directional_light1.ambientCoefficient = 0.0f;
-
-            Light directional_light2;
-            directional_light2.intensities = glm::vec3(0.1, 0.1, 0.1);
-            directional_light2.position = glm::vec4(-20.0, 9.5, -27.0,0);
-            directional_light2.attenuation = 0.1f;
-            directional_light2.ambientCoefficient = 0.0f;
-
-            Light directional_light3;
-            directional_light3.intensities = glm::vec3(0.1, 0.1, 0.1);
-            directional_light3.position = glm::vec4(-20.0, -9.5, -27.0,0);
-            directional_light3.attenuation = 0.1f;
-            directional_light3.ambientCoefficient = 0.0f;
-
-            lights=std::vector<Light>();
-            lights.push_back(spotlight_exit);
-            lights.push_back(spotlight1);
-            lights.push_back(spotlight2);
-            lights.push_back(spotlight3);
-            lights.push_back(spotlight4);
-            lights.push_back(directional_light1);
-            lights.push_back(directional_light2);
-            lights.push_back(directional_light3);
-
-            currColor=0;
-        }
-
-//        virtual void Render(const Camera &gCamera) const = 0;
-
-        void Render(const Camera &gCamera, const RenderParams& params)  {
-
-            gk3d::ModelAsset *asset = this->asset;
-            for (int i = 0; i < asset->meshes.size(); ++i) {
-
-                gk3d::Mesh *mesh = asset->meshes[i];
-                gk3d::Program *shaders = mesh->shaders;
-
-                //bind the shaders
-                shaders->use();
-
-                //set the shader uniforms
-                shaders->setUniform("camera", gCamera.matrix());
-
-                shaders->setUniform("model", this->transform);
-
-                int t_size = (int) mesh->textures.size();
-
-                //set the textures
-                if (t_size > 0) {
-                    shaders->setUniform("useTexture", 1.0f);
-                    shaders->setUniform("numTextures", t_size);
-                }
+                transform(),
+                lod(0) {
+        }
 
-                for (int j = 0; j < t_size; ++j) {
-                    glActiveTexture(GL_TEXTURE0 + j);
-                    glBindTexture(GL_TEXTURE_2D, mesh->textures[j]->object());
-                    SetUniform(shaders, "tex", NULL, j, j);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.magTextureFilter);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.minTextureFilter);
-                    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_LOD_BIAS, params.bias);
-                }
+        /**
+        * Smallest projected diameter, in pixels, at which each level of detail is still drawn:
+        * below LodThresholds()[n] the instance moves to level n + 1.
+        */
+        static const float *LodThresholds() {
+            static const float thresholds[ModelAsset::LodLevels] = {200.0f, 80.0f, 30.0f};
+            return thresholds;
+        }
 
-                shaders->setUniform("materialAmbientColor", mesh->ambientColor);
-                shaders->setUniform("materialDiffuseColor", mesh->diffuseColor);
-                shaders->setUniform("materialSpecularColor", mesh->specularColor);
-                shaders->setUniform("materialShininess", mesh->shininess);
-
-                shaders->setUniform("numLights", (int) lights.size());
-                lights[1].intensities = currColor == 0 ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(1.f, 1.f, 1.f);
-                currColor = (currColor + 1) % 2;
-                for (size_t i = 0; i < lights.size(); ++i) {
-                    SetUniform(shaders, "lights", "position", i, lights[i].position);
-                    SetUniform(shaders, "lights", "intensities", i, lights[i].intensities);
-                    SetUniform(shaders, "lights", "attenuation", i, lights[i].attenuation);
-                    SetUniform(shaders, "lights", "ambientCoefficient", i, lights[i].ambientCoefficient);
-                    SetUniform(shaders, "lights", "coneAngle", i, lights[i].coneAngle);
-                    SetUniform(shaders, "lights", "coneDirection", i, lights[i].coneDirection);
-                }
+        /**
+        * Picks the level of detail from the projected size of the instance's bounding sphere.
+        *
+        * A level is left only once the size is 10% past its threshold, so an instance near
+        * a threshold does not switch back and forth between levels.
+        *
+        * @param viewportHeight  height of the viewport in pixels
+        * @param lodBias         levels added to the choice; each halves the projected size
+        */
+        void selectLod(const Camera &camera, float viewportHeight, float lodBias) {
+            glm::vec4 sphere = worldSphere();
+            float distance = glm::length(glm::vec3(sphere) - camera.position());
+            if (sphere.w < 0.0f || distance <= sphere.w) {
+                lod = 0;
+                return;
+            }
 
-                if (params.fog != NULL) {
-                    shaders->setUniform("fog.color", params.fog->color);
-                    shaders->setUniform("fog.density", params.fog->density);
-                    shaders->setUniform("fog.eq", params.fog->eq);
-                    shaders->setUniform("fog.start", params.fog->start);
-                    shaders->setUniform("fog.end", params.fog->end);
-                }
+            float pixels = sphere.w * viewportHeight / (distance * std::tan(glm::radians(camera.fieldOfView() * 0.5f)));
+            pixels *= std::pow(2.0f, -lodBias);
 
-                //bind VAO and draw
-                glBindVertexArray(mesh->vao);
-                glDrawArrays(mesh->drawType, mesh->drawStart, mesh->drawCount);
+            const float *thresholds = LodThresholds();
+            while (lod < ModelAsset::LodLevels && pixels < thresholds[lod] * 0.9f)
+                lod++;
+            while (lod > 0 && pixels > thresholds[lod - 1] * 1.1f)
+                lod--;
+        }
 
-                //unbind everything
-                glBindVertexArray(0);
-                shaders->stopUsing();
-            }
+        /** World-space bounding sphere of the instance: xyz centre, w radius */
+        glm::vec4 worldSphere() const {
+            return Frustum::worldSphere(asset->bounds, this->transform);
         }
 
-        template <typename T>
-        void SetUniform(gk3d::Program *shaders, const char *uniformName, const char *propertyName, size_t lightIndex, T &value) const{
-            std::ostringstream ss;
-            ss << uniformName << "[" << lightIndex << "]";
-            if (propertyName != NULL) {
-                ss << "." << propertyName;
+        /**
+        * Queues a draw of every mesh of the asset whose bounds intersect `frustum`.
+        *
+        * The instance as a whole is expected to have passed the test of its world sphere.
+        * Meshes are drawn at the level of detail chosen by selectLod.
+        *
+        * @param condition  occlusion query the draws are conditional on, or 0
+        */
+        void Enqueue(RenderQueue &queue, const Frustum &frustum, CullStats &stats, GLuint condition = 0) const {
+            for (size_t i = 0; i < asset->meshes.size(); ++i) {
+                const Mesh *mesh = asset->meshes[i];
+                if (!frustum.intersects(mesh->bounds, this->transform)) {
+                    stats.meshesCulled++;
+                    continue;
+                }
+                queue.add(mesh->lod(lod), this->transform, 0, condition);
+                stats.meshesDrawn++;
             }
-            std::string uniformName1 = ss.str();
-
-            shaders->setUniform(uniformName1.c_str(), value);
         }
 
     };
 
-}
\ No newline at end of file
+}
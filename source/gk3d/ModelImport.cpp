@@ -0,0 +1,361 @@
+#include "ModelImport.h"
+#include "LzCompression.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+
+using namespace gk3d;
+
+static const char Magic[4] = {'G', 'K', 'M', 'S'};
+static const uint32_t Version = 2;
+
+//the fixed-size part of the file, followed by the `storedSize` bytes of the payload
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t source;
+    uint32_t subMeshes;
+    uint32_t lodLevels;
+    uint32_t compressed;
+    uint32_t reserved;
+    /** bytes of the payload once decompressed */
+    uint64_t payloadSize;
+    uint64_t storedSize;
+};
+
+//the start of the payload
+struct StatsRecord {
+    uint64_t verticesBefore;
+    uint64_t verticesAfter;
+    uint64_t triangles;
+    uint64_t bytesBefore;
+    uint64_t bytesAfter;
+    uint64_t lodTriangles[ModelData::LodLevels];
+    float acmr;
+};
+
+//one per sub-mesh, after the stats; the arrays of all sub-meshes follow the records
+struct SubMeshRecord {
+    uint32_t vertexFloats;
+    uint32_t indexCount;
+    uint32_t lodIndexCounts[ModelData::LodLevels];
+    Material material;
+    float boundsMin[3];
+    float boundsMax[3];
+    float boundsCenter[3];
+    float boundsRadius;
+};
+
+//records and arrays of the payload start at multiples of this
+static const size_t PayloadAlignment = 16;
+
+static void Append(std::vector<unsigned char>& payload, const void* data, size_t size) {
+    payload.resize((payload.size() + PayloadAlignment - 1) / PayloadAlignment * PayloadAlignment);
+    const unsigned char* bytes = (const unsigned char*) data;
+    payload.insert(payload.end(), bytes, bytes + size);
+}
+
+//copies the next `size` bytes of the payload, if it has them
+static bool Take(const unsigned char* payload, size_t payloadSize, size_t& offset, void* data, size_t size) {
+    offset = (offset + PayloadAlignment - 1) / PayloadAlignment * PayloadAlignment;
+    if (offset > payloadSize || payloadSize - offset < size)
+        return false;
+    if (size > 0)
+        memcpy(data, payload + offset, size);
+    offset += size;
+    return true;
+}
+
+//the count is checked against the bytes left before anything is allocated
+template <typename T>
+static bool TakeArray(const unsigned char* payload, size_t payloadSize, size_t& offset, std::vector<T>& array, size_t count) {
+    if (offset > payloadSize || count > (payloadSize - offset) / sizeof(T))
+        return false;
+    array.resize(count);
+    return Take(payload, payloadSize, offset, array.empty() ? NULL : &array[0], count * sizeof(T));
+}
+
+//the hash covers the source, not the payload: indices are checked before they reach a draw call
+static bool IndicesBelow(const std::vector<GLuint>& indices, size_t vertexCount) {
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] >= vertexCount)
+            return false;
+    }
+    return true;
+}
+
+ModelData::ModelData() :
+    subMeshes()
+{
+    stats.verticesBefore = 0;
+    stats.verticesAfter = 0;
+    stats.triangles = 0;
+    stats.bytesBefore = 0;
+    stats.bytesAfter = 0;
+    stats.acmr = 0.0f;
+    for (unsigned level = 0; level < LodLevels; ++level)
+        stats.lodTriangles[level] = 0;
+}
+
+void ModelData::save(const std::string& path, ContentHash source, bool compressed) const {
+    std::vector<unsigned char> payload;
+    StatsRecord statsRecord;
+    memset(&statsRecord, 0, sizeof(statsRecord));
+    statsRecord.verticesBefore = stats.verticesBefore;
+    statsRecord.verticesAfter = stats.verticesAfter;
+    statsRecord.triangles = stats.triangles;
+    statsRecord.bytesBefore = stats.bytesBefore;
+    statsRecord.bytesAfter = stats.bytesAfter;
+    for (unsigned level = 0; level < LodLevels; ++level)
+        statsRecord.lodTriangles[level] = stats.lodTriangles[level];
+    statsRecord.acmr = stats.acmr;
+    Append(payload, &statsRecord, sizeof(statsRecord));
+
+    for (size_t i = 0; i < subMeshes.size(); ++i) {
+        const SubMesh& subMesh = subMeshes[i];
+        SubMeshRecord record;
+        memset((void*) &record, 0, sizeof(record));
+        record.vertexFloats = (uint32_t) subMesh.vertices.size();
+        record.indexCount = (uint32_t) subMesh.indices.size();
+        for (unsigned level = 0; level < LodLevels && level < subMesh.lods.size(); ++level)
+            record.lodIndexCounts[level] = (uint32_t) subMesh.lods[level].size();
+        record.material = subMesh.material;
+        for (int axis = 0; axis < 3; ++axis) {
+            record.boundsMin[axis] = subMesh.bounds.min[axis];
+            record.boundsMax[axis] = subMesh.bounds.max[axis];
+            record.boundsCenter[axis] = subMesh.bounds.center[axis];
+        }
+        record.boundsRadius = subMesh.bounds.radius;
+        Append(payload, &record, sizeof(record));
+    }
+    for (size_t i = 0; i < subMeshes.size(); ++i) {
+        const SubMesh& subMesh = subMeshes[i];
+        Append(payload, subMesh.vertices.empty() ? NULL : &subMesh.vertices[0], subMesh.vertices.size() * sizeof(GLfloat));
+        Append(payload, subMesh.indices.empty() ? NULL : &subMesh.indices[0], subMesh.indices.size() * sizeof(GLuint));
+        for (unsigned level = 0; level < LodLevels && level < subMesh.lods.size(); ++level) {
+            const std::vector<GLuint>& lod = subMesh.lods[level];
+            Append(payload, lod.empty() ? NULL : &lod[0], lod.size() * sizeof(GLuint));
+        }
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.source = source;
+    header.subMeshes = (uint32_t) subMeshes.size();
+    header.lodLevels = LodLevels;
+    header.compressed = compressed ? 1 : 0;
+    header.payloadSize = payload.size();
+    if (compressed) {
+        std::vector<unsigned char> stored(LzCompressBound(payload.size()));
+        stored.resize(LzCompress(&payload[0], payload.size(), &stored[0]));
+        payload.swap(stored);
+    }
+    header.storedSize = payload.size();
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Failed to open model cache for writing: " + path);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&payload[0], payload.size(), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        remove(path.c_str());
+        throw std::runtime_error("Failed to write model cache: " + path);
+    }
+}
+
+bool ModelData::load(const std::string& path, ContentHash source) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(Header))
+        return false;
+
+    Header header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.source != source ||
+        header.lodLevels != LodLevels || header.storedSize != file.size() - sizeof(Header))
+        return false;
+
+    //uncompressed, the arrays are copied straight out of the mapped pages
+    const unsigned char* payload = file.data() + sizeof(Header);
+    const size_t payloadSize = (size_t) header.payloadSize;
+    std::vector<unsigned char> decompressed;
+    if (header.compressed) {
+        //no LZ4 block expands more than 255 times
+        if (header.payloadSize / 255 > header.storedSize)
+            return false;
+        decompressed.resize(payloadSize);
+        if (payloadSize == 0 || !LzDecompress(payload, (size_t) header.storedSize, &decompressed[0], payloadSize))
+            return false;
+        payload = &decompressed[0];
+    } else if (header.payloadSize != header.storedSize) {
+        return false;
+    }
+
+    //every sub-mesh has a record in the payload: a larger count is damage, not a reason to allocate
+    if (payloadSize < sizeof(StatsRecord) || header.subMeshes > (payloadSize - sizeof(StatsRecord)) / sizeof(SubMeshRecord))
+        return false;
+
+    size_t offset = 0;
+    StatsRecord statsRecord;
+    std::vector<SubMeshRecord> records(header.subMeshes);
+    bool ok = Take(payload, payloadSize, offset, &statsRecord, sizeof(statsRecord));
+    for (size_t i = 0; ok && i < records.size(); ++i)
+        ok = Take(payload, payloadSize, offset, &records[i], sizeof(SubMeshRecord));
+
+    std::vector<SubMesh> meshes(records.size());
+    for (size_t i = 0; ok && i < records.size(); ++i) {
+        const SubMeshRecord& record = records[i];
+        SubMesh& subMesh = meshes[i];
+        const size_t vertexCount = record.vertexFloats / 6;
+        ok = record.vertexFloats % 6 == 0 &&
+             TakeArray(payload, payloadSize, offset, subMesh.vertices, record.vertexFloats) &&
+             TakeArray(payload, payloadSize, offset, subMesh.indices, record.indexCount) &&
+             IndicesBelow(subMesh.indices, vertexCount);
+        subMesh.lods.resize(LodLevels);
+        for (unsigned level = 0; ok && level < LodLevels; ++level)
+            ok = TakeArray(payload, payloadSize, offset, subMesh.lods[level], record.lodIndexCounts[level]) &&
+                 IndicesBelow(subMesh.lods[level], vertexCount);
+        subMesh.material = record.material;
+        for (int axis = 0; axis < 3; ++axis) {
+            subMesh.bounds.min[axis] = record.boundsMin[axis];
+            subMesh.bounds.max[axis] = record.boundsMax[axis];
+            subMesh.bounds.center[axis] = record.boundsCenter[axis];
+        }
+        subMesh.bounds.radius = record.boundsRadius;
+    }
+    if (!ok)
+        return false;
+
+    stats.verticesBefore = (size_t) statsRecord.verticesBefore;
+    stats.verticesAfter = (size_t) statsRecord.verticesAfter;
+    stats.triangles = (size_t) statsRecord.triangles;
+    stats.bytesBefore = (size_t) statsRecord.bytesBefore;
+    stats.bytesAfter = (size_t) statsRecord.bytesAfter;
+    for (unsigned level = 0; level < LodLevels; ++level)
+        stats.lodTriangles[level] = (size_t) statsRecord.lodTriangles[level];
+    stats.acmr = statsRecord.acmr;
+    subMeshes.swap(meshes);
+    return true;
+}
+
+//appends the position and normal of the three corners of every face
+static void GetVertices(const aiMesh* mesh, std::vector<GLfloat>& vertices) {
+    for (unsigned j = 0; j < mesh->mNumFaces; ++j) {
+        const aiFace& face = mesh->mFaces[j];
+        for (int k = 0; k < 3; ++k) {
+            aiVector3D pos = mesh->mVertices[face.mIndices[k]];
+            aiVector3D normal = mesh->mNormals[face.mIndices[k]];
+            vertices.push_back(pos.x);
+            vertices.push_back(pos.y);
+            vertices.push_back(pos.z);
+            vertices.push_back(normal.x);
+            vertices.push_back(normal.y);
+            vertices.push_back(normal.z);
+        }
+    }
+}
+
+static glm::vec4 GetMaterialColor(const aiMaterial* material, const char* key, unsigned type, unsigned index) {
+    aiColor4D color;
+    aiGetMaterialColor(material, key, type, index, &color);
+    return glm::vec4(color.r, color.g, color.b, color.a);
+}
+
+//bytes per index of a mesh with `vertexCount` vertices, as the geometry pool stores them
+static size_t IndexSize(size_t vertexCount) {
+    return vertexCount <= 65536 ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+//true if `path` ends with `extension`, in any case
+static bool HasExtension(const std::string& path, const char* extension) {
+    const size_t length = strlen(extension);
+    if (path.size() < length)
+        return false;
+    for (size_t i = 0; i < length; ++i) {
+        if (tolower((unsigned char) path[path.size() - length + i]) != extension[i])
+            return false;
+    }
+    return true;
+}
+
+//adds a sub-mesh of the triangles in `vertexList`, three corners of 6 floats each
+static void AddSubMesh(ModelData& model, const std::vector<GLfloat>& vertexList, const Material& material, float& missesAfter) {
+    ModelData::Stats& stats = model.stats;
+    model.subMeshes.push_back(SubMesh());
+    SubMesh& subMesh = model.subMeshes.back();
+    subMesh.material = material;
+
+    //merge the vertices shared by faces, then reorder for the vertex cache, for overdraw and for fetch locality
+    size_t vertexCount = vertexList.size() / 6;
+    IndexVertices(vertexList.empty() ? NULL : &vertexList.front(), vertexCount, 6, subMesh.vertices, subMesh.indices);
+    size_t uniqueCount = subMesh.vertices.size() / 6;
+    OptimizeVertexCache(subMesh.indices, uniqueCount);
+    OptimizeOverdraw(subMesh.indices, subMesh.vertices.empty() ? NULL : &subMesh.vertices.front(), uniqueCount, 6);
+    uniqueCount = OptimizeVertexFetch(subMesh.vertices, 6, subMesh.indices);
+    const GLfloat* vertices = subMesh.vertices.empty() ? NULL : &subMesh.vertices.front();
+    subMesh.bounds = Bounds::fromVertices(vertices, uniqueCount, 6);
+
+    stats.verticesBefore += vertexCount;
+    stats.verticesAfter += uniqueCount;
+    stats.triangles += subMesh.indices.size() / 3;
+    missesAfter += AnalyzeVertexCache(subMesh.indices, uniqueCount) * (subMesh.indices.size() / 3);
+    stats.bytesBefore += sizeof(GLfloat) * vertexList.size();
+    stats.bytesAfter += sizeof(GLfloat) * subMesh.vertices.size() + IndexSize(uniqueCount) * subMesh.indices.size();
+
+    //each level halves the triangles of the one before, as long as the surface moves by
+    //no more than a small, growing fraction of the sub-mesh's size
+    subMesh.lods.resize(ModelData::LodLevels);
+    for (unsigned level = 0; level < ModelData::LodLevels; ++level) {
+        const std::vector<GLuint>& finer = level == 0 ? subMesh.indices : subMesh.lods[level - 1];
+        float maxError = subMesh.bounds.radius * 0.02f * (1 << level);
+        SimplifyMesh(vertices, uniqueCount, 6, finer, finer.size() / 6 * 3, maxError, subMesh.lods[level]);
+        OptimizeVertexCache(subMesh.lods[level], uniqueCount);
+        model.stats.lodTriangles[level] += subMesh.lods[level].size() / 3;
+    }
+}
+
+ModelData gk3d::ImportModel(const std::string& path, unsigned importFlags) {
+    ModelData model;
+    float missesAfter = 0.0f;
+    if (HasExtension(path, ".obj")) {
+        std::vector<ObjMesh> meshes;
+        ParseObj(path, meshes);
+        for (size_t i = 0; i < meshes.size(); ++i)
+            AddSubMesh(model, meshes[i].vertices, meshes[i].material, missesAfter);
+    } else {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, importFlags);
+        if (!scene)
+            throw std::runtime_error(importer.GetErrorString());
+
+        std::vector<GLfloat> vertexList;
+        for (unsigned i = 0; i < scene->mNumMeshes; ++i) {
+            const aiMesh* source = scene->mMeshes[i];
+            vertexList.clear();
+            GetVertices(source, vertexList);
+
+            const aiMaterial* sourceMaterial = scene->mMaterials[source->mMaterialIndex];
+            Material material;
+            material.ambientColor = GetMaterialColor(sourceMaterial, AI_MATKEY_COLOR_AMBIENT);
+            material.diffuseColor = GetMaterialColor(sourceMaterial, AI_MATKEY_COLOR_DIFFUSE);
+            material.specularColor = GetMaterialColor(sourceMaterial, AI_MATKEY_COLOR_SPECULAR);
+            float shininess = 0;
+            unsigned int max = 1;
+            aiGetMaterialFloatArray(sourceMaterial, AI_MATKEY_SHININESS, &shininess, &max);
+            if (shininess != 0)
+                material.shininess = shininess;
+            AddSubMesh(model, vertexList, material, missesAfter);
+        }
+    }
+    model.stats.acmr = model.stats.triangles > 0 ? missesAfter / model.stats.triangles : 0.0f;
+    return model;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Bounds.h"
+#include "Hash.h"
+#include "MaterialTable.h"
+
+namespace gk3d {
+
+    /**
+    * One material's part of an imported model, ready for the gk3d::GeometryPool.
+    */
+    struct SubMesh {
+        /** unique position + normal vertices, 6 floats each, in the order the indices fetch them */
+        std::vector<GLfloat> vertices;
+        /** triangle list, ordered for the vertex cache and for overdraw */
+        std::vector<GLuint> indices;
+        /** coarser triangle lists over the same vertices, each with about half the triangles of the one before */
+        std::vector<std::vector<GLuint> > lods;
+        Material material;
+        Bounds bounds;
+    };
+
+    /**
+    * The geometry and materials of a model file, processed on the CPU. Holds no GL objects,
+    * so it can be built on any thread and shared between the assets drawing it.
+    *
+    * Models are cached between runs in a binary file starting with the magic "GKMS", a
+    * version and the hash of the source file and import flags the model was built from,
+    * followed by the stats, a record per sub-mesh with its sizes, material and bounds, and
+    * the vertex and index arrays, each aligned to 16 bytes. The part after the header may
+    * be LZ4 compressed. A file whose hash differs from the caller's is stale and is ignored.
+    */
+    struct ModelData {
+        /** Number of coarser levels of detail built for every sub-mesh */
+        static const unsigned LodLevels = 3;
+
+        std::vector<SubMesh> subMeshes;
+
+        /** What the processing did, for reporting */
+        struct Stats {
+            size_t verticesBefore;
+            size_t verticesAfter;
+            size_t triangles;
+            size_t bytesBefore;
+            size_t bytesAfter;
+            /** average transformed vertices per triangle after optimisation */
+            float acmr;
+            size_t lodTriangles[LodLevels];
+        } stats;
+
+        ModelData();
+
+        /**
+        * Writes the model to `path`.
+        *
+        * @param compressed  LZ4 compresses the arrays, for when reading the disk is slower than decompressing
+        *
+        * @throws std::exception if the file can not be written.
+        */
+        void save(const std::string& path, ContentHash source, bool compressed) const;
+
+        /**
+        * Maps the file at `path` into memory and reads the model from it, if it exists and
+        * was built from `source`.
+        *
+        * @result false if the file is missing, damaged or stale
+        */
+        bool load(const std::string& path, ContentHash source);
+    };
+
+    /**
+    * Imports the model file at `path`: OBJ files with gk3d::ParseObj, any other format
+    * with Assimp.
+    *
+    * The vertices of every mesh in the file are merged where faces share them, reordered
+    * for the vertex cache, for overdraw and for fetch locality, and simplified into
+    * ModelData::LodLevels coarser levels.
+    *
+    * @param importFlags  aiPostProcessSteps; they must triangulate and give normals, which
+    *                     OBJ files always are
+    *
+    * @throws std::exception if the file can not be imported.
+    */
+    ModelData ImportModel(const std::string& path, unsigned importFlags);
+
+}
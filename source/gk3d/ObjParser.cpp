@@ -0,0 +1,451 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <stdint.h>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GK3D_OBJ_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace gk3d;
+
+//chunks are at least this large, so small files are parsed on one thread
+static const size_t MinChunkSize = 256 * 1024;
+
+//significant digits kept of a number, all of which a uint64_t holds
+static const int MaxDigits = 19;
+
+static const double PowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+//the normal index of a corner without `//n`; a relative index resolving below 0 is never this far off
+static const int64_t NoNormal = INT64_MIN;
+
+//one corner of a face, with 0-based indices; a relative index counts from the chunk's first vertex
+struct Corner {
+    int64_t position;
+    int64_t normal;
+    bool positionRelative;
+    bool normalRelative;
+};
+
+//what one chunk of the file holds
+struct Chunk {
+    std::vector<GLfloat> positions;
+    std::vector<GLfloat> normals;
+    /** position and normal index of the corners of every triangle; NoNormal if the corner has none */
+    std::vector<int64_t> corners;
+    /** the elements of `corners` made from negative indices, counted from the chunk's first position or normal */
+    std::vector<size_t> relative;
+    /** the triangle each `usemtl` applies from, and the name of the material */
+    std::vector<std::pair<size_t, std::string> > materials;
+    std::vector<std::string> libraries;
+    std::string error;
+};
+
+static inline bool IsDigit(char c) {
+    return (unsigned char) (c - '0') < 10;
+}
+
+static inline bool IsBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static const char *SkipBlanks(const char *p, const char *end) {
+    while (p < end && IsBlank(*p))
+        ++p;
+    return p;
+}
+
+//true if the line at `p` starts with `keyword` and a blank
+static bool StartsWith(const char *p, const char *end, const char *keyword) {
+    const size_t length = strlen(keyword);
+    return (size_t) (end - p) > length && memcmp(p, keyword, length) == 0 && IsBlank(p[length]);
+}
+
+//the rest of the line, without blanks and a '\r' around it
+static std::string RestOfLine(const char *p, const char *end) {
+    p = SkipBlanks(p, end);
+    while (end > p && (IsBlank(end[-1]) || end[-1] == '\r'))
+        --end;
+    return std::string(p, end);
+}
+
+#ifdef GK3D_OBJ_SSE2
+static inline unsigned TrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctz(mask);
+#endif
+}
+
+//the value of 8 decimal digits, all at once in the bytes of one 64-bit word
+static inline uint32_t EightDigits(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    v -= 0x3030303030303030ull;
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32)) +
+         ((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32))) >> 32;
+    return (uint32_t) v;
+}
+#endif
+
+//number of decimal digits `p` starts with
+static size_t CountDigits(const char *p, const char *end) {
+    size_t count = 0;
+#ifdef GK3D_OBJ_SSE2
+    //digits are the bytes whose distance from '0', as an unsigned byte, is below 10
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i flip = _mm_set1_epi8((char) 0x80);
+    const __m128i limit = _mm_set1_epi8((char) (0x80 + 10));
+    while ((size_t) (end - p) - count >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (p + count));
+        __m128i digits = _mm_cmplt_epi8(_mm_xor_si128(_mm_sub_epi8(bytes, zero), flip), limit);
+        unsigned others = ~(unsigned) _mm_movemask_epi8(digits) & 0xffff;
+        if (others)
+            return count + TrailingZeros(others);
+        count += 16;
+    }
+#endif
+    while (p + count < end && IsDigit(p[count]))
+        count++;
+    return count;
+}
+
+//appends the `count` digits at `p` to `mantissa`, as long as it has fewer than MaxDigits
+//@result the number of digits dropped
+static size_t AppendDigits(const char *p, size_t count, uint64_t &mantissa, int &digits) {
+    size_t i = 0;
+#ifdef GK3D_OBJ_SSE2
+    for (; count - i >= 8 && digits + 8 <= MaxDigits; i += 8, digits += 8)
+        mantissa = mantissa * 100000000u + EightDigits(p + i);
+#endif
+    for (; i < count && digits < MaxDigits; ++i, ++digits)
+        mantissa = mantissa * 10 + (unsigned) (p[i] - '0');
+    return count - i;
+}
+
+//parses a number as strtof does in the C locale, but for "inf" and "nan"
+//@result the end of the number, or NULL if `p` starts none
+static const char *ParseFloat(const char *p, const char *end, GLfloat &value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    size_t count = CountDigits(p, end);
+    int exponent = (int) AppendDigits(p, count, mantissa, digits);
+    size_t total = count;
+    p += count;
+    if (p < end && *p == '.') {
+        ++p;
+        count = CountDigits(p, end);
+        exponent -= (int) (count - AppendDigits(p, count, mantissa, digits));
+        total += count;
+        p += count;
+    }
+    if (total == 0)
+        return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            ++q;
+        }
+        count = CountDigits(q, end);
+        if (count > 0) {
+            int e = 0;
+            for (size_t i = 0; i < count && e < 10000; ++i)
+                e = e * 10 + (q[i] - '0');
+            exponent += negativeExponent ? -e : e;
+            p = q + count;
+        }
+    }
+
+    //powers of 10 up to 1e22 are exact doubles, so most numbers take a single rounding
+    double result = (double) mantissa;
+    if (mantissa != 0) {
+        for (; exponent > 22; exponent -= 22)
+            result *= 1e22;
+        for (; exponent < -22; exponent += 22)
+            result /= 1e22;
+        result = exponent < 0 ? result / PowersOf10[-exponent] : result * PowersOf10[exponent];
+    }
+    value = (GLfloat) (negative ? -result : result);
+    return p;
+}
+
+//@result the end of the integer, or NULL if `p` starts none
+static const char *ParseIndex(const char *p, const char *end, int64_t &index) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    const size_t count = CountDigits(p, end);
+    if (count == 0)
+        return NULL;
+    int64_t value = 0;
+    for (size_t i = 0; i < count && i < 18; ++i)
+        value = value * 10 + (p[i] - '0');
+    index = negative ? -value : value;
+    return p + count;
+}
+
+//makes a 1-based index, or a negative one counting back from `count`, 0-based
+static bool ResolveIndex(int64_t raw, size_t count, int64_t &index, bool &relative) {
+    if (raw == 0)
+        return false;
+    relative = raw < 0;
+    index = raw > 0 ? raw - 1 : (int64_t) count + raw;
+    return true;
+}
+
+//parses the floats after a keyword into `values`; missing ones are an error
+static bool ParseFloats(const char *p, const char *end, int count, std::vector<GLfloat> &values) {
+    for (int i = 0; i < count; ++i) {
+        GLfloat value;
+        p = ParseFloat(SkipBlanks(p, end), end, value);
+        if (!p)
+            return false;
+        values.push_back(value);
+    }
+    return true;
+}
+
+static bool ParseFace(const char *p, const char *end, Chunk &chunk, std::vector<Corner> &polygon) {
+    const size_t positionCount = chunk.positions.size() / 3, normalCount = chunk.normals.size() / 3;
+    polygon.clear();
+    p = SkipBlanks(p, end);
+    while (p < end && *p != '\r' && *p != '#') {
+        Corner corner;
+        int64_t raw;
+        p = ParseIndex(p, end, raw);
+        if (!p || !ResolveIndex(raw, positionCount, corner.position, corner.positionRelative))
+            return false;
+        corner.normal = NoNormal;
+        corner.normalRelative = false;
+        if (p < end && *p == '/') {
+            //the texture coordinate is not used
+            ++p;
+            if (p < end && *p != '/' && !(p = ParseIndex(p, end, raw)))
+                return false;
+            if (p < end && *p == '/') {
+                p = ParseIndex(p + 1, end, raw);
+                if (!p || !ResolveIndex(raw, normalCount, corner.normal, corner.normalRelative))
+                    return false;
+            }
+        }
+        polygon.push_back(corner);
+        p = SkipBlanks(p, end);
+    }
+
+    //a fan of triangles around the first corner; points and lines are dropped
+    for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+        const Corner *triangle[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+        for (int k = 0; k < 3; ++k) {
+            if (triangle[k]->positionRelative)
+                chunk.relative.push_back(chunk.corners.size());
+            chunk.corners.push_back(triangle[k]->position);
+            if (triangle[k]->normalRelative)
+                chunk.relative.push_back(chunk.corners.size());
+            chunk.corners.push_back(triangle[k]->normal);
+        }
+    }
+    return true;
+}
+
+static void ParseChunk(const char *p, const char *end, Chunk *chunk) {
+    std::vector<Corner> polygon;
+    while (p < end) {
+        const char *lineEnd = (const char *) memchr(p, '\n', (size_t) (end - p));
+        if (!lineEnd)
+            lineEnd = end;
+        const char *q = SkipBlanks(p, lineEnd);
+
+        bool ok = true;
+        if (StartsWith(q, lineEnd, "v"))
+            ok = ParseFloats(q + 1, lineEnd, 3, chunk->positions);
+        else if (StartsWith(q, lineEnd, "vn"))
+            ok = ParseFloats(q + 2, lineEnd, 3, chunk->normals);
+        else if (StartsWith(q, lineEnd, "f"))
+            ok = ParseFace(q + 1, lineEnd, *chunk, polygon);
+        else if (StartsWith(q, lineEnd, "usemtl"))
+            chunk->materials.push_back(std::make_pair(chunk->corners.size() / 6, RestOfLine(q + 6, lineEnd)));
+        else if (StartsWith(q, lineEnd, "mtllib"))
+            chunk->libraries.push_back(RestOfLine(q + 6, lineEnd));
+        if (!ok) {
+            chunk->error = "Malformed line \"" + RestOfLine(q, lineEnd) + "\"";
+            return;
+        }
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+}
+
+//the material Assimp gives faces without one, and the one MTL materials start from
+static Material DefaultMaterial() {
+    Material material;
+    material.ambientColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    material.diffuseColor = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f);
+    material.specularColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    return material;
+}
+
+//as Assimp does, a missing library is skipped, and `d` is not folded into the diffuse alpha
+static void ParseMtl(const std::string &path, std::map<std::string, Material> &materials) {
+    MappedFile file;
+    if (!file.open(path) || !file.data())
+        return;
+
+    const char *p = (const char *) file.data(), *end = p + file.size();
+    Material *material = NULL;
+    while (p < end) {
+        const char *lineEnd = (const char *) memchr(p, '\n', (size_t) (end - p));
+        if (!lineEnd)
+            lineEnd = end;
+        const char *q = SkipBlanks(p, lineEnd);
+
+        std::vector<GLfloat> values;
+        if (StartsWith(q, lineEnd, "newmtl")) {
+            material = &materials[RestOfLine(q + 6, lineEnd)];
+            *material = DefaultMaterial();
+        } else if (material && StartsWith(q, lineEnd, "Ka") && ParseFloats(q + 2, lineEnd, 3, values)) {
+            material->ambientColor = glm::vec4(values[0], values[1], values[2], 1.0f);
+        } else if (material && StartsWith(q, lineEnd, "Kd") && ParseFloats(q + 2, lineEnd, 3, values)) {
+            material->diffuseColor = glm::vec4(values[0], values[1], values[2], 1.0f);
+        } else if (material && StartsWith(q, lineEnd, "Ks") && ParseFloats(q + 2, lineEnd, 3, values)) {
+            material->specularColor = glm::vec4(values[0], values[1], values[2], 1.0f);
+        } else if (material && StartsWith(q, lineEnd, "Ns") && ParseFloats(q + 2, lineEnd, 1, values)) {
+            if (values[0] != 0)
+                material->shininess = values[0];
+        }
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+}
+
+static std::string Directory(const std::string &path) {
+    const size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+void gk3d::ParseObj(const std::string &path, std::vector<ObjMesh> &meshes, unsigned threadCount) {
+    MappedFile file;
+    if (!file.open(path))
+        throw std::runtime_error("Failed to open model: " + path);
+    const char *data = (const char *) file.data();
+    const size_t size = file.size();
+
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / MinChunkSize));
+
+    //chunks end after the first line break past an even split
+    std::vector<const char *> bounds(chunkCount + 1, data);
+    bounds[chunkCount] = data + size;
+    for (size_t c = 1; c < chunkCount; ++c) {
+        const char *split = std::max(data + size * c / chunkCount, bounds[c - 1]);
+        const char *lineEnd = (const char *) memchr(split, '\n', (size_t) (data + size - split));
+        bounds[c] = lineEnd ? lineEnd + 1 : data + size;
+    }
+
+    std::vector<Chunk> chunks(chunkCount);
+    std::vector<std::thread> threads;
+    for (size_t c = 1; c < chunkCount; ++c)
+        threads.push_back(std::thread(ParseChunk, bounds[c], bounds[c + 1], &chunks[c]));
+    ParseChunk(bounds[0], bounds[1], &chunks[0]);
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    //chunks number their vertices from 0: offset them by the vertices of the chunks before
+    std::vector<GLfloat> positions, normals;
+    std::map<std::string, Material> library;
+    for (size_t c = 0; c < chunkCount; ++c) {
+        Chunk &chunk = chunks[c];
+        if (!chunk.error.empty())
+            throw std::runtime_error(chunk.error + " in " + path);
+        const int64_t bases[2] = {(int64_t) positions.size() / 3, (int64_t) normals.size() / 3};
+        for (size_t i = 0; i < chunk.relative.size(); ++i)
+            chunk.corners[chunk.relative[i]] += bases[chunk.relative[i] % 2];
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        for (size_t i = 0; i < chunk.libraries.size(); ++i)
+            ParseMtl(Directory(path) + chunk.libraries[i], library);
+    }
+
+    //a mesh per material, with the material in effect at each triangle
+    const int64_t positionCount = (int64_t) positions.size() / 3, normalCount = (int64_t) normals.size() / 3;
+    meshes.clear();
+    std::map<std::string, size_t> meshOfMaterial;
+    std::string materialName;
+    size_t mesh = std::string::npos;
+    for (size_t c = 0; c < chunkCount; ++c) {
+        const Chunk &chunk = chunks[c];
+        const size_t triangles = chunk.corners.size() / 6;
+        size_t nextMaterial = 0;
+        for (size_t t = 0; t <= triangles; ++t) {
+            for (; nextMaterial < chunk.materials.size() && chunk.materials[nextMaterial].first == t; ++nextMaterial) {
+                materialName = chunk.materials[nextMaterial].second;
+                mesh = std::string::npos;
+            }
+            if (t == triangles)
+                break;
+
+            if (mesh == std::string::npos) {
+                std::map<std::string, size_t>::iterator it = meshOfMaterial.find(materialName);
+                if (it == meshOfMaterial.end()) {
+                    std::map<std::string, Material>::const_iterator material = library.find(materialName);
+                    meshes.push_back(ObjMesh());
+                    meshes.back().material = material != library.end() ? material->second : DefaultMaterial();
+                    it = meshOfMaterial.insert(std::make_pair(materialName, meshes.size() - 1)).first;
+                }
+                mesh = it->second;
+            }
+
+            const int64_t *corners = &chunk.corners[t * 6];
+            glm::vec3 p[3], n[3];
+            bool hasNormals = true;
+            for (int k = 0; k < 3; ++k) {
+                const int64_t position = corners[k * 2], normal = corners[k * 2 + 1];
+                if (position < 0 || position >= positionCount ||
+                    (normal != NoNormal && (normal < 0 || normal >= normalCount)))
+                    throw std::runtime_error("Face refers to a missing vertex in " + path);
+                p[k] = glm::vec3(positions[position * 3], positions[position * 3 + 1], positions[position * 3 + 2]);
+                if (normal != NoNormal)
+                    n[k] = glm::vec3(normals[normal * 3], normals[normal * 3 + 1], normals[normal * 3 + 2]);
+                else
+                    hasNormals = false;
+            }
+            if (!hasNormals) {
+                glm::vec3 faceNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                const float length = glm::length(faceNormal);
+                faceNormal = length > 0.0f ? faceNormal / length : glm::vec3(0.0f);
+                n[0] = n[1] = n[2] = faceNormal;
+            }
+
+            std::vector<GLfloat> &vertices = meshes[mesh].vertices;
+            for (int k = 0; k < 3; ++k) {
+                const GLfloat vertex[6] = {p[k].x, p[k].y, p[k].z, n[k].x, n[k].y, n[k].z};
+                vertices.insert(vertices.end(), vertex, vertex + 6);
+            }
+        }
+    }
+}
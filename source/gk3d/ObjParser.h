@@ -0,0 +1,36 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include "MaterialTable.h"
+
+namespace gk3d {
+
+    /**
+    * The triangles of one material of an OBJ file, three corners each, not yet sharing
+    * vertices between triangles.
+    */
+    struct ObjMesh {
+        Material material;
+        /** position + normal of every corner, 6 floats each */
+        std::vector<GLfloat> vertices;
+    };
+
+    /**
+    * Parses a Wavefront OBJ file and the MTL files it names, with the results Assimp gives
+    * with aiProcess_Triangulate | aiProcess_GenNormals: polygons are split into fans of
+    * triangles, and corners without a normal take the normal of their triangle.
+    *
+    * The file is mapped into memory and split into chunks at line boundaries, which are
+    * parsed in parallel; only the positions, normals, faces and materials are read. Numbers
+    * are parsed without the locale, scanning digits with SSE2 where available.
+    *
+    * @param meshes       receives a mesh per material, in the order the file first uses them
+    * @param threadCount  threads sharing the chunks; 0 uses every hardware thread
+    *
+    * @throws std::exception if the file can not be read, or a face refers to a vertex it does not have.
+    */
+    void ParseObj(const std::string &path, std::vector<ObjMesh> &meshes, unsigned threadCount = 0);
+
+}
@@ -0,0 +1,161 @@
+#include "OcclusionCuller.h"
+#include "Cube.h"
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace gk3d;
+
+static constexpr Name ProxyModel("model");
+
+OcclusionCuller::OcclusionCuller(ProgramHandle proxyProgram) :
+    _entries(),
+    _proxies(),
+    _program(proxyProgram),
+    _vao(0),
+    _vbo(0),
+    _frame(0),
+    _mode(Deferred),
+    _cameraPosition(),
+    _nearPlane(0.0f)
+{
+    memset(&_stats, 0, sizeof(_stats));
+
+    //the unit cube [-1, 1], scaled to each box by the `model` matrix
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE), CUBE, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(_program->attrib("vert"));
+    glVertexAttribPointer(_program->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), NULL);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    for (std::map<const ModelInstance*, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it)
+        glDeleteQueries(1, &it->second.query);
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+}
+
+OcclusionCuller::Mode OcclusionCuller::mode() const {
+    return _mode;
+}
+
+void OcclusionCuller::setMode(Mode mode) {
+    _mode = mode;
+}
+
+void OcclusionCuller::begin(const Camera& camera) {
+    _frame++;
+    _cameraPosition = camera.position();
+    _nearPlane = camera.nearPlane();
+    _proxies.clear();
+    memset(&_stats, 0, sizeof(_stats));
+
+    for (std::map<const ModelInstance*, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+        Entry& entry = it->second;
+        if (!entry.pending)
+            continue;
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint anySamplesPassed = GL_FALSE;
+        glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &anySamplesPassed);
+        entry.visible = anySamplesPassed != GL_FALSE;
+        entry.pending = false;
+    }
+}
+
+bool OcclusionCuller::test(const ModelInstance* instance, const Bounds& bounds, const glm::mat4& transform, GLuint& condition) {
+    condition = 0;
+    if (_mode == Disabled || bounds.isEmpty())
+        return true;
+
+    std::map<const ModelInstance*, Entry>::iterator it = _entries.find(instance);
+    if (it == _entries.end()) {
+        Entry entry;
+        glGenQueries(1, &entry.query);
+        entry.stagger = (unsigned) _entries.size();
+        entry.lastSeen = 0;
+        entry.visible = true;
+        entry.pending = false;
+        it = _entries.insert(std::make_pair(instance, entry)).first;
+    }
+    Entry& entry = it->second;
+
+    //results from before the object left the view say nothing about it now
+    if (_frame - entry.lastSeen > 1)
+        entry.visible = true;
+    entry.lastSeen = _frame;
+
+    //world-space box of the proxy, as the frustum test computes it
+    glm::vec3 center = glm::vec3(transform * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    glm::vec3 extent = bounds.extent();
+    glm::vec3 worldExtent = glm::abs(glm::vec3(transform[0])) * extent.x +
+                            glm::abs(glm::vec3(transform[1])) * extent.y +
+                            glm::abs(glm::vec3(transform[2])) * extent.z;
+
+    //the near plane would clip a box around the camera away
+    glm::vec3 offset = glm::abs(_cameraPosition - center);
+    float margin = 2.0f * _nearPlane;
+    if (offset.x <= worldExtent.x + margin && offset.y <= worldExtent.y + margin && offset.z <= worldExtent.z + margin) {
+        entry.visible = true;
+        return true;
+    }
+
+    bool due = !entry.pending && (!entry.visible || (_frame + entry.stagger) % VisibleQueryInterval == 0);
+    if (due) {
+        Proxy proxy;
+        proxy.entry = &entry;
+        proxy.model = glm::scale(glm::translate(glm::mat4(), center), glm::max(worldExtent, glm::vec3(1e-4f)));
+        _proxies.push_back(proxy);
+    }
+
+    if (entry.visible)
+        return true;
+
+    //a query in flight may have found the object again; let the GPU decide without waiting for it
+    if (_mode == Conditional && entry.pending) {
+        condition = entry.query;
+        _stats.conditional++;
+        return true;
+    }
+
+    _stats.occluded++;
+    return false;
+}
+
+void OcclusionCuller::issueQueries() {
+    if (_proxies.empty())
+        return;
+
+    _program->use();
+    glBindVertexArray(_vao);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+
+    for (size_t i = 0; i < _proxies.size(); ++i) {
+        Entry& entry = *_proxies[i].entry;
+        _program->setUniform(ProxyModel, _proxies[i].model);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, entry.query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        entry.pending = true;
+    }
+    _stats.queries += (unsigned) _proxies.size();
+    _proxies.clear();
+
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glBindVertexArray(0);
+    _program->stopUsing();
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::stats() const {
+    return _stats;
+}
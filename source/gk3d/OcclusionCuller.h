@@ -0,0 +1,117 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+#include "Bounds.h"
+#include "Camera.h"
+#include "ProgramRegistry.h"
+
+namespace gk3d {
+
+    struct ModelInstance;
+
+    /**
+    * Hides objects that are behind others, using hardware occlusion queries on proxy boxes.
+    *
+    * After the scene of a frame is drawn, `issueQueries` draws the bounding box of every
+    * object due for a test, with colour and depth writes off, inside a GL_ANY_SAMPLES_PASSED
+    * query. The results are collected at the start of a later frame without waiting for
+    * the GPU, so visibility lags by a frame or more.
+    *
+    * Objects found visible are re-tested only every VisibleQueryInterval frames, staggered
+    * between objects; hidden objects are re-tested every frame so they reappear promptly.
+    * An object that was outside the view, or whose box contains the camera, counts as
+    * visible until a query says otherwise.
+    */
+    class OcclusionCuller {
+    public:
+        enum Mode {
+            /** Every object is drawn */
+            Disabled,
+            /** Objects are skipped by the CPU on the last result read back */
+            Deferred,
+            /** As Deferred, but objects whose query is still in flight are drawn under glBeginConditionalRender */
+            Conditional
+        };
+
+        /** Objects handled over the frame */
+        struct Stats {
+            unsigned queries;
+            unsigned occluded;
+            unsigned conditional;
+        };
+
+        /** Re-test period, in frames, of objects found visible */
+        static const unsigned VisibleQueryInterval = 8;
+
+        /** Assets with fewer triangles are cheaper to draw than to test */
+        static const unsigned MinTriangles = 1000;
+
+        /**
+        * Creates the proxy box geometry. Requires a current OpenGL context.
+        *
+        * @param proxyProgram  program with a `vert` attribute and a `model` matrix uniform,
+        *                      reading the camera from the `Frame` block
+        */
+        explicit OcclusionCuller(ProgramHandle proxyProgram);
+        ~OcclusionCuller();
+
+        Mode mode() const;
+        void setMode(Mode mode);
+
+        /**
+        * Starts a frame: collects the results that became available, without waiting.
+        */
+        void begin(const Camera& camera);
+
+        /**
+        * Decides how `instance`, which passed frustum culling, is drawn this frame, and
+        * schedules its proxy query if one is due.
+        *
+        * @param bounds     local-space bounds of the instance
+        * @param condition  receives the query to draw the instance under, or 0
+        * @result false if the instance is hidden and must not be drawn
+        */
+        bool test(const ModelInstance* instance, const Bounds& bounds, const glm::mat4& transform, GLuint& condition);
+
+        /**
+        * Draws the proxies scheduled by `test`. Call once the scene of the frame was drawn.
+        */
+        void issueQueries();
+
+        /** Counters of the current frame */
+        const Stats& stats() const;
+
+    private:
+        struct Entry {
+            GLuint query;
+            unsigned stagger;
+            unsigned lastSeen;
+            bool visible;
+            bool pending;
+        };
+
+        struct Proxy {
+            Entry* entry;
+            glm::mat4 model;
+        };
+
+        std::map<const ModelInstance*, Entry> _entries;
+        std::vector<Proxy> _proxies;
+        ProgramHandle _program;
+        GLuint _vao;
+        GLuint _vbo;
+        unsigned _frame;
+        Mode _mode;
+        glm::vec3 _cameraPosition;
+        float _nearPlane;
+        Stats _stats;
+
+        //copying disabled
+        OcclusionCuller(const OcclusionCuller&);
+        const OcclusionCuller& operator=(const OcclusionCuller&);
+    };
+
+}
@@ -18,6 +18,9 @@
 
 #include "Program.h"
 #include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <string>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace gk3d;
@@ -60,6 +63,8 @@ Program::Program(const std::vector<Shader>& shaders) :
         glDeleteProgram(_object); _object = 0;
         throw std::runtime_error(msg);
     }
+
+    _reflect();
 }
 
 Program::~Program() {
@@ -90,103 +95,219 @@ GLint Program::attrib(const GLchar* attribName) const {
     if(!attribName)
         throw std::runtime_error("attribName was NULL");
     
-    GLint attrib = glGetAttribLocation(_object, attribName);
-    if(attrib == -1)
+    const Location* attrib = _find(_attribs, hashName(attribName));
+    if(!attrib)
         throw std::runtime_error(std::string("Program attribute not found: ") + attribName);
     
-    return attrib;
+    return attrib->location;
+}
+
+GLint Program::attrib(Name attribName) const {
+    const Location* attrib = _find(_attribs, attribName.hash());
+    if(!attrib) {
+        std::ostringstream msg;
+        msg << "Program attribute not found: #" << std::hex << attribName.hash();
+        throw std::runtime_error(msg.str());
+    }
+
+    return attrib->location;
 }
 
 GLint Program::uniform(const GLchar* uniformName) const {
     if(!uniformName)
         throw std::runtime_error("uniformName was NULL");
     
-    GLint uniform = glGetUniformLocation(_object, uniformName);
-    if(uniform == -1)
+    const Location* uniform = _find(_uniforms, hashName(uniformName));
+    if(!uniform)
         throw std::runtime_error(std::string("Program uniform not found: ") + uniformName);
     
-    return uniform;
+    return uniform->location;
+}
+
+GLint Program::uniform(Name uniformName) const {
+    const Location* uniform = _find(_uniforms, uniformName.hash());
+    if(!uniform) {
+        std::ostringstream msg;
+        msg << "Program uniform not found: #" << std::hex << uniformName.hash();
+        throw std::runtime_error(msg.str());
+    }
+
+    return uniform->location;
+}
+
+bool Program::hasUniform(Name uniformName) const {
+    return _find(_uniforms, uniformName.hash()) != NULL;
+}
+
+bool Program::bindUniformBlock(const GLchar* blockName, GLuint binding) const {
+    if(!blockName)
+        throw std::runtime_error("blockName was NULL");
+
+    GLuint index = glGetUniformBlockIndex(_object, blockName);
+    if(index == GL_INVALID_INDEX)
+        return false;
+
+    glUniformBlockBinding(_object, index, binding);
+    return true;
 }
 
-#define ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE, TYPE_PREFIX, TYPE_SUFFIX) \
+const Program::Location* Program::_find(const std::vector<Location>& table, NameHash hash) {
+    Location key = { hash, -1 };
+    std::vector<Location>::const_iterator it = std::lower_bound(table.begin(), table.end(), key);
+    if(it == table.end() || it->hash != hash)
+        return NULL;
+    return &*it;
+}
+
+namespace {
+    struct ReflectedName {
+        NameHash hash;
+        std::string name;
+        GLint location;
+
+        ReflectedName(const std::string& name, GLint location) :
+            hash(hashName(name.c_str())), name(name), location(location) {}
+
+        bool operator<(const ReflectedName& other) const { return hash < other.hash; }
+    };
+
+    //sorts the reflected names by hash, failing loudly if two different names collide
+    template <typename Location>
+    std::vector<Location> BuildTable(std::vector<ReflectedName>& names) {
+        std::sort(names.begin(), names.end());
+        std::vector<Location> table;
+        table.reserve(names.size());
+        for(size_t i = 0; i < names.size(); ++i) {
+            if(!table.empty() && table.back().hash == names[i].hash) {
+                if(names[i].name != names[i - 1].name)
+                    throw std::runtime_error("Shader variable name hash collision: " + names[i - 1].name + " / " + names[i].name);
+                continue;
+            }
+            Location entry = { names[i].hash, names[i].location };
+            table.push_back(entry);
+        }
+        return table;
+    }
+}
+
+void Program::_reflect() {
+    GLint count = 0, maxLength = 0;
+    std::vector<ReflectedName> names;
+
+    //uniforms; array elements are registered individually, so `tex[3]` needs no lookup
+    glGetProgramiv(_object, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(_object, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<GLchar> buffer(maxLength + 1);
+    for(GLint i = 0; i < count; ++i) {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(_object, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, &buffer[0]);
+        std::string name(&buffer[0]);
+
+        GLint location = glGetUniformLocation(_object, name.c_str());
+        if(location == -1)
+            continue; //member of a uniform block
+
+        names.push_back(ReflectedName(name, location));
+
+        const std::string arraySuffix("[0]");
+        if(name.size() > arraySuffix.size() && name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0) {
+            std::string base = name.substr(0, name.size() - arraySuffix.size());
+            names.push_back(ReflectedName(base, location));
+            for(GLint element = 1; element < size; ++element) {
+                std::ostringstream elementName;
+                elementName << base << "[" << element << "]";
+                names.push_back(ReflectedName(elementName.str(), glGetUniformLocation(_object, elementName.str().c_str())));
+            }
+        }
+    }
+    _uniforms = BuildTable<Location>(names);
+
+    //attributes
+    names.clear();
+    glGetProgramiv(_object, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(_object, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    buffer.assign(maxLength + 1, 0);
+    for(GLint i = 0; i < count; ++i) {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveAttrib(_object, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, &buffer[0]);
+        std::string name(&buffer[0]);
+        GLint location = glGetAttribLocation(_object, name.c_str());
+        if(location == -1)
+            continue; //built-in such as gl_VertexID
+        names.push_back(ReflectedName(name, location));
+    }
+    _attribs = BuildTable<Location>(names);
+}
+
+#define ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE, TYPE_PREFIX, TYPE_SUFFIX, NAME_TYPE) \
 \
-    void Program::setAttrib(const GLchar* name, OGL_TYPE v0) \
+    void Program::setAttrib(NAME_TYPE name, OGL_TYPE v0) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 1 ## TYPE_SUFFIX (attrib(name), v0); } \
-    void Program::setAttrib(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1) \
+    void Program::setAttrib(NAME_TYPE name, OGL_TYPE v0, OGL_TYPE v1) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 2 ## TYPE_SUFFIX (attrib(name), v0, v1); } \
-    void Program::setAttrib(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2) \
+    void Program::setAttrib(NAME_TYPE name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 3 ## TYPE_SUFFIX (attrib(name), v0, v1, v2); } \
-    void Program::setAttrib(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3) \
+    void Program::setAttrib(NAME_TYPE name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 4 ## TYPE_SUFFIX (attrib(name), v0, v1, v2, v3); } \
 \
-    void Program::setAttrib1v(const GLchar* name, const OGL_TYPE* v) \
+    void Program::setAttrib1v(NAME_TYPE name, const OGL_TYPE* v) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 1 ## TYPE_SUFFIX ## v (attrib(name), v); } \
-    void Program::setAttrib2v(const GLchar* name, const OGL_TYPE* v) \
+    void Program::setAttrib2v(NAME_TYPE name, const OGL_TYPE* v) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 2 ## TYPE_SUFFIX ## v (attrib(name), v); } \
-    void Program::setAttrib3v(const GLchar* name, const OGL_TYPE* v) \
+    void Program::setAttrib3v(NAME_TYPE name, const OGL_TYPE* v) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 3 ## TYPE_SUFFIX ## v (attrib(name), v); } \
-    void Program::setAttrib4v(const GLchar* name, const OGL_TYPE* v) \
+    void Program::setAttrib4v(NAME_TYPE name, const OGL_TYPE* v) \
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 4 ## TYPE_SUFFIX ## v (attrib(name), v); } \
 \
-    void Program::setUniform(const GLchar* name, OGL_TYPE v0) \
+    void Program::setUniform(NAME_TYPE name, OGL_TYPE v0) \
         { assert(isInUse()); glUniform1 ## TYPE_SUFFIX (uniform(name), v0); } \
-    void Program::setUniform(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1) \
+    void Program::setUniform(NAME_TYPE name, OGL_TYPE v0, OGL_TYPE v1) \
         { assert(isInUse()); glUniform2 ## TYPE_SUFFIX (uniform(name), v0, v1); } \
-    void Program::setUniform(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2) \
+    void Program::setUniform(NAME_TYPE name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2) \
         { assert(isInUse()); glUniform3 ## TYPE_SUFFIX (uniform(name), v0, v1, v2); } \
-    void Program::setUniform(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3) \
+    void Program::setUniform(NAME_TYPE name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3) \
         { assert(isInUse()); glUniform4 ## TYPE_SUFFIX (uniform(name), v0, v1, v2, v3); } \
 \
-    void Program::setUniform1v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
+    void Program::setUniform1v(NAME_TYPE name, const OGL_TYPE* v, GLsizei count) \
         { assert(isInUse()); glUniform1 ## TYPE_SUFFIX ## v (uniform(name), count, v); } \
-    void Program::setUniform2v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
+    void Program::setUniform2v(NAME_TYPE name, const OGL_TYPE* v, GLsizei count) \
         { assert(isInUse()); glUniform2 ## TYPE_SUFFIX ## v (uniform(name), count, v); } \
-    void Program::setUniform3v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
+    void Program::setUniform3v(NAME_TYPE name, const OGL_TYPE* v, GLsizei count) \
         { assert(isInUse()); glUniform3 ## TYPE_SUFFIX ## v (uniform(name), count, v); } \
-    void Program::setUniform4v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
+    void Program::setUniform4v(NAME_TYPE name, const OGL_TYPE* v, GLsizei count) \
         { assert(isInUse()); glUniform4 ## TYPE_SUFFIX ## v (uniform(name), count, v); }
 
-ATTRIB_N_UNIFORM_SETTERS(GLfloat, , f);
-ATTRIB_N_UNIFORM_SETTERS(GLdouble, , d);
-ATTRIB_N_UNIFORM_SETTERS(GLint, I, i);
-ATTRIB_N_UNIFORM_SETTERS(GLuint, I, ui);
-
-void Program::setUniformMatrix2(const GLchar* name, const GLfloat* v, GLsizei count, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix2fv(uniform(name), count, transpose, v);
-}
-
-void Program::setUniformMatrix3(const GLchar* name, const GLfloat* v, GLsizei count, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix3fv(uniform(name), count, transpose, v);
-}
-
-void Program::setUniformMatrix4(const GLchar* name, const GLfloat* v, GLsizei count, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix4fv(uniform(name), count, transpose, v);
-}
-
-void Program::setUniform(const GLchar* name, const glm::mat2& m, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix2fv(uniform(name), 1, transpose, glm::value_ptr(m));
-}
-
-void Program::setUniform(const GLchar* name, const glm::mat3& m, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix3fv(uniform(name), 1, transpose, glm::value_ptr(m));
-}
-
-void Program::setUniform(const GLchar* name, const glm::mat4& m, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix4fv(uniform(name), 1, transpose, glm::value_ptr(m));
-}
-
-void Program::setUniform(const GLchar* uniformName, const glm::vec3& v) {
-    setUniform3v(uniformName, glm::value_ptr(v));
-}
-
-void Program::setUniform(const GLchar* uniformName, const glm::vec4& v) {
-    setUniform4v(uniformName, glm::value_ptr(v));
-}
+#define MATRIX_N_VECTOR_SETTERS(NAME_TYPE) \
+\
+    void Program::setUniformMatrix2(NAME_TYPE name, const GLfloat* v, GLsizei count, GLboolean transpose) \
+        { assert(isInUse()); glUniformMatrix2fv(uniform(name), count, transpose, v); } \
+    void Program::setUniformMatrix3(NAME_TYPE name, const GLfloat* v, GLsizei count, GLboolean transpose) \
+        { assert(isInUse()); glUniformMatrix3fv(uniform(name), count, transpose, v); } \
+    void Program::setUniformMatrix4(NAME_TYPE name, const GLfloat* v, GLsizei count, GLboolean transpose) \
+        { assert(isInUse()); glUniformMatrix4fv(uniform(name), count, transpose, v); } \
+\
+    void Program::setUniform(NAME_TYPE name, const glm::mat2& m, GLboolean transpose) \
+        { assert(isInUse()); glUniformMatrix2fv(uniform(name), 1, transpose, glm::value_ptr(m)); } \
+    void Program::setUniform(NAME_TYPE name, const glm::mat3& m, GLboolean transpose) \
+        { assert(isInUse()); glUniformMatrix3fv(uniform(name), 1, transpose, glm::value_ptr(m)); } \
+    void Program::setUniform(NAME_TYPE name, const glm::mat4& m, GLboolean transpose) \
+        { assert(isInUse()); glUniformMatrix4fv(uniform(name), 1, transpose, glm::value_ptr(m)); } \
+\
+    void Program::setUniform(NAME_TYPE name, const glm::vec3& v) \
+        { setUniform3v(name, glm::value_ptr(v)); } \
+    void Program::setUniform(NAME_TYPE name, const glm::vec4& v) \
+        { setUniform4v(name, glm::value_ptr(v)); }
 
+ATTRIB_N_UNIFORM_SETTERS(GLfloat, , f, const GLchar*);
+ATTRIB_N_UNIFORM_SETTERS(GLdouble, , d, const GLchar*);
+ATTRIB_N_UNIFORM_SETTERS(GLint, I, i, const GLchar*);
+ATTRIB_N_UNIFORM_SETTERS(GLuint, I, ui, const GLchar*);
+MATRIX_N_VECTOR_SETTERS(const GLchar*);
 
+ATTRIB_N_UNIFORM_SETTERS(GLfloat, , f, Name);
+ATTRIB_N_UNIFORM_SETTERS(GLdouble, , d, Name);
+ATTRIB_N_UNIFORM_SETTERS(GLint, I, i, Name);
+ATTRIB_N_UNIFORM_SETTERS(GLuint, I, ui, Name);
+MATRIX_N_VECTOR_SETTERS(Name);
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "Shader.h"
+#include "Hash.h"
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -26,6 +27,9 @@ namespace gk3d {
 
     /**
      Represents an OpenGL program made by linking shaders.
+
+     All active uniforms and attributes are reflected once, after linking, into flat
+     tables keyed by gk3d::Name, so looking up a location never calls into the driver.
      */
     class Program { 
     public:
@@ -57,56 +61,96 @@ namespace gk3d {
          @result The attribute index for the given name, as returned from glGetAttribLocation.
          */
         GLint attrib(const GLchar* attribName) const;
+        GLint attrib(Name attribName) const;
         
         
         /**
          @result The uniform index for the given name, as returned from glGetUniformLocation.
+
+         Elements of uniform arrays can be addressed both as `name[i]` and, for the first
+         element, as plain `name`.
          */
         GLint uniform(const GLchar* uniformName) const;
+        GLint uniform(Name uniformName) const;
+
+        /**
+         @result true if the program has an active uniform with the given name.
+         */
+        bool hasUniform(Name uniformName) const;
+
+        /**
+         Assigns the uniform block `blockName` to the uniform buffer binding point `binding`.
+
+         @result false if the program has no active block with that name.
+         */
+        bool bindUniformBlock(const GLchar* blockName, GLuint binding) const;
 
         /**
          Setters for attribute and uniform variables.
 
          These are convenience methods for the glVertexAttrib* and glUniform* functions.
+         Every setter takes either the plain name or its gk3d::Name; the latter should
+         be preferred inside the render loop.
          */
-#define _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE) \
-        void setAttrib(const GLchar* attribName, OGL_TYPE v0); \
-        void setAttrib(const GLchar* attribName, OGL_TYPE v0, OGL_TYPE v1); \
-        void setAttrib(const GLchar* attribName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2); \
-        void setAttrib(const GLchar* attribName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3); \
+#define _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE, NAME_TYPE) \
+        void setAttrib(NAME_TYPE attribName, OGL_TYPE v0); \
+        void setAttrib(NAME_TYPE attribName, OGL_TYPE v0, OGL_TYPE v1); \
+        void setAttrib(NAME_TYPE attribName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2); \
+        void setAttrib(NAME_TYPE attribName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3); \
 \
-        void setAttrib1v(const GLchar* attribName, const OGL_TYPE* v); \
-        void setAttrib2v(const GLchar* attribName, const OGL_TYPE* v); \
-        void setAttrib3v(const GLchar* attribName, const OGL_TYPE* v); \
-        void setAttrib4v(const GLchar* attribName, const OGL_TYPE* v); \
+        void setAttrib1v(NAME_TYPE attribName, const OGL_TYPE* v); \
+        void setAttrib2v(NAME_TYPE attribName, const OGL_TYPE* v); \
+        void setAttrib3v(NAME_TYPE attribName, const OGL_TYPE* v); \
+        void setAttrib4v(NAME_TYPE attribName, const OGL_TYPE* v); \
 \
-        void setUniform(const GLchar* uniformName, OGL_TYPE v0); \
-        void setUniform(const GLchar* uniformName, OGL_TYPE v0, OGL_TYPE v1); \
-        void setUniform(const GLchar* uniformName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2); \
-        void setUniform(const GLchar* uniformName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3); \
+        void setUniform(NAME_TYPE uniformName, OGL_TYPE v0); \
+        void setUniform(NAME_TYPE uniformName, OGL_TYPE v0, OGL_TYPE v1); \
+        void setUniform(NAME_TYPE uniformName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2); \
+        void setUniform(NAME_TYPE uniformName, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3); \
 \
-        void setUniform1v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
-        void setUniform2v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
-        void setUniform3v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
-        void setUniform4v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
-
-        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLfloat)
-        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLdouble)
-        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLint)
-        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLuint)
-
-        void setUniformMatrix2(const GLchar* uniformName, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE);
-        void setUniformMatrix3(const GLchar* uniformName, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE);
-        void setUniformMatrix4(const GLchar* uniformName, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE);
-        void setUniform(const GLchar* uniformName, const glm::mat2& m, GLboolean transpose=GL_FALSE);
-        void setUniform(const GLchar* uniformName, const glm::mat3& m, GLboolean transpose=GL_FALSE);
-        void setUniform(const GLchar* uniformName, const glm::mat4& m, GLboolean transpose=GL_FALSE);
-        void setUniform(const GLchar* uniformName, const glm::vec3& v);
-        void setUniform(const GLchar* uniformName, const glm::vec4& v);
+        void setUniform1v(NAME_TYPE uniformName, const OGL_TYPE* v, GLsizei count=1); \
+        void setUniform2v(NAME_TYPE uniformName, const OGL_TYPE* v, GLsizei count=1); \
+        void setUniform3v(NAME_TYPE uniformName, const OGL_TYPE* v, GLsizei count=1); \
+        void setUniform4v(NAME_TYPE uniformName, const OGL_TYPE* v, GLsizei count=1); \
+
+#define _TDOGL_PROGRAM_MATRIX_N_VECTOR_SETTERS(NAME_TYPE) \
+        void setUniformMatrix2(NAME_TYPE uniformName, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE); \
+        void setUniformMatrix3(NAME_TYPE uniformName, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE); \
+        void setUniformMatrix4(NAME_TYPE uniformName, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE); \
+        void setUniform(NAME_TYPE uniformName, const glm::mat2& m, GLboolean transpose=GL_FALSE); \
+        void setUniform(NAME_TYPE uniformName, const glm::mat3& m, GLboolean transpose=GL_FALSE); \
+        void setUniform(NAME_TYPE uniformName, const glm::mat4& m, GLboolean transpose=GL_FALSE); \
+        void setUniform(NAME_TYPE uniformName, const glm::vec3& v); \
+        void setUniform(NAME_TYPE uniformName, const glm::vec4& v); \
+
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLfloat, const GLchar*)
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLdouble, const GLchar*)
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLint, const GLchar*)
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLuint, const GLchar*)
+        _TDOGL_PROGRAM_MATRIX_N_VECTOR_SETTERS(const GLchar*)
+
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLfloat, Name)
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLdouble, Name)
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLint, Name)
+        _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLuint, Name)
+        _TDOGL_PROGRAM_MATRIX_N_VECTOR_SETTERS(Name)
 
         
     private:
+        /** One reflected uniform or attribute; tables are sorted by hash */
+        struct Location {
+            NameHash hash;
+            GLint location;
+
+            bool operator<(const Location& other) const { return hash < other.hash; }
+        };
+
         GLuint _object;
+        std::vector<Location> _uniforms;
+        std::vector<Location> _attribs;
+
+        void _reflect();
+        static const Location* _find(const std::vector<Location>& table, NameHash hash);
         
         //copying disabled
         Program(const Program&);
@@ -0,0 +1,86 @@
+#include "ProgramRegistry.h"
+#include "FrameState.h"
+#include "MaterialTable.h"
+#include <stdexcept>
+#include <vector>
+
+using namespace gk3d;
+
+//inserts `defines` on the line after the #version directive, which must stay first
+static std::string WithDefines(const std::string& source, const std::string& defines) {
+    if (defines.empty())
+        return source;
+
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return defines + source;
+
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return source + "\n" + defines;
+
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+ProgramRegistry::ProgramRegistry() :
+    _programs(),
+    _sources(),
+    _linkCount(0)
+{
+}
+
+ProgramHandle ProgramRegistry::get(const std::string& vertexFile, const std::string& fragmentFile, const std::string& defines) {
+    const std::string& vertexSource = _source(vertexFile);
+    const std::string& fragmentSource = _source(fragmentFile);
+
+    //the terminating zeros separate the parts, so "ab"+"c" and "a"+"bc" differ
+    ContentHash key = hashBytes(vertexSource.c_str(), vertexSource.size() + 1);
+    key = hashBytes(fragmentSource.c_str(), fragmentSource.size() + 1, key);
+    key = hashBytes(defines.c_str(), defines.size() + 1, key);
+
+    std::map<ContentHash, Entry>::iterator it = _programs.find(key);
+    if (it != _programs.end()) {
+        const Entry& entry = it->second;
+        if (entry.vertexSource != vertexSource || entry.fragmentSource != fragmentSource || entry.defines != defines)
+            throw std::runtime_error("Shader program hash collision: " + vertexFile + " / " + fragmentFile);
+
+        ProgramHandle program = entry.program.lock();
+        if (program)
+            return program;
+    }
+
+    std::vector<Shader> shaders;
+    shaders.push_back(Shader(WithDefines(vertexSource, defines), GL_VERTEX_SHADER));
+    shaders.push_back(Shader(WithDefines(fragmentSource, defines), GL_FRAGMENT_SHADER));
+    ProgramHandle program(new Program(shaders));
+    FrameState::bindBlocks(*program);
+    MaterialTable::bindBlock(*program);
+    _linkCount++;
+
+    Entry& entry = _programs[key];
+    entry.vertexSource = vertexSource;
+    entry.fragmentSource = fragmentSource;
+    entry.defines = defines;
+    entry.program = program;
+    return program;
+}
+
+size_t ProgramRegistry::size() const {
+    size_t alive = 0;
+    for (std::map<ContentHash, Entry>::const_iterator it = _programs.begin(); it != _programs.end(); ++it) {
+        if (!it->second.program.expired())
+            alive++;
+    }
+    return alive;
+}
+
+unsigned ProgramRegistry::linkCount() const {
+    return _linkCount;
+}
+
+const std::string& ProgramRegistry::_source(const std::string& filePath) {
+    std::map<std::string, std::string>::iterator it = _sources.find(filePath);
+    if (it == _sources.end())
+        it = _sources.insert(std::make_pair(filePath, Shader::sourceFromFile(filePath))).first;
+    return it->second;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include "Hash.h"
+#include "Program.h"
+
+namespace gk3d {
+
+    /**
+    * Shared, reference counted handle to a linked gk3d::Program.
+    */
+    typedef std::shared_ptr<Program> ProgramHandle;
+
+    /**
+    * Compiles and links each distinct shader program once.
+    *
+    * Programs are keyed by a hash of their vertex and fragment shader sources and of
+    * the preprocessor defines they were built with. Asking for a program that is
+    * already alive returns another handle to it; a program is deleted when its last
+    * handle is released.
+    */
+    class ProgramRegistry {
+    public:
+        ProgramRegistry();
+
+        /**
+        * Returns the program linked from the given shader files.
+        *
+        * @param defines  Preprocessor lines (e.g. "#define INSTANCED\n") inserted after
+        *                 the `#version` directive of both shaders.
+        *
+        * @throws std::exception if a file can not be read or the program fails to build.
+        */
+        ProgramHandle get(const std::string& vertexFile, const std::string& fragmentFile, const std::string& defines = "");
+
+        /** Number of programs currently alive */
+        size_t size() const;
+
+        /** Number of programs compiled and linked so far */
+        unsigned linkCount() const;
+
+    private:
+        struct Entry {
+            std::string vertexSource;
+            std::string fragmentSource;
+            std::string defines;
+            std::weak_ptr<Program> program;
+        };
+
+        std::map<ContentHash, Entry> _programs;
+        std::map<std::string, std::string> _sources;
+        unsigned _linkCount;
+
+        const std::string& _source(const std::string& filePath);
+
+        //copying disabled
+        ProgramRegistry(const ProgramRegistry&);
+        const ProgramRegistry& operator=(const ProgramRegistry&);
+    };
+
+}
@@ -0,0 +1,306 @@
+#include "RenderQueue.h"
+#include "Model.h"
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <glm/gtc/matrix_inverse.hpp>
+
+using namespace gk3d;
+
+/*
+ * Key layout, most significant bits first:
+ *
+ *   opaque:  pass:2 | blended:1 | program:8 | material:12 | vao:12 | depth:24 (near to far) | 5 unused
+ *   blended: pass:2 | blended:1 | depth:24 (far to near) | program:8 | material:12 | vao:12 | 5 unused
+ */
+static const unsigned PassShift = 62;
+static const unsigned BlendedShift = 61;
+static const uint64_t DepthMask = (1u << 24) - 1;
+
+//must match MAX_TEXTURES in the scene shaders
+static const unsigned MaxTextures = 10;
+
+//wrap modes as the scene shaders apply them to texture array layers
+static inline GLint WrapCode(GLint wrapMode) {
+    switch (wrapMode) {
+        case GL_MIRRORED_REPEAT: return 1;
+        case GL_CLAMP_TO_EDGE: return 2;
+        case GL_CLAMP_TO_BORDER: return 3;
+        default: return 0;
+    }
+}
+
+//per-instance attributes of the scene shaders; matrices take one location per column
+static constexpr Name InstanceModel("instanceModel");
+static constexpr Name InstanceNormalMatrix("instanceNormalMatrix");
+
+static inline uint64_t StateBits(const Mesh* mesh) {
+    return ((uint64_t)(mesh->shaders->object() & 0xFF) << 24) |
+           ((uint64_t)(mesh->id & 0xFFF) << 12) |
+           (uint64_t)(mesh->vao & 0xFFF);
+}
+
+static inline bool IsBlended(uint64_t key) {
+    return (key >> BlendedShift) & 1;
+}
+
+RenderQueue::RenderQueue() :
+    _view(),
+    _farPlane(1.0f),
+    _packets(),
+    _scratch(),
+    _instances(),
+    _instanceBuffer(0),
+    _samplers(),
+    _boundSampler(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+RenderQueue::~RenderQueue() {
+    if (_instanceBuffer != 0)
+        glDeleteBuffers(1, &_instanceBuffer);
+}
+
+void RenderQueue::setupInstanceAttributes(const Program& program) {
+    GLint model = program.attrib(InstanceModel);
+    for (GLint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(model + column);
+        glVertexAttribDivisor(model + column, 1);
+    }
+    GLint normalMatrix = program.attrib(InstanceNormalMatrix);
+    for (GLint column = 0; column < 3; ++column) {
+        glEnableVertexAttribArray(normalMatrix + column);
+        glVertexAttribDivisor(normalMatrix + column, 1);
+    }
+}
+
+void RenderQueue::begin(const Camera& camera) {
+    _view = camera.view();
+    _farPlane = camera.farPlane();
+    _packets.clear();
+}
+
+void RenderQueue::add(const Mesh* mesh, const glm::mat4& transform, unsigned pass, GLuint condition) {
+    assert(pass < 4);
+
+    //view-space distance of the model origin, quantised over [0, far]
+    float depth = -(_view * transform[3]).z / _farPlane;
+    depth = std::min(std::max(depth, 0.0f), 1.0f);
+    uint64_t quantisedDepth = (uint64_t)(depth * DepthMask);
+
+    Packet packet;
+    packet.key = (uint64_t)pass << PassShift;
+    if (mesh->isBlended()) {
+        packet.key |= (uint64_t)1 << BlendedShift;
+        packet.key |= (DepthMask - quantisedDepth) << 37;
+        packet.key |= StateBits(mesh) << 5;
+    } else {
+        packet.key |= StateBits(mesh) << 29;
+        packet.key |= quantisedDepth << 5;
+    }
+    packet.mesh = mesh;
+    packet.transform = &transform;
+    packet.condition = condition;
+    _packets.push_back(packet);
+}
+
+void RenderQueue::sort() {
+    _radixSort();
+}
+
+void RenderQueue::submit(const RenderParams& params) {
+    memset(&_stats, 0, sizeof(_stats));
+    _uploadInstances();
+
+    const Program* program = NULL;
+    const Mesh* material = NULL;
+    GLuint vao = 0;
+    GLuint boundTexture = 0;
+    bool blending = false;
+    glDisable(GL_BLEND);
+
+    SamplerState samplerState;
+    samplerState.magFilter = params.magTextureFilter;
+    samplerState.minFilter = params.minTextureFilter;
+    samplerState.lodBias = params.bias;
+    samplerState.anisotropy = params.anisotropy;
+    //layers apply their own wrap mode in the shader
+    samplerState.wrapMode = GL_REPEAT;
+
+    //samplers stay bound across frames, until the parameters change
+    GLuint sampler = _samplers.get(samplerState);
+    if (_boundSampler != sampler) {
+        glBindSampler(0, sampler);
+        _boundSampler = sampler;
+        _stats.samplerBinds++;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+
+    for (size_t i = 0; i < _packets.size(); ) {
+        const Packet& packet = _packets[i];
+        const Mesh* mesh = packet.mesh;
+
+        //the following draws of the same mesh become instances of this one, unless they are conditional
+        size_t instanceCount = 1;
+        while (packet.condition == 0 && i + instanceCount < _packets.size() &&
+               _packets[i + instanceCount].mesh == mesh && _packets[i + instanceCount].condition == 0)
+            instanceCount++;
+
+        if (IsBlended(packet.key) != blending) {
+            blending = !blending;
+            if (blending) {
+                glEnable(GL_BLEND);
+            } else {
+                glDisable(GL_BLEND);
+            }
+        }
+
+        if (mesh->shaders.get() != program) {
+            program = mesh->shaders.get();
+            program->use();
+            material = NULL; //uniform values belong to the program
+            _stats.programSwitches++;
+        }
+        Program* shaders = mesh->shaders.get();
+
+        if (mesh != material) {
+            material = mesh;
+            int t_size = (int) mesh->textures.size();
+            assert(t_size <= (int) MaxTextures);
+            shaders->setUniform(uniforms::useTexture, t_size > 0 ? 1.0f : 0.0f);
+            if (t_size > 0) {
+                shaders->setUniform(uniforms::numTextures, t_size);
+                shaders->setUniform(uniforms::layers, 0);
+            }
+
+            //every texture is a layer of the same array, so meshes share one texture unit
+            for (int j = 0; j < t_size; ++j) {
+                const Texture* texture = mesh->textures[j];
+                assert(texture->layer() >= 0);
+                shaders->setUniform(uniforms::textureLayers.element(j), texture->layer());
+                shaders->setUniform(uniforms::textureWraps.element(j), WrapCode(texture->wrapMode()));
+
+                if (boundTexture == texture->object())
+                    continue;
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, texture->object());
+                boundTexture = texture->object();
+                _stats.textureBinds++;
+            }
+
+            //quantised positions are scaled back within the mesh's bounds
+            shaders->setUniform(uniforms::positionScale, mesh->positionScale);
+            shaders->setUniform(uniforms::positionOffset, mesh->positionOffset);
+            shaders->setUniform(uniforms::octahedralNormals, mesh->octahedralNormals ? 1 : 0);
+
+            //meshes without per-vertex materials select theirs through the attribute's current value
+            if (mesh->material != Mesh::PerVertexMaterial)
+                shaders->setAttrib(attributes::vertMaterial, mesh->material);
+        }
+
+        if (mesh->vao != vao) {
+            vao = mesh->vao;
+            glBindVertexArray(vao);
+            _stats.vaoBinds++;
+        }
+
+        _pointInstanceAttributes(*shaders, i);
+        if (packet.condition != 0) {
+            //don't wait for the query: if its result is not ready the GPU draws anyway
+            glBeginConditionalRender(packet.condition, GL_QUERY_NO_WAIT);
+            _stats.conditionalDraws++;
+        }
+        const GLsizei ranges = (GLsizei) mesh->drawCounts.size();
+        if (instanceCount == 1 && ranges > 1) {
+            //older GLEW headers declare the arrays non-const
+            glMultiDrawElementsBaseVertex(mesh->drawType, const_cast<GLsizei*>(&mesh->drawCounts[0]), mesh->indexType,
+                                          const_cast<GLvoid**>(&mesh->drawOffsets[0]), ranges,
+                                          const_cast<GLint*>(&mesh->baseVertices[0]));
+            _stats.draws++;
+        } else {
+            for (GLsizei r = 0; r < ranges; ++r) {
+                glDrawElementsInstancedBaseVertex(mesh->drawType, mesh->drawCounts[r], mesh->indexType, mesh->drawOffsets[r],
+                                                  (GLsizei) instanceCount, mesh->baseVertices[r]);
+            }
+            _stats.draws += ranges;
+        }
+        if (packet.condition != 0)
+            glEndConditionalRender();
+        _stats.ranges += ranges;
+        _stats.instances += instanceCount;
+        i += instanceCount;
+    }
+
+    //unbind everything
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+    glEnable(GL_BLEND);
+}
+
+const RenderQueue::Stats& RenderQueue::stats() const {
+    return _stats;
+}
+
+void RenderQueue::_uploadInstances() {
+    _instances.resize(_packets.size());
+    for (size_t i = 0; i < _packets.size(); ++i) {
+        const glm::mat4& model = *_packets[i].transform;
+        _instances[i].model = model;
+        _instances[i].normalMatrix = glm::inverseTranspose(glm::mat3(model));
+    }
+
+    if (_instanceBuffer == 0)
+        glGenBuffers(1, &_instanceBuffer);
+
+    //orphan last frame's instances, the GPU may still be reading them
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, _instances.size() * sizeof(Instance), _instances.empty() ? NULL : &_instances[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//points the instance attributes of the bound VAO at the batch starting at `firstInstance`
+void RenderQueue::_pointInstanceAttributes(const Program& program, size_t firstInstance) {
+    const size_t base = firstInstance * sizeof(Instance);
+    GLint model = program.attrib(InstanceModel);
+    for (GLint column = 0; column < 4; ++column) {
+        glVertexAttribPointer(model + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                              (const GLvoid*) (base + offsetof(Instance, model) + column * sizeof(glm::vec4)));
+    }
+    GLint normalMatrix = program.attrib(InstanceNormalMatrix);
+    for (GLint column = 0; column < 3; ++column) {
+        glVertexAttribPointer(normalMatrix + column, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                              (const GLvoid*) (base + offsetof(Instance, normalMatrix) + column * sizeof(glm::vec3)));
+    }
+}
+
+//LSD radix sort by key, 8 bits per pass; passes where every key has the same digit are skipped
+void RenderQueue::_radixSort() {
+    const size_t count = _packets.size();
+    if (count < 2)
+        return;
+
+    _scratch.resize(count);
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+        size_t offsets[256];
+        memset(offsets, 0, sizeof(offsets));
+        for (size_t i = 0; i < count; ++i)
+            offsets[(_packets[i].key >> shift) & 0xFF]++;
+
+        if (offsets[(_packets[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t sum = 0;
+        for (unsigned digit = 0; digit < 256; ++digit) {
+            size_t digitCount = offsets[digit];
+            offsets[digit] = sum;
+            sum += digitCount;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            _scratch[offsets[(_packets[i].key >> shift) & 0xFF]++] = _packets[i];
+        _packets.swap(_scratch);
+    }
+}
+
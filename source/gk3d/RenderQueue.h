@@ -0,0 +1,124 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+#include "Camera.h"
+#include "Program.h"
+#include "SamplerCache.h"
+
+namespace gk3d {
+
+    struct Mesh;
+    struct RenderParams;
+
+    /**
+    * Collects the draws of a frame, sorts them by a packed 64-bit key and submits them
+    * issuing only the GL calls whose state actually changed.
+    *
+    * Opaque draws are ordered by program, material, VAO and then front-to-back, and are
+    * drawn with blending disabled. Blended draws follow, ordered back-to-front.
+    *
+    * Consecutive draws of the same mesh are merged into one instanced draw call. The model
+    * and normal matrices of every instance are streamed into a per-frame vertex buffer
+    * read through the `instanceModel` and `instanceNormalMatrix` attributes.
+    *
+    * A mesh made of several index ranges is issued with one glMultiDrawElementsBaseVertex
+    * when drawn once, or with one instanced draw per range otherwise.
+    *
+    * Draws queued with an occlusion query as condition are issued on their own, under
+    * glBeginConditionalRender, so the GPU skips them if the query found no samples.
+    *
+    * Textures are layers of a gk3d::TextureArray bound to unit 0, sampled through a
+    * sampler object built from the gk3d::RenderParams. The sampler is rebound only when
+    * the parameters change.
+    */
+    class RenderQueue {
+    public:
+        /** Number of GL calls issued by the last `submit` */
+        struct Stats {
+            unsigned draws;
+            unsigned ranges;
+            unsigned instances;
+            unsigned programSwitches;
+            unsigned textureBinds;
+            unsigned samplerBinds;
+            unsigned vaoBinds;
+            unsigned conditionalDraws;
+        };
+
+        RenderQueue();
+        ~RenderQueue();
+
+        /**
+        * Enables the per-instance attributes of `program` in the currently bound VAO.
+        *
+        * Must be called once for every VAO drawn through the queue.
+        */
+        static void setupInstanceAttributes(const Program& program);
+
+        /**
+        * Starts a new frame seen through `camera`, discarding the previous draws.
+        */
+        void begin(const Camera& camera);
+
+        /**
+        * Queues a draw of `mesh` with the model matrix `transform`.
+        *
+        * The transform is referenced, not copied, and must stay alive until `submit`.
+        *
+        * @param pass       Draws of lower passes are submitted first, 0 - 3.
+        * @param condition  Occlusion query the draw is conditional on, or 0.
+        */
+        void add(const Mesh* mesh, const glm::mat4& transform, unsigned pass = 0, GLuint condition = 0);
+
+        /**
+        * Sorts the queued draws by key.
+        */
+        void sort();
+
+        /**
+        * Uploads the instance matrices and issues the sorted draws.
+        *
+        * Requires a current OpenGL context.
+        */
+        void submit(const RenderParams& params);
+
+        /** Counters of the last `submit` */
+        const Stats& stats() const;
+
+    private:
+        struct Packet {
+            uint64_t key;
+            const Mesh* mesh;
+            const glm::mat4* transform;
+            GLuint condition;
+        };
+
+        //layout of the instance buffer, one per packet
+        struct Instance {
+            glm::mat4 model;
+            glm::mat3 normalMatrix;
+        };
+
+        glm::mat4 _view;
+        float _farPlane;
+        std::vector<Packet> _packets;
+        std::vector<Packet> _scratch;
+        std::vector<Instance> _instances;
+        GLuint _instanceBuffer;
+        SamplerCache _samplers;
+        GLuint _boundSampler;
+        Stats _stats;
+
+        void _radixSort();
+        void _uploadInstances();
+        static void _pointInstanceAttributes(const Program& program, size_t firstInstance);
+
+        //copying disabled
+        RenderQueue(const RenderQueue&);
+        const RenderQueue& operator=(const RenderQueue&);
+    };
+
+}
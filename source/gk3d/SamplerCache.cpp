@@ -0,0 +1,52 @@
+#include "SamplerCache.h"
+#include <algorithm>
+
+using namespace gk3d;
+
+bool SamplerState::operator<(const SamplerState& other) const {
+    if (magFilter != other.magFilter)
+        return magFilter < other.magFilter;
+    if (minFilter != other.minFilter)
+        return minFilter < other.minFilter;
+    if (wrapMode != other.wrapMode)
+        return wrapMode < other.wrapMode;
+    if (lodBias != other.lodBias)
+        return lodBias < other.lodBias;
+    return anisotropy < other.anisotropy;
+}
+
+SamplerCache::SamplerCache() :
+    _samplers()
+{
+}
+
+SamplerCache::~SamplerCache() {
+    for (std::map<SamplerState, GLuint>::iterator it = _samplers.begin(); it != _samplers.end(); ++it)
+        glDeleteSamplers(1, &it->second);
+}
+
+GLuint SamplerCache::get(const SamplerState& state) {
+    std::map<SamplerState, GLuint>::iterator it = _samplers.find(state);
+    if (it != _samplers.end())
+        return it->second;
+
+    GLuint sampler = 0;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, state.magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, state.minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, state.wrapMode);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, state.wrapMode);
+    glSamplerParameterf(sampler, GL_TEXTURE_LOD_BIAS, state.lodBias);
+    if (state.anisotropy > 1.0f && GLEW_EXT_texture_filter_anisotropic) {
+        GLfloat maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(state.anisotropy, maxAnisotropy));
+    }
+
+    _samplers.insert(std::make_pair(state, sampler));
+    return sampler;
+}
+
+size_t SamplerCache::size() const {
+    return _samplers.size();
+}
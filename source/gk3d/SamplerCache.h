@@ -0,0 +1,63 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <map>
+
+namespace gk3d {
+
+    /**
+    * How a texture is sampled; the key of a gk3d::SamplerCache.
+    */
+    struct SamplerState {
+        GLint magFilter;
+        GLint minFilter;
+        GLint wrapMode;
+        GLfloat lodBias;
+        /** maximum anisotropy, 1 for none */
+        GLfloat anisotropy;
+
+        SamplerState() :
+                magFilter(GL_LINEAR),
+                minFilter(GL_LINEAR),
+                wrapMode(GL_CLAMP_TO_EDGE),
+                lodBias(0.0f),
+                anisotropy(1.0f) {
+        }
+
+        bool operator<(const SamplerState& other) const;
+    };
+
+    /**
+    * Creates one OpenGL sampler object per distinct gk3d::SamplerState and keeps it for
+    * the lifetime of the cache.
+    *
+    * Sampling parameters live in the sampler bound to a texture unit, so changing them
+    * selects another sampler instead of modifying the texture objects.
+    */
+    class SamplerCache {
+    public:
+        SamplerCache();
+        ~SamplerCache();
+
+        /**
+        * Returns the sampler for `state`, creating it on first use. Requires a current
+        * OpenGL context.
+        *
+        * An anisotropy above 1 is clamped to what the driver supports, and ignored
+        * without EXT_texture_filter_anisotropic.
+        */
+        GLuint get(const SamplerState& state);
+
+        /** Number of samplers created */
+        size_t size() const;
+
+    private:
+        std::map<SamplerState, GLuint> _samplers;
+
+        //copying disabled
+        SamplerCache(const SamplerCache&);
+        const SamplerCache& operator=(const SamplerCache&);
+    };
+
+}
@@ -87,6 +87,12 @@ Shader& Shader::operator = (const Shader& other) {
 }
 
 Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
+    //return new shader
+    Shader shader(sourceFromFile(filePath), shaderType);
+    return shader;
+}
+
+std::string Shader::sourceFromFile(const std::string& filePath) {
     //open file
     std::ifstream f;
     f.open(filePath.c_str(), std::ios::in | std::ios::binary);
@@ -97,10 +103,7 @@ Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
     //read whole file into stringstream buffer
     std::stringstream buffer;
     buffer << f.rdbuf();
-
-    //return new shader
-    Shader shader(buffer.str(), shaderType);
-    return shader;
+    return buffer.str();
 }
 
 void Shader::_retain() {
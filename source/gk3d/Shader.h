@@ -39,6 +39,13 @@ namespace gk3d {
          @throws std::exception if an error occurs.
          */
         static Shader shaderFromFile(const std::string& filePath, GLenum shaderType);
+
+        /**
+         Reads the whole text file `filePath`.
+
+         @throws std::exception if the file can not be opened.
+         */
+        static std::string sourceFromFile(const std::string& filePath);
         
         
         /**
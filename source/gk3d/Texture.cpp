@@ -17,6 +17,8 @@
  */
 
 #include "Texture.h"
+#include "MipGenerator.h"
+#include "TextureContainer.h"
 #include <stdexcept>
 
 using namespace gk3d;
@@ -24,40 +26,76 @@ using namespace gk3d;
 static GLenum TextureFormatForBitmapFormat(Bitmap::Format format)
 {
     switch (format) {
-        case Bitmap::Format_Grayscale: return GL_LUMINANCE;
-        case Bitmap::Format_GrayscaleAlpha: return GL_LUMINANCE_ALPHA;
+        case Bitmap::Format_Grayscale: return GL_RED;
+        case Bitmap::Format_GrayscaleAlpha: return GL_RG;
         case Bitmap::Format_RGB: return GL_RGB;
         case Bitmap::Format_RGBA: return GL_RGBA;
         default: throw std::runtime_error("Unrecognised Bitmap::Format");
     }
 }
 
+static GLenum SizedFormatForBitmapFormat(Bitmap::Format format)
+{
+    switch (format) {
+        case Bitmap::Format_Grayscale: return GL_R8;
+        case Bitmap::Format_GrayscaleAlpha: return GL_RG8;
+        case Bitmap::Format_RGB: return GL_RGB8;
+        case Bitmap::Format_RGBA: return GL_RGBA8;
+        default: throw std::runtime_error("Unrecognised Bitmap::Format");
+    }
+}
+
 Texture::Texture(const Bitmap& bitmap, GLint minMagFiler, GLint wrapMode) :
-    _originalWidth((GLfloat)bitmap.width()),
-    _originalHeight((GLfloat)bitmap.height())
+    Texture(bitmap.view(), minMagFiler, wrapMode)
+{
+}
+
+Texture::Texture(const BitmapView& view, GLint minMagFiler, GLint wrapMode) :
+    _originalWidth((GLfloat)view.width),
+    _originalHeight((GLfloat)view.height),
+    _hasAlpha(view.format == Bitmap::Format_GrayscaleAlpha || view.format == Bitmap::Format_RGBA),
+    _wrapMode(wrapMode),
+    _layer(-1),
+    _format(view.format)
 {
-    glGenTextures(1, &_object);
+    //the core profile has no luminance formats: grayscale is stored in red, alpha in green
+    TextureContainer container;
+    container.width = view.width;
+    container.height = view.height;
+    container.internalFormat = SizedFormatForBitmapFormat(view.format);
+    container.format = TextureFormatForBitmapFormat(view.format);
+    if (view.format == Bitmap::Format_Grayscale || view.format == Bitmap::Format_GrayscaleAlpha) {
+        container.swizzle[0] = container.swizzle[1] = container.swizzle[2] = GL_RED;
+        container.swizzle[3] = view.format == Bitmap::Format_GrayscaleAlpha ? GL_GREEN : GL_ONE;
+    }
+    //mipmaps are filtered on the CPU, in linear light, rather than by glGenerateMipmap
+    GenerateMips(view.pixels, view.width, view.height, view.format, MipFilter_Kaiser, true, container.levels, 0, view.rowStride);
+    _object = container.upload(GL_TEXTURE_2D);
+
     glBindTexture(GL_TEXTURE_2D, _object);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minMagFiler);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, minMagFiler);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0, 
-                 TextureFormatForBitmapFormat(bitmap.format()),
-                 (GLsizei)bitmap.width(), 
-                 (GLsizei)bitmap.height(),
-                 0, 
-                 TextureFormatForBitmapFormat(bitmap.format()), 
-                 GL_UNSIGNED_BYTE, 
-                 bitmap.pixelBuffer());
-    glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+Texture::Texture(GLint layer, unsigned width, unsigned height, bool hasAlpha, GLint wrapMode) :
+    _object(0),
+    _originalWidth((GLfloat)width),
+    _originalHeight((GLfloat)height),
+    _hasAlpha(hasAlpha),
+    _wrapMode(wrapMode),
+    _layer(layer),
+    _format(hasAlpha ? Bitmap::Format_RGBA : Bitmap::Format_RGB)
+{
+}
+
 Texture::~Texture()
 {
-    glDeleteTextures(1, &_object);
+    //layers share the object of their array, which deletes it
+    if (_layer < 0)
+        glDeleteTextures(1, &_object);
 }
 
 GLuint Texture::object() const
@@ -74,3 +112,45 @@ GLfloat Texture::originalHeight() const
 {
     return _originalHeight;
 }
+
+bool Texture::hasAlpha() const
+{
+    return _hasAlpha;
+}
+
+GLenum Texture::target() const
+{
+    return _layer < 0 ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY;
+}
+
+GLint Texture::layer() const
+{
+    return _layer;
+}
+
+GLint Texture::wrapMode() const
+{
+    return _wrapMode;
+}
+
+void Texture::update(const BitmapView& view, GLint column, GLint row, GLint level)
+{
+    if (_layer >= 0)
+        throw std::runtime_error("Texture array layers are updated through their array");
+    if (view.format != _format)
+        throw std::runtime_error("Format of the view does not match the texture");
+    if (view.rowStride % view.format != 0)
+        throw std::runtime_error("Row stride of the view is not a whole number of pixels");
+    if (view.width == 0 || view.height == 0)
+        return;
+
+    //the rows are read where they are, however far apart
+    glBindTexture(GL_TEXTURE_2D, _object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint) (view.rowStride / view.format));
+    glTexSubImage2D(GL_TEXTURE_2D, level, column, row, (GLsizei) view.width, (GLsizei) view.height,
+                    TextureFormatForBitmapFormat(view.format), GL_UNSIGNED_BYTE, view.pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -20,11 +20,14 @@
 
 #include <GL/glew.h>
 #include "Bitmap.h"
+#include "BitmapView.h"
 
 namespace gk3d {
+
+    class TextureArray;
     
     /**
-     Represents an OpenGL texture
+     Represents an OpenGL texture, or one layer of a gk3d::TextureArray
      */
     class Texture {
     public:
@@ -43,15 +46,35 @@ namespace gk3d {
                 GLint minMagFiler = GL_LINEAR,
                 GLint wrapMode = GL_CLAMP_TO_EDGE);
         
+        /**
+         Creates a texture from the pixels of a view, e.g. a rectangle of a bitmap. The rows
+         are read where they are; the only copy is the base level of the mip chain, packed
+         as it is read.
+         */
+        Texture(const BitmapView& view,
+                GLint minMagFiler = GL_LINEAR,
+                GLint wrapMode = GL_CLAMP_TO_EDGE);
+        
         /**
          Deletes the texture object with glDeleteTextures
          */
         ~Texture();
         
         /**
-         @result The texure object, as created by glGenTextures
+         @result The texure object, as created by glGenTextures. For a layer, the array
+                 texture it belongs to.
          */
         GLuint object() const;
+
+        /**
+         @result GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for a layer
+         */
+        GLenum target() const;
+
+        /**
+         @result The index of the layer in its gk3d::TextureArray, or -1
+         */
+        GLint layer() const;
         
         /**
          @result The original width (in pixels) of the bitmap this texture was made from
@@ -62,11 +85,40 @@ namespace gk3d {
          @result The original height (in pixels) of the bitmap this texture was made from
          */
         GLfloat originalHeight() const;
+
+        /**
+         @result true if the bitmap this texture was made from has an alpha channel
+         */
+        bool hasAlpha() const;
+
+        /**
+         @result The wrap mode the texture was created with; the scene shader applies it to layers
+         */
+        GLint wrapMode() const;
+        
+        /**
+         Replaces the rectangle of `level` with its top left at (column, row) by the pixels
+         of `view`. The view's rows are read in place through GL_UNPACK_ROW_LENGTH, so a
+         rectangle of a larger image is uploaded without being copied out. Other levels
+         are left as they are.
+         
+         Will throw an exception for a layer of a gk3d::TextureArray, which may be resampled
+         or compressed, for a view of another format than the texture was created from, or
+         for a view whose row stride is not a whole number of pixels.
+         */
+        void update(const BitmapView& view, GLint column = 0, GLint row = 0, GLint level = 0);
         
     private:
         GLuint _object;
         GLfloat _originalWidth;
         GLfloat _originalHeight;
+        bool _hasAlpha;
+        GLint _wrapMode;
+        GLint _layer;
+        Bitmap::Format _format;
+
+        friend class TextureArray;
+        Texture(GLint layer, unsigned width, unsigned height, bool hasAlpha, GLint wrapMode);
         
         //copying disabled
         Texture(const Texture&);
@@ -0,0 +1,382 @@
+#include "TextureArray.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+using namespace gk3d;
+
+//what the fills of one upload share: the levels, and the layers they are built from unless loaded from the cache
+struct TextureArray::Build {
+    TextureContainer container;
+    std::vector<Layer> layers;
+    std::vector<Bitmap> bitmaps;
+    bool compressed;
+    BlockFormat format;
+    MipFilter mipFilter;
+    std::string cachePath;
+    /** one per layer, for the fill that builds it; NULL if the levels came from the cache */
+    std::unique_ptr<std::once_flag[]> built;
+    std::atomic<size_t> layersLeft;
+    /** why the levels could not be saved; read on the GL thread once every fill has finished */
+    std::string saveError;
+
+    void buildLayer(size_t layer);
+};
+
+//reads the pixel at (col, row) of `bitmap` as RGBA
+static inline void ReadRGBA(const Bitmap& bitmap, unsigned col, unsigned row, float rgba[4]) {
+    const unsigned char* pixel = bitmap.pixelBuffer() + (row * bitmap.width() + col) * bitmap.format();
+    switch (bitmap.format()) {
+        case Bitmap::Format_Grayscale:
+            rgba[0] = rgba[1] = rgba[2] = pixel[0];
+            rgba[3] = 255.0f;
+            break;
+        case Bitmap::Format_GrayscaleAlpha:
+            rgba[0] = rgba[1] = rgba[2] = pixel[0];
+            rgba[3] = pixel[1];
+            break;
+        case Bitmap::Format_RGB:
+            rgba[0] = pixel[0];
+            rgba[1] = pixel[1];
+            rgba[2] = pixel[2];
+            rgba[3] = 255.0f;
+            break;
+        case Bitmap::Format_RGBA:
+            rgba[0] = pixel[0];
+            rgba[1] = pixel[1];
+            rgba[2] = pixel[2];
+            rgba[3] = pixel[3];
+            break;
+        default:
+            throw std::runtime_error("Unrecognised Bitmap::Format");
+    }
+}
+
+//stretches `src` to `width` x `height` RGBA pixels at `dest`, sampling at pixel centres
+static void ResampleRGBA(const Bitmap& src, unsigned width, unsigned height, unsigned char* dest) {
+    const float scaleX = (float) src.width() / width;
+    const float scaleY = (float) src.height() / height;
+    for (unsigned row = 0; row < height; ++row) {
+        float y = std::max((row + 0.5f) * scaleY - 0.5f, 0.0f);
+        unsigned y0 = std::min((unsigned) y, src.height() - 1);
+        unsigned y1 = std::min(y0 + 1, src.height() - 1);
+        float fy = y - y0;
+        for (unsigned col = 0; col < width; ++col) {
+            float x = std::max((col + 0.5f) * scaleX - 0.5f, 0.0f);
+            unsigned x0 = std::min((unsigned) x, src.width() - 1);
+            unsigned x1 = std::min(x0 + 1, src.width() - 1);
+            float fx = x - x0;
+
+            float p00[4], p10[4], p01[4], p11[4];
+            ReadRGBA(src, x0, y0, p00);
+            ReadRGBA(src, x1, y0, p10);
+            ReadRGBA(src, x0, y1, p01);
+            ReadRGBA(src, x1, y1, p11);
+            for (int c = 0; c < 4; ++c) {
+                float top = p00[c] + (p10[c] - p00[c]) * fx;
+                float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+                *dest++ = (unsigned char) (top + (bottom - top) * fy + 0.5f);
+            }
+        }
+    }
+}
+
+//continues the hash `basis` with the bytes of the file at `path`
+static ContentHash HashFile(const std::string& path, ContentHash basis) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::runtime_error("Failed to open texture: " + path);
+    unsigned char buffer[65536];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        basis = hashBytes(buffer, read, basis);
+    fclose(file);
+    return basis;
+}
+
+void TextureArray::Build::buildLayer(size_t i) {
+    const Layer& layer = layers[i];
+    std::unique_ptr<Bitmap> decoded;
+    if (!layer.path.empty())
+        decoded.reset(new Bitmap(Bitmap::bitmapFromFile(layer.path)));
+    const Bitmap& bitmap = decoded ? *decoded : bitmaps[layer.bitmap];
+
+    std::vector<unsigned char> pixels((size_t) container.width * container.height * 4);
+    ResampleRGBA(bitmap, container.width, container.height, &pixels[0]);
+    decoded.reset();
+
+    //layers build in parallel already: each stays on its worker thread
+    std::vector<std::vector<unsigned char> > mips;
+    GenerateMips(&pixels[0], container.width, container.height, 4, mipFilter, true, mips, 1);
+    const bool channelFormat = compressed && (format == BlockFormat_BC4 || format == BlockFormat_BC5);
+    for (unsigned level = 0; level < mips.size(); ++level) {
+        //grayscale in red, alpha in green: moved only after filtering, so alpha is filtered as linear, not sRGB
+        if (channelFormat) {
+            std::vector<unsigned char>& mip = mips[level];
+            for (size_t p = 0; p < mip.size(); p += 4)
+                mip[p + 1] = mip[p + 3];
+        }
+        unsigned char* data = &container.levels[level][i * container.layerSize(level)];
+        if (compressed)
+            CompressBlocks(&mips[level][0], container.levelWidth(level), container.levelHeight(level), format, data, 1);
+        else
+            memcpy(data, &mips[level][0], mips[level].size());
+    }
+
+    //the last layer built saves them all
+    if (--layersLeft == 0 && !cachePath.empty()) {
+        try {
+            container.save(cachePath);
+        } catch (const std::exception& e) {
+            saveError = e.what();
+        }
+    }
+}
+
+TextureArray::TextureArray() :
+    _layers(),
+    _bitmaps(),
+    _textures(),
+    _layerCount(0),
+    _width(0),
+    _height(0),
+    _object(0),
+    _internalFormat(GL_RGBA8),
+    _bytes(0),
+    _compressed(false),
+    _mipFilter(MipFilter_Kaiser),
+    _cachePath(),
+    _cacheError(),
+    _pendingRegions(),
+    _failedRegions(0),
+    _baseLevel(0)
+{
+}
+
+TextureArray::~TextureArray() {
+    for (size_t i = 0; i < _textures.size(); ++i)
+        delete _textures[i];
+    if (_object != 0)
+        glDeleteTextures(1, &_object);
+}
+
+Texture* TextureArray::add(const Bitmap& bitmap, GLint wrapMode) {
+    size_t index = 0;
+    const size_t bytes = (size_t) bitmap.width() * bitmap.height() * bitmap.format();
+    while (index < _layers.size()) {
+        const Layer& layer = _layers[index];
+        if (layer.path.empty()) {
+            const Bitmap& other = _bitmaps[layer.bitmap];
+            if (other.width() == bitmap.width() && other.height() == bitmap.height() && other.format() == bitmap.format() &&
+                memcmp(other.pixelBuffer(), bitmap.pixelBuffer(), bytes) == 0)
+                break;
+        }
+        ++index;
+    }
+
+    Layer layer;
+    layer.bitmap = _bitmaps.size();
+    layer.width = bitmap.width();
+    layer.height = bitmap.height();
+    layer.format = bitmap.format();
+    const bool added = index == _layers.size();
+    Texture* texture = _add(layer, index, wrapMode);
+    if (added)
+        _bitmaps.push_back(bitmap);
+    return texture;
+}
+
+Texture* TextureArray::add(const std::string& path, GLint wrapMode) {
+    size_t index = 0;
+    while (index < _layers.size() && _layers[index].path != path)
+        ++index;
+
+    Layer layer;
+    layer.path = path;
+    layer.bitmap = 0;
+    if (index == _layers.size() && !Bitmap::infoFromFile(path, layer.width, layer.height, layer.format))
+        throw std::runtime_error("Failed to read texture: " + path);
+    return _add(layer, index, wrapMode);
+}
+
+Texture* TextureArray::_add(const Layer& layer, size_t index, GLint wrapMode) {
+    if (_object != 0)
+        throw std::runtime_error("Texture array was already uploaded");
+
+    if (index == _layers.size()) {
+        _layers.push_back(layer);
+        _width = std::max(_width, layer.width);
+        _height = std::max(_height, layer.height);
+        _layerCount++;
+    }
+    const Layer& added = _layers[index];
+    const bool alpha = added.format == Bitmap::Format_GrayscaleAlpha || added.format == Bitmap::Format_RGBA;
+    Texture* texture = new Texture((GLint) index, added.width, added.height, alpha, wrapMode);
+    _textures.push_back(texture);
+    return texture;
+}
+
+void TextureArray::setCompression(bool compressed) {
+    _compressed = compressed;
+}
+
+void TextureArray::setMipFilter(MipFilter filter) {
+    _mipFilter = filter;
+}
+
+void TextureArray::setCachePath(const std::string& path) {
+    _cachePath = path;
+}
+
+void TextureArray::upload(TextureStreamer& streamer) {
+    if (_object != 0 || _layers.empty())
+        return;
+
+    //the most compact format that keeps the channels of every layer
+    bool gray = true, alpha = false;
+    for (size_t i = 0; i < _layers.size(); ++i) {
+        Bitmap::Format format = _layers[i].format;
+        gray = gray && (format == Bitmap::Format_Grayscale || format == Bitmap::Format_GrayscaleAlpha);
+        alpha = alpha || format == Bitmap::Format_GrayscaleAlpha || format == Bitmap::Format_RGBA;
+    }
+    BlockFormat format = gray ? (alpha ? BlockFormat_BC5 : BlockFormat_BC4) : (alpha ? BlockFormat_BC3 : BlockFormat_BC1);
+    bool s3tc = format == BlockFormat_BC1 || format == BlockFormat_BC3;
+    bool compressed = _compressed && (!s3tc || GLEW_EXT_texture_compression_s3tc);
+
+    //the cached levels are valid as long as the images and the settings they were built with are the same
+    ContentHash source = hashBytes(&compressed, sizeof(compressed));
+    source = hashBytes(&_mipFilter, sizeof(_mipFilter), source);
+    for (size_t i = 0; i < _layers.size(); ++i) {
+        const Layer& layer = _layers[i];
+        unsigned description[3] = {layer.width, layer.height, (unsigned) layer.format};
+        source = hashBytes(description, sizeof(description), source);
+        if (layer.path.empty())
+            source = hashBytes(_bitmaps[layer.bitmap].pixelBuffer(), (size_t) layer.width * layer.height * layer.format, source);
+        else
+            source = HashFile(layer.path, source);
+    }
+
+    std::shared_ptr<Build> build(new Build);
+    TextureContainer& container = build->container;
+    if (_cachePath.empty() || !container.load(_cachePath, source)) {
+        container.width = _width;
+        container.height = _height;
+        container.layers = (unsigned) _layers.size();
+        container.internalFormat = compressed ? CompressedInternalFormat(format) : GL_RGBA8;
+        container.format = GL_RGBA;
+        container.type = GL_UNSIGNED_BYTE;
+        container.source = source;
+        if (compressed && (format == BlockFormat_BC4 || format == BlockFormat_BC5)) {
+            container.swizzle[0] = container.swizzle[1] = container.swizzle[2] = GL_RED;
+            container.swizzle[3] = format == BlockFormat_BC5 ? GL_GREEN : GL_ONE;
+        }
+        container.levels.resize(MipLevelCount(_width, _height));
+        for (unsigned level = 0; level < container.levels.size(); ++level)
+            container.levels[level].resize(container.levelSize(level));
+
+        build->layers.swap(_layers);
+        build->bitmaps.swap(_bitmaps);
+        build->compressed = compressed;
+        build->format = format;
+        build->mipFilter = _mipFilter;
+        build->cachePath = _cachePath;
+        build->built.reset(new std::once_flag[container.layers]);
+        build->layersLeft = container.layers;
+    }
+    _layers.clear();
+    _bitmaps.clear();
+
+    const unsigned levels = (unsigned) container.levels.size();
+    _object = container.allocate(GL_TEXTURE_2D_ARRAY);
+    _internalFormat = container.internalFormat;
+    _bytes = 0;
+    for (unsigned level = 0; level < levels; ++level)
+        _bytes += container.levelSize(level);
+    for (size_t i = 0; i < _textures.size(); ++i)
+        _textures[i]->_object = _object;
+
+    //nothing is resident yet: sample the coarsest level, which arrives first
+    _pendingRegions.assign(levels, container.layers);
+    _failedRegions = 0;
+    _baseLevel = (GLint) levels;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _object);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, (GLint) levels - 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    for (unsigned level = levels; level-- > 0; ) {
+        for (unsigned layer = 0; layer < container.layers; ++layer) {
+            TextureRegion region;
+            region.texture = _object;
+            region.target = GL_TEXTURE_2D_ARRAY;
+            region.level = (GLint) level;
+            region.layer = (GLint) layer;
+            region.width = (GLsizei) container.levelWidth(level);
+            region.height = (GLsizei) container.levelHeight(level);
+            region.compressed = container.isCompressed();
+            region.internalFormat = container.internalFormat;
+            region.format = container.format;
+            region.type = container.type;
+            region.bytes = container.layerSize(level);
+
+            streamer.enqueue(region, [build, level, layer](unsigned char* destination) {
+                if (build->built)
+                    std::call_once(build->built[layer], &Build::buildLayer, build.get(), (size_t) layer);
+                const size_t size = build->container.layerSize(level);
+                memcpy(destination, &build->container.levels[level][layer * size], size);
+            }, [this, build, level](bool uploaded) {
+                _levelResident(level, uploaded);
+                //every fill has returned once every region is in, the one that saved the cache too
+                if (_baseLevel == 0)
+                    _cacheError = build->saveError;
+            });
+        }
+    }
+}
+
+void TextureArray::_levelResident(unsigned level, bool uploaded) {
+    //a layer whose fill failed is left undefined at this level rather than holding back the others
+    if (!uploaded)
+        _failedRegions++;
+    _pendingRegions[level]--;
+    GLint base = _baseLevel;
+    while (base > 0 && _pendingRegions[base - 1] == 0)
+        base--;
+    if (base == _baseLevel)
+        return;
+    _baseLevel = base;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _object);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, _baseLevel);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GLuint TextureArray::object() const {
+    return _object;
+}
+
+size_t TextureArray::size() const {
+    return _layerCount;
+}
+
+size_t TextureArray::bytes() const {
+    return _bytes;
+}
+
+GLenum TextureArray::internalFormat() const {
+    return _internalFormat;
+}
+
+GLint TextureArray::baseLevel() const {
+    return _baseLevel;
+}
+
+const std::string& TextureArray::cacheError() const {
+    return _cacheError;
+}
+
+bool TextureArray::resident() const {
+    return _object != 0 && _baseLevel == 0 && _failedRegions == 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Bitmap.h"
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+#include "TextureContainer.h"
+#include "Texture.h"
+#include "TextureStreamer.h"
+
+namespace gk3d {
+
+    /**
+    * Packs the small textures of the scene into the layers of one GL_TEXTURE_2D_ARRAY, so
+    * every mesh samples them through a single texture unit and meshes need no texture
+    * binds between them.
+    *
+    * Images are added while models load; only their size and format are read then.
+    * `upload` creates the array once, and streams the layers into it. Every layer has
+    * the size of the largest image in each dimension: smaller images are stretched
+    * bilinearly to it, which leaves their texture coordinates unchanged. Stretching is
+    * not free: a small image takes as much memory as the largest and gains no detail
+    * for it, and an image of another aspect ratio gets texels that are no longer square.
+    * Images that differ much in size are better kept in arrays of their own.
+    * gk3d::Texture::originalWidth and originalHeight still give the image's own size.
+    * Images are decoded to RGBA before they are filtered and, optionally, compressed.
+    *
+    * The array is sampled with GL_REPEAT. Other wrap modes are applied by the scene
+    * shader from the layer's gk3d::Texture::wrapMode.
+    *
+    * The mip chain is built on the CPU by gk3d::GenerateMips, in linear light. With
+    * compression on, every level is then encoded with gk3d::CompressBlocks: BC4 if all
+    * layers are grayscale, BC5 if they are grayscale with alpha, BC3 if any has alpha and
+    * BC1 otherwise. Channels are swizzled back so the shader always reads RGBA.
+    *
+    * The built levels are saved to a gk3d::TextureContainer file, if a cache path is set,
+    * and loaded from it on later runs instead of being built again.
+    */
+    class TextureArray {
+    public:
+        TextureArray();
+        ~TextureArray();
+
+        /**
+        * Adds `bitmap` as a new layer, or reuses the layer of an identical bitmap added before.
+        * The layer is stretched to the size of the largest layer, as described above.
+        *
+        * @param wrapMode  GL_REPEAT, GL_MIRRORED_REPEAT, GL_CLAMP_TO_EDGE, or GL_CLAMP_TO_BORDER
+        *
+        * @result the texture sampling the layer, owned by the array. Its object is valid once uploaded.
+        *
+        * @throws std::exception if the array was already uploaded.
+        */
+        Texture* add(const Bitmap& bitmap, GLint wrapMode = GL_CLAMP_TO_EDGE);
+
+        /**
+        * Adds the image file at `path` as a new layer, or reuses the layer of the same file
+        * added before. The file is decoded later, on the worker threads of `upload`, and
+        * stretched to the size of the largest layer like any other.
+        *
+        * @throws std::exception if the file is not a readable image, or the array was already uploaded.
+        */
+        Texture* add(const std::string& path, GLint wrapMode = GL_CLAMP_TO_EDGE);
+
+        /**
+        * Selects block compression for `upload`. S3TC formats fall back to uncompressed
+        * layers without EXT_texture_compression_s3tc.
+        */
+        void setCompression(bool compressed);
+
+        /** Selects the kernel the mip levels are filtered with; Kaiser by default */
+        void setMipFilter(MipFilter filter);
+
+        /** Sets the file the built levels are cached in; empty to build them every time */
+        void setCachePath(const std::string& path);
+
+        /**
+        * Creates the texture array and points every layer at it, then queues every level
+        * of every layer on `streamer`, the coarsest levels first. The levels are loaded
+        * from the cache or decoded and built by the fills, on the streamer's threads.
+        *
+        * Layers are drawn from the finest level all of them have received, so the array
+        * sharpens as the streamer catches up. A layer that fails to load is left undefined
+        * at the levels it lacks; the streamer's `update` reports the error. Requires a
+        * current OpenGL context; the array must outlive the uploads queued.
+        */
+        void upload(TextureStreamer& streamer);
+
+        /** The array texture object, 0 before `upload` */
+        GLuint object() const;
+
+        /** Number of layers */
+        size_t size() const;
+
+        /** Size of all levels of all layers in bytes, once uploaded */
+        size_t bytes() const;
+
+        /** The internal format of the uploaded array, e.g. GL_RGBA8 */
+        GLenum internalFormat() const;
+
+        /** The finest level every layer has received: the GL_TEXTURE_BASE_LEVEL of the array */
+        GLint baseLevel() const;
+
+        /** true once every level of every layer was uploaded; false for good if any failed to load */
+        bool resident() const;
+
+        /** Why the built levels could not be written to the cache file; empty until then, or if they were */
+        const std::string& cacheError() const;
+
+    private:
+        /** an image added, decoded from `path` or held in `_bitmaps` */
+        struct Layer {
+            std::string path;
+            size_t bitmap;
+            unsigned width;
+            unsigned height;
+            Bitmap::Format format;
+        };
+        struct Build;
+
+        std::vector<Layer> _layers;
+        std::vector<Bitmap> _bitmaps;
+        std::vector<Texture*> _textures;
+        size_t _layerCount;
+        unsigned _width;
+        unsigned _height;
+        GLuint _object;
+        GLenum _internalFormat;
+        size_t _bytes;
+        bool _compressed;
+        MipFilter _mipFilter;
+        std::string _cachePath;
+        std::string _cacheError;
+        /** regions of each level not uploaded yet */
+        std::vector<unsigned> _pendingRegions;
+        /** regions whose fill failed; counted as received so the others still sharpen */
+        unsigned _failedRegions;
+        GLint _baseLevel;
+
+        Texture* _add(const Layer& layer, size_t index, GLint wrapMode);
+        void _levelResident(unsigned level, bool uploaded);
+
+        //copying disabled
+        TextureArray(const TextureArray&);
+        const TextureArray& operator=(const TextureArray&);
+    };
+
+}
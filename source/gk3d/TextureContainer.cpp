@@ -0,0 +1,258 @@
+#include "TextureContainer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+
+using namespace gk3d;
+
+static const char Magic[4] = {'G', 'K', 'T', 'X'};
+static const uint32_t Version = 1;
+//limits of a file taken as valid; far beyond what any driver takes
+static const uint32_t MaxSize = 1 << 16;
+static const uint32_t MaxLayers = 1 << 16;
+
+//the fixed-size part of the file, followed by a uint64_t size and the bytes of every level
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t source;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    uint32_t levels;
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t type;
+    int32_t swizzle[4];
+};
+
+//levels of a full mip chain of `width` x `height`
+static uint32_t levelCount(uint32_t width, uint32_t height) {
+    uint32_t count = 1;
+    for (uint32_t size = width > height ? width : height; size > 1; size >>= 1)
+        ++count;
+    return count;
+}
+
+TextureContainer::TextureContainer() :
+    width(0),
+    height(0),
+    layers(1),
+    internalFormat(GL_RGBA8),
+    format(GL_RGBA),
+    type(GL_UNSIGNED_BYTE),
+    source(0),
+    levels()
+{
+    swizzle[0] = GL_RED;
+    swizzle[1] = GL_GREEN;
+    swizzle[2] = GL_BLUE;
+    swizzle[3] = GL_ALPHA;
+}
+
+bool TextureContainer::isCompressed() const {
+    switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_RG_RGTC2:
+            return true;
+        default:
+            return false;
+    }
+}
+
+unsigned TextureContainer::levelWidth(unsigned level) const {
+    return width >> level > 0 ? width >> level : 1;
+}
+
+unsigned TextureContainer::levelHeight(unsigned level) const {
+    return height >> level > 0 ? height >> level : 1;
+}
+
+size_t TextureContainer::layerSize(unsigned level) const {
+    const size_t w = levelWidth(level), h = levelHeight(level);
+    switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+            return (w + 3) / 4 * ((h + 3) / 4) * 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+            return (w + 3) / 4 * ((h + 3) / 4) * 16;
+        default:
+            break;
+    }
+    size_t channels = 4;
+    switch (format) {
+        case GL_RED: channels = 1; break;
+        case GL_RG: channels = 2; break;
+        case GL_RGB: channels = 3; break;
+        default: break;
+    }
+    return w * h * channels;
+}
+
+size_t TextureContainer::levelSize(unsigned level) const {
+    return layerSize(level) * layers;
+}
+
+void TextureContainer::save(const std::string &path) const {
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.source = source;
+    header.width = width;
+    header.height = height;
+    header.layers = layers;
+    header.levels = (uint32_t) levels.size();
+    header.internalFormat = internalFormat;
+    header.format = format;
+    header.type = type;
+    for (int i = 0; i < 4; ++i)
+        header.swizzle[i] = swizzle[i];
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Failed to open texture container for writing: " + path);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < levels.size(); ++i) {
+        uint64_t size = levels[i].size();
+        ok = fwrite(&size, sizeof(size), 1, file) == 1 &&
+             (size == 0 || fwrite(&levels[i][0], (size_t) size, 1, file) == 1);
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        remove(path.c_str());
+        throw std::runtime_error("Failed to write texture container: " + path);
+    }
+}
+
+bool TextureContainer::load(const std::string &path, ContentHash source) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        fileSize = ftell(file);
+    Header header;
+    bool ok = fileSize >= 0 && fseek(file, 0, SEEK_SET) == 0 &&
+              fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+              header.version == Version &&
+              header.source == source &&
+              header.width > 0 && header.width <= MaxSize &&
+              header.height > 0 && header.height <= MaxSize &&
+              header.layers > 0 && header.layers <= MaxLayers &&
+              header.levels > 0 && header.levels <= levelCount(header.width, header.height);
+
+    //the level sizes follow from the header: check each one before allocating it
+    TextureContainer loaded;
+    if (ok) {
+        loaded.width = header.width;
+        loaded.height = header.height;
+        loaded.layers = header.layers;
+        loaded.internalFormat = header.internalFormat;
+        loaded.format = header.format;
+        loaded.type = header.type;
+        for (int i = 0; i < 4; ++i)
+            loaded.swizzle[i] = header.swizzle[i];
+        loaded.source = header.source;
+        loaded.levels.resize(header.levels);
+    }
+    uint64_t left = ok ? (uint64_t) fileSize - sizeof(header) : 0;
+    for (unsigned i = 0; ok && i < loaded.levels.size(); ++i) {
+        uint64_t size = 0;
+        ok = fread(&size, sizeof(size), 1, file) == 1 &&
+             size == loaded.levelSize(i) &&
+             left >= sizeof(size) + size;
+        if (ok) {
+            left -= sizeof(size) + size;
+            try {
+                loaded.levels[i].resize((size_t) size);
+            } catch (const std::bad_alloc&) {
+                ok = false;
+                break;
+            }
+            ok = fread(&loaded.levels[i][0], (size_t) size, 1, file) == 1;
+        }
+    }
+    fclose(file);
+    if (!ok)
+        return false;
+
+    std::swap(*this, loaded);
+    return true;
+}
+
+GLuint TextureContainer::allocate(GLenum target) const {
+    const GLsizei levelCount = (GLsizei) levels.size();
+    const bool storage = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+
+    GLuint object = 0;
+    glGenTextures(1, &object);
+    glBindTexture(target, object);
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+    if (storage) {
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glTexStorage3D(target, levelCount, internalFormat, (GLsizei) width, (GLsizei) height, (GLsizei) layers);
+        else
+            glTexStorage2D(target, levelCount, internalFormat, (GLsizei) width, (GLsizei) height);
+    } else {
+        //every level defined with undefined contents, as glTexStorage would leave them
+        GLsizei levelWidth = (GLsizei) width, levelHeight = (GLsizei) height;
+        for (GLint level = 0; level < levelCount; ++level) {
+            const GLsizei size = (GLsizei) levelSize(level);
+            if (target == GL_TEXTURE_2D_ARRAY) {
+                if (isCompressed())
+                    glCompressedTexImage3D(target, level, internalFormat, levelWidth, levelHeight, (GLsizei) layers, 0, size, NULL);
+                else
+                    glTexImage3D(target, level, internalFormat, levelWidth, levelHeight, (GLsizei) layers, 0, format, type, NULL);
+            } else {
+                if (isCompressed())
+                    glCompressedTexImage2D(target, level, internalFormat, levelWidth, levelHeight, 0, size, NULL);
+                else
+                    glTexImage2D(target, level, internalFormat, levelWidth, levelHeight, 0, format, type, NULL);
+            }
+            levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+            levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+        }
+    }
+
+    glBindTexture(target, 0);
+    return object;
+}
+
+GLuint TextureContainer::upload(GLenum target) const {
+    const GLuint object = allocate(target);
+    glBindTexture(target, object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    GLsizei levelWidth = (GLsizei) width, levelHeight = (GLsizei) height;
+    for (GLint level = 0; level < (GLint) levels.size(); ++level) {
+        const GLvoid *data = levels[level].empty() ? NULL : &levels[level][0];
+        const GLsizei size = (GLsizei) levels[level].size();
+        if (target == GL_TEXTURE_2D_ARRAY) {
+            if (isCompressed())
+                glCompressedTexSubImage3D(target, level, 0, 0, 0, levelWidth, levelHeight, (GLsizei) layers, internalFormat, size, data);
+            else
+                glTexSubImage3D(target, level, 0, 0, 0, levelWidth, levelHeight, (GLsizei) layers, format, type, data);
+        } else {
+            if (isCompressed())
+                glCompressedTexSubImage2D(target, level, 0, 0, levelWidth, levelHeight, internalFormat, size, data);
+            else
+                glTexSubImage2D(target, level, 0, 0, levelWidth, levelHeight, format, type, data);
+        }
+        levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+        levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(target, 0);
+    return object;
+}
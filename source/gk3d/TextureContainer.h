@@ -0,0 +1,83 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include "Hash.h"
+
+namespace gk3d {
+
+    /**
+    * Every mip level of a texture or texture array, ready to upload, and the file format
+    * they are cached in between runs.
+    *
+    * The file starts with the magic "GKTX", a version and the hash of the source images
+    * and build settings the levels were made from, followed by the size, format and
+    * swizzle of the texture and the bytes of each level. A file whose hash differs from
+    * the caller's is stale and is ignored.
+    */
+    struct TextureContainer {
+        unsigned width;
+        unsigned height;
+        /** 1 for a 2D texture */
+        unsigned layers;
+        /** sized or compressed internal format, e.g. GL_RGBA8 or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT */
+        GLenum internalFormat;
+        /** format and type of uncompressed levels, as glTexSubImage takes them */
+        GLenum format;
+        GLenum type;
+        /** GL_TEXTURE_SWIZZLE_RGBA of the texture */
+        GLint swizzle[4];
+        /** hash of everything the levels were built from */
+        ContentHash source;
+        /** level 0 first; every layer of a level, one after another */
+        std::vector<std::vector<unsigned char> > levels;
+
+        TextureContainer();
+
+        /** true if the levels are block compressed */
+        bool isCompressed() const;
+
+        /** Width and height of `level`: halved per level, rounded down, at least 1 */
+        unsigned levelWidth(unsigned level) const;
+        unsigned levelHeight(unsigned level) const;
+
+        /** Bytes of one layer of `level`, from the size and format; levels of 8-bit channels only */
+        size_t layerSize(unsigned level) const;
+
+        /** Bytes of `level` with all its layers */
+        size_t levelSize(unsigned level) const;
+
+        /**
+        * Writes the container to `path`.
+        *
+        * @throws std::exception if the file can not be written.
+        */
+        void save(const std::string &path) const;
+
+        /**
+        * Reads the container at `path` if it exists and was built from `source`.
+        *
+        * @result false if the file is missing, damaged or stale
+        */
+        bool load(const std::string &path, ContentHash source);
+
+        /**
+        * Creates a texture of `target` (GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY) with room for
+        * every level, with immutable storage where the driver has it, but none of their data.
+        * `levels` only gives the number of levels.
+        *
+        * @result the texture object, left unbound
+        */
+        GLuint allocate(GLenum target) const;
+
+        /**
+        * Creates a texture as `allocate` does and uploads every level into it. No mipmaps
+        * are generated.
+        *
+        * @result the texture object, left unbound
+        */
+        GLuint upload(GLenum target) const;
+    };
+
+}
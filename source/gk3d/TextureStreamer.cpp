@@ -0,0 +1,308 @@
+#include "TextureStreamer.h"
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace gk3d;
+
+//spans of the ring start at multiples of this, aligned for texel rows and blocks
+static const size_t SpanAlignment = 16;
+
+//longest `finish` waits on one fence before checking again, in nanoseconds
+static const GLuint64 FenceTimeout = 1000000000ull;
+
+TextureRegion::TextureRegion() :
+    texture(0),
+    target(GL_TEXTURE_2D),
+    level(0),
+    layer(0),
+    width(0),
+    height(0),
+    compressed(false),
+    internalFormat(GL_RGBA8),
+    format(GL_RGBA),
+    type(GL_UNSIGNED_BYTE),
+    bytes(0)
+{
+}
+
+struct TextureStreamer::Job {
+    TextureRegion region;
+    Fill fill;
+    Resident resident;
+    /** the span of the ring the region is staged in */
+    size_t offset;
+    size_t span;
+    /** where the fill writes: the mapped ring, or `staging` */
+    unsigned char* destination;
+    std::vector<unsigned char> staging;
+    /** set by the worker, under the streamer's mutex */
+    bool filled;
+    std::exception_ptr error;
+    /** signalled once the GPU has read the span; 0 until uploaded */
+    GLsync fence;
+};
+
+TextureStreamer::TextureStreamer(size_t ringBytes, size_t frameBudget, unsigned threadCount) :
+    _buffer(0),
+    _mapped(NULL),
+    _capacity(ringBytes),
+    _head(0),
+    _frameBudget(frameBudget),
+    _queued(),
+    _staged(),
+    _cancelled(false),
+    _pool(threadCount)
+{
+    _stats.bytes = 0;
+    _stats.uploads = 0;
+    _stats.pending = 0;
+
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        //mapped once; coherent, so texels written by the workers need no flush before the upload
+        const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) _capacity, NULL, access | GL_DYNAMIC_STORAGE_BIT);
+        _mapped = (unsigned char*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) _capacity, access);
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) _capacity, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStreamer::~TextureStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cancelled = true;
+    }
+    _pool.wait();
+
+    for (size_t i = 0; i < _staged.size(); ++i) {
+        if (_staged[i]->fence)
+            glDeleteSync(_staged[i]->fence);
+        delete _staged[i];
+    }
+    for (size_t i = 0; i < _queued.size(); ++i)
+        delete _queued[i];
+
+    if (_mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &_buffer);
+}
+
+void TextureStreamer::enqueue(const TextureRegion& region, const Fill& fill, const Resident& resident) {
+    size_t span = (region.bytes + SpanAlignment - 1) / SpanAlignment * SpanAlignment;
+    if (span == 0)
+        span = SpanAlignment;
+    if (span > _capacity)
+        throw std::runtime_error("Texture region is larger than the upload ring");
+
+    Job* job = new Job;
+    job->region = region;
+    job->fill = fill;
+    job->resident = resident;
+    job->offset = 0;
+    job->span = span;
+    job->destination = NULL;
+    job->filled = false;
+    job->fence = 0;
+    _queued.push_back(job);
+    _dispatch();
+}
+
+void TextureStreamer::update() {
+    _stats.bytes = 0;
+    _stats.uploads = 0;
+    _retire();
+    _upload(_frameBudget);
+    _dispatch();
+
+    _stats.pending = (unsigned) _queued.size();
+    for (size_t i = 0; i < _staged.size(); ++i) {
+        if (!_staged[i]->fence)
+            _stats.pending++;
+    }
+}
+
+void TextureStreamer::finish() {
+    _stats.bytes = 0;
+    _stats.uploads = 0;
+    while (!idle()) {
+        _retire();
+        _upload(std::numeric_limits<size_t>::max());
+        _dispatch();
+
+        //wait for the oldest region still being filled, or else for the GPU to release the oldest span
+        Job* unfilled = NULL;
+        for (size_t i = 0; i < _staged.size() && !unfilled; ++i) {
+            if (!_staged[i]->fence)
+                unfilled = _staged[i];
+        }
+        if (unfilled) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _filled.wait(lock, [unfilled]() { return unfilled->filled; });
+        } else if (!_staged.empty()) {
+            glClientWaitSync(_staged.front()->fence, GL_SYNC_FLUSH_COMMANDS_BIT, FenceTimeout);
+        }
+    }
+    _stats.pending = 0;
+}
+
+bool TextureStreamer::idle() const {
+    return _queued.empty() && _staged.empty();
+}
+
+bool TextureStreamer::persistent() const {
+    return _mapped != NULL;
+}
+
+const TextureStreamer::Stats& TextureStreamer::stats() const {
+    return _stats;
+}
+
+bool TextureStreamer::_allocate(size_t size, size_t& offset) {
+    if (_staged.empty()) {
+        _head = 0;
+        offset = 0;
+    } else {
+        //spans never end on the oldest one: a full ring would look empty
+        const size_t tail = _staged.front()->offset;
+        if (_head > tail && _head + size <= _capacity)
+            offset = _head;
+        else if (_head > tail && size < tail)
+            offset = 0;
+        else if (_head < tail && _head + size < tail)
+            offset = _head;
+        else
+            return false;
+    }
+    _head = offset + size;
+    return true;
+}
+
+void TextureStreamer::_dispatch() {
+    while (!_queued.empty()) {
+        Job* job = _queued.front();
+        if (!_allocate(job->span, job->offset))
+            break;
+        _queued.pop_front();
+        _staged.push_back(job);
+
+        if (_mapped) {
+            job->destination = _mapped + job->offset;
+        } else {
+            job->staging.resize(job->region.bytes);
+            job->destination = job->staging.empty() ? NULL : &job->staging[0];
+        }
+
+        _pool.run([this, job]() {
+            bool cancelled;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                cancelled = _cancelled;
+            }
+            std::exception_ptr error;
+            try {
+                if (!cancelled)
+                    job->fill(job->destination);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            job->error = error;
+            job->filled = true;
+            _filled.notify_all();
+        });
+    }
+}
+
+void TextureStreamer::_upload(size_t budget) {
+    bool bound = false;
+    std::exception_ptr error;
+    for (size_t i = 0; i < _staged.size() && !error; ++i) {
+        Job* job = _staged[i];
+        if (job->fence)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!job->filled)
+                continue;
+        }
+        if (job->error) {
+            //the span is released like any other; the error is reported once
+            error = job->error;
+            job->error = std::exception_ptr();
+            job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            if (job->resident)
+                job->resident(false);
+            break;
+        }
+
+        const TextureRegion& region = job->region;
+        if (_stats.bytes > 0 && _stats.bytes + region.bytes > budget)
+            break;
+
+        if (!bound) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            bound = true;
+        }
+        if (!job->staging.empty()) {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, (GLintptr) job->offset, (GLsizeiptr) job->staging.size(), &job->staging[0]);
+            std::vector<unsigned char>().swap(job->staging);
+        }
+
+        //with an unpack buffer bound, the data pointer is an offset into it
+        const GLvoid* data = reinterpret_cast<const GLvoid*>(job->offset);
+        const GLsizei size = (GLsizei) region.bytes;
+        glBindTexture(region.target, region.texture);
+        if (region.target == GL_TEXTURE_2D_ARRAY) {
+            if (region.compressed)
+                glCompressedTexSubImage3D(region.target, region.level, 0, 0, region.layer, region.width, region.height, 1,
+                                          region.internalFormat, size, data);
+            else
+                glTexSubImage3D(region.target, region.level, 0, 0, region.layer, region.width, region.height, 1,
+                                region.format, region.type, data);
+        } else {
+            if (region.compressed)
+                glCompressedTexSubImage2D(region.target, region.level, 0, 0, region.width, region.height,
+                                          region.internalFormat, size, data);
+            else
+                glTexSubImage2D(region.target, region.level, 0, 0, region.width, region.height,
+                                region.format, region.type, data);
+        }
+        glBindTexture(region.target, 0);
+        job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        _stats.bytes += region.bytes;
+        _stats.uploads++;
+        if (job->resident)
+            job->resident(true);
+    }
+
+    if (bound) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void TextureStreamer::_retire() {
+    while (!_staged.empty()) {
+        Job* job = _staged.front();
+        if (!job->fence)
+            break;
+        GLenum status = glClientWaitSync(job->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(job->fence);
+        _staged.pop_front();
+        delete job;
+    }
+}
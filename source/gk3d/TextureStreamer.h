@@ -0,0 +1,139 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include "ThreadPool.h"
+
+namespace gk3d {
+
+    /**
+    * One layer of one mip level of a texture, as glTexSubImage* or glCompressedTexSubImage* take it.
+    */
+    struct TextureRegion {
+        GLuint texture;
+        /** GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY */
+        GLenum target;
+        GLint level;
+        /** layer of an array texture; ignored for GL_TEXTURE_2D */
+        GLint layer;
+        GLsizei width;
+        GLsizei height;
+        /** true for block-compressed data, uploaded as `internalFormat` */
+        bool compressed;
+        GLenum internalFormat;
+        /** format and type of uncompressed data */
+        GLenum format;
+        GLenum type;
+        /** size of the data in bytes, rows packed with no padding */
+        size_t bytes;
+
+        TextureRegion();
+    };
+
+    /**
+    * Uploads texture data without stalling the thread that renders.
+    *
+    * Data is staged in a ring of pixel unpack buffer memory. Each queued region gets the next
+    * free span of the ring and its `Fill` runs on a worker thread, writing the texels
+    * straight into that span. Once filled, `update` copies the region into its texture with
+    * glTexSubImage* sourced from the buffer, so the driver reads it asynchronously, and
+    * fences the span; it is reused once the fence has signalled. Every call of `update`
+    * uploads at most `frameBudget` bytes, so regions become resident over several frames.
+    *
+    * With GL 4.4 or ARB_buffer_storage the ring is one buffer mapped persistently and
+    * coherently for the life of the streamer. Without it, fills write into memory of their
+    * own, which `update` copies into the ring with glBufferSubData.
+    *
+    * Regions are staged and uploaded in the order they were queued, as far as their fills
+    * finish in that order.
+    */
+    class TextureStreamer {
+    public:
+        /** Writes the `bytes` of a region to `destination`. Runs on a worker thread; may throw. */
+        typedef std::function<void(unsigned char* destination)> Fill;
+
+        /**
+        * Called on the GL thread once the upload of a region was issued, with true, or once its
+        * fill failed, with false: the region then stays as it was.
+        */
+        typedef std::function<void(bool uploaded)> Resident;
+
+        /** Work done by the last `update` */
+        struct Stats {
+            size_t bytes;
+            unsigned uploads;
+            /** regions queued but not uploaded yet */
+            unsigned pending;
+        };
+
+        /**
+        * Creates the ring buffer and the worker threads. Requires a current OpenGL context.
+        *
+        * @param ringBytes    size of the ring; no region can be larger
+        * @param frameBudget  bytes uploaded by one `update`; a larger region still goes alone
+        * @param threadCount  worker threads running fills; 0 uses every hardware thread
+        */
+        TextureStreamer(size_t ringBytes = 8 << 20, size_t frameBudget = 1 << 20, unsigned threadCount = 0);
+
+        /** Waits for the fills running, skipping those not started, and frees the ring */
+        ~TextureStreamer();
+
+        /**
+        * Queues the upload of `region`, starting its fill as soon as the ring has room.
+        *
+        * @throws std::exception if the region is larger than the ring.
+        */
+        void enqueue(const TextureRegion& region, const Fill& fill, const Resident& resident = Resident());
+
+        /**
+        * Uploads filled regions up to the frame budget, recycles ring space the GPU is done
+        * with and starts fills for the regions it makes room for. Call once per frame.
+        *
+        * @throws std::exception if a fill failed, after calling the region's `Resident` with false.
+        */
+        void update();
+
+        /** Uploads everything queued, waiting for fills and the GPU, regardless of the budget */
+        void finish();
+
+        /** true if every region queued was uploaded and its ring space recycled */
+        bool idle() const;
+
+        /** true if the ring is mapped persistently */
+        bool persistent() const;
+
+        const Stats& stats() const;
+
+    private:
+        struct Job;
+
+        GLuint _buffer;
+        unsigned char* _mapped;
+        size_t _capacity;
+        size_t _head;
+        size_t _frameBudget;
+        /** regions waiting for ring space */
+        std::deque<Job*> _queued;
+        /** regions holding ring space, oldest first */
+        std::deque<Job*> _staged;
+        std::mutex _mutex;
+        std::condition_variable _filled;
+        bool _cancelled;
+        Stats _stats;
+        ThreadPool _pool;
+
+        bool _allocate(size_t size, size_t& offset);
+        void _dispatch();
+        void _upload(size_t budget);
+        void _retire();
+
+        //copying disabled
+        TextureStreamer(const TextureStreamer&);
+        const TextureStreamer& operator=(const TextureStreamer&);
+    };
+
+}
@@ -0,0 +1,62 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace gk3d;
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+    _threads(),
+    _tasks(),
+    _busy(0),
+    _stopping(false)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned i = 0; i < threadCount; ++i)
+        _threads.push_back(std::thread(&ThreadPool::_work, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (size_t i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+}
+
+void ThreadPool::run(const Task& task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(task);
+    }
+    _wake.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this]() { return _tasks.empty() && _busy == 0; });
+}
+
+unsigned ThreadPool::size() const {
+    return (unsigned) _threads.size();
+}
+
+void ThreadPool::_work() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _wake.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+        if (_tasks.empty())
+            return; //stopping, with nothing left to run
+
+        Task task = _tasks.front();
+        _tasks.pop_front();
+        _busy++;
+        lock.unlock();
+        task();
+        lock.lock();
+        _busy--;
+        if (_tasks.empty() && _busy == 0)
+            _idle.notify_all();
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gk3d {
+
+    /**
+    * A fixed set of worker threads taking tasks off one queue, in the order they were queued.
+    *
+    * Tasks must not throw: anything they can fail with is theirs to catch and report.
+    */
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        /** @param threadCount  0 uses every hardware thread */
+        explicit ThreadPool(unsigned threadCount = 0);
+
+        /** Finishes the tasks still queued, then joins the threads */
+        ~ThreadPool();
+
+        /** Queues `task` to run on the first free thread */
+        void run(const Task& task);
+
+        /** Blocks until every task queued so far has finished */
+        void wait();
+
+        /** Number of worker threads */
+        unsigned size() const;
+
+    private:
+        std::vector<std::thread> _threads;
+        std::deque<Task> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _idle;
+        unsigned _busy;
+        bool _stopping;
+
+        void _work();
+
+        //copying disabled
+        ThreadPool(const ThreadPool&);
+        const ThreadPool& operator=(const ThreadPool&);
+    };
+
+}
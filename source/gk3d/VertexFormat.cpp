@@ -0,0 +1,212 @@
+#include "VertexFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+using namespace gk3d;
+
+static uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7fffffff;
+
+    //NaN stays NaN, and whatever is too large for a half becomes infinity
+    if (magnitude > 0x7f800000)
+        return (uint16_t) (sign | 0x7e00);
+    if (magnitude >= 0x477ff000)
+        return (uint16_t) (sign | 0x7c00);
+
+    //below the smallest normal half the mantissa is shifted down, rounding to nearest even
+    if (magnitude < 0x38800000) {
+        if (magnitude < 0x33000000)
+            return sign;
+        const uint32_t mantissa = (magnitude & 0x007fffff) | 0x00800000;
+        const unsigned shift = 126 - (magnitude >> 23);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return (uint16_t) (sign | half);
+    }
+
+    //rebias the exponent and round the mantissa to nearest even; a carry moves into the exponent
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    const uint32_t rest = magnitude & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return (uint16_t) (sign | half);
+}
+
+static float SignNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static int16_t ToSnorm16(float value) {
+    value = std::max(-1.0f, std::min(1.0f, value));
+    return (int16_t) std::floor(value * 32767.0f + 0.5f);
+}
+
+static uint32_t ToSnorm10(float value) {
+    value = std::max(-1.0f, std::min(1.0f, value));
+    return (uint32_t) (int32_t) std::floor(value * 511.0f + 0.5f) & 0x3ff;
+}
+
+VertexFormat::VertexFormat() :
+    position(PositionFormat_Unorm16),
+    normal(NormalFormat_Int2_10_10_10),
+    texCoord(TexCoordFormat_Half)
+{
+}
+
+VertexFormat::VertexFormat(PositionFormat position, NormalFormat normal, TexCoordFormat texCoord) :
+    position(position),
+    normal(normal),
+    texCoord(texCoord)
+{
+}
+
+//byte offsets of the attributes within a vertex
+static GLsizei NormalSize(NormalFormat normal) {
+    return normal == NormalFormat_Float ? 3 * sizeof(GLfloat) : 4;
+}
+
+static GLsizei NormalOffset(PositionFormat position) {
+    //quantised positions keep the material in their fourth short, which aligns the normal
+    return position == PositionFormat_Float ? 3 * sizeof(GLfloat) : 4 * sizeof(GLushort);
+}
+
+static GLsizei MaterialOffset(PositionFormat position, NormalFormat normal) {
+    return position == PositionFormat_Float ? NormalOffset(position) + NormalSize(normal) : 3 * sizeof(GLushort);
+}
+
+GLsizei VertexFormat::stride() const {
+    GLsizei size = NormalOffset(position) + NormalSize(normal);
+    if (position == PositionFormat_Float)
+        size += sizeof(GLuint);
+    return size;
+}
+
+GLsizei VertexFormat::texCoordSize() const {
+    return texCoord == TexCoordFormat_Float ? 2 * sizeof(GLfloat) : 2 * sizeof(GLushort);
+}
+
+void VertexFormat::encode(const GLfloat *vertices, size_t count, const Bounds &bounds, const GLuint *materials,
+                          unsigned char *output) const {
+    const GLsizei vertexSize = stride();
+    const GLsizei normalOffset = NormalOffset(position);
+    const GLsizei materialOffset = MaterialOffset(position, normal);
+
+    //axes along which the box is flat quantise to 0
+    glm::vec3 inverseSize(0.0f);
+    if (position == PositionFormat_Unorm16) {
+        const glm::vec3 size = bounds.max - bounds.min;
+        for (int axis = 0; axis < 3; ++axis)
+            inverseSize[axis] = size[axis] > 0.0f ? 65535.0f / size[axis] : 0.0f;
+    }
+
+    memset(output, 0, vertexSize * count);
+    for (size_t i = 0; i < count; ++i) {
+        const GLfloat *vertex = vertices + i * 6;
+        unsigned char *out = output + i * vertexSize;
+
+        if (position == PositionFormat_Float) {
+            memcpy(out, vertex, 3 * sizeof(GLfloat));
+        } else {
+            GLushort quantised[3];
+            for (int axis = 0; axis < 3; ++axis) {
+                float q = std::floor((vertex[axis] - bounds.min[axis]) * inverseSize[axis] + 0.5f);
+                quantised[axis] = (GLushort) std::max(0.0f, std::min(65535.0f, q));
+            }
+            memcpy(out, quantised, sizeof(quantised));
+        }
+
+        const glm::vec3 n(vertex[3], vertex[4], vertex[5]);
+        if (normal == NormalFormat_Float) {
+            memcpy(out + normalOffset, vertex + 3, 3 * sizeof(GLfloat));
+        } else if (normal == NormalFormat_Int2_10_10_10) {
+            const uint32_t packed = ToSnorm10(n.x) | (ToSnorm10(n.y) << 10) | (ToSnorm10(n.z) << 20);
+            memcpy(out + normalOffset, &packed, sizeof(packed));
+        } else {
+            //project onto the octahedron, folding the lower half over the upper one
+            const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+            float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+            float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+            if (n.z < 0.0f) {
+                const float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+                y = (1.0f - std::fabs(x)) * SignNotZero(y);
+                x = foldedX;
+            }
+            const int16_t encoded[2] = {ToSnorm16(x), ToSnorm16(y)};
+            memcpy(out + normalOffset, encoded, sizeof(encoded));
+        }
+
+        if (materials) {
+            if (position == PositionFormat_Float) {
+                memcpy(out + materialOffset, &materials[i], sizeof(GLuint));
+            } else {
+                const GLushort material = (GLushort) materials[i];
+                memcpy(out + materialOffset, &material, sizeof(material));
+            }
+        }
+    }
+}
+
+void VertexFormat::encodeTexCoords(const GLfloat *texCoords, size_t count, unsigned char *output) const {
+    if (texCoord == TexCoordFormat_Float) {
+        memcpy(output, texCoords, 2 * sizeof(GLfloat) * count);
+        return;
+    }
+    for (size_t i = 0; i < 2 * count; ++i) {
+        const uint16_t half = FloatToHalf(texCoords[i]);
+        memcpy(output + i * sizeof(half), &half, sizeof(half));
+    }
+}
+
+void VertexFormat::dequantization(const Bounds &bounds, glm::vec3 &scale, glm::vec3 &offset) const {
+    if (position == PositionFormat_Float || bounds.isEmpty()) {
+        scale = glm::vec3(1.0f);
+        offset = glm::vec3(0.0f);
+        return;
+    }
+    //normalised shorts reach the shader in [0, 1]
+    scale = bounds.max - bounds.min;
+    offset = bounds.min;
+}
+
+void VertexFormat::setupAttributes(const Program &program, bool perVertexMaterial) const {
+    const GLsizei vertexSize = stride();
+    const GLsizei normalOffset = NormalOffset(position);
+
+    glEnableVertexAttribArray(program.attrib("vert"));
+    if (position == PositionFormat_Float)
+        glVertexAttribPointer(program.attrib("vert"), 3, GL_FLOAT, GL_FALSE, vertexSize, NULL);
+    else
+        glVertexAttribPointer(program.attrib("vert"), 3, GL_UNSIGNED_SHORT, GL_TRUE, vertexSize, NULL);
+
+    glEnableVertexAttribArray(program.attrib("vertNormal"));
+    if (normal == NormalFormat_Float)
+        glVertexAttribPointer(program.attrib("vertNormal"), 3, GL_FLOAT, GL_FALSE, vertexSize, (const GLvoid *) (size_t) normalOffset);
+    else if (normal == NormalFormat_Int2_10_10_10)
+        glVertexAttribPointer(program.attrib("vertNormal"), 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexSize, (const GLvoid *) (size_t) normalOffset);
+    else
+        glVertexAttribPointer(program.attrib("vertNormal"), 2, GL_SHORT, GL_TRUE, vertexSize, (const GLvoid *) (size_t) normalOffset);
+
+    if (perVertexMaterial) {
+        const GLint location = program.attrib("vertMaterial");
+        const GLvoid *materialOffset = (const GLvoid *) (size_t) MaterialOffset(position, normal);
+        glEnableVertexAttribArray(location);
+        glVertexAttribIPointer(location, 1, position == PositionFormat_Float ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT,
+                               vertexSize, materialOffset);
+    }
+}
+
+void VertexFormat::setupTexCoordAttribute(const Program &program) const {
+    glEnableVertexAttribArray(program.attrib("vertTexCoord"));
+    if (texCoord == TexCoordFormat_Float)
+        glVertexAttribPointer(program.attrib("vertTexCoord"), 2, GL_FLOAT, GL_FALSE, texCoordSize(), NULL);
+    else
+        glVertexAttribPointer(program.attrib("vertTexCoord"), 2, GL_HALF_FLOAT, GL_FALSE, texCoordSize(), NULL);
+}
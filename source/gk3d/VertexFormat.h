@@ -0,0 +1,89 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "Bounds.h"
+#include "Program.h"
+
+namespace gk3d {
+
+    enum PositionFormat {
+        /** 3 floats, 12 bytes */
+        PositionFormat_Float,
+        /** 3 unsigned shorts normalised within the mesh's bounding box, 6 bytes */
+        PositionFormat_Unorm16
+    };
+
+    enum NormalFormat {
+        /** 3 floats, 12 bytes */
+        NormalFormat_Float,
+        /** GL_INT_2_10_10_10_REV, normalised, 4 bytes */
+        NormalFormat_Int2_10_10_10,
+        /** the octahedral map of the unit sphere onto a square, 2 normalised shorts, 4 bytes */
+        NormalFormat_Octahedral16
+    };
+
+    enum TexCoordFormat {
+        /** 2 floats, 8 bytes */
+        TexCoordFormat_Float,
+        /** 2 half floats, 4 bytes */
+        TexCoordFormat_Half
+    };
+
+    /**
+    * How the vertices of a mesh are stored in its buffers.
+    *
+    * Positions and normals are interleaved, with room for a material index per vertex:
+    * after the normal for float positions, or in the fourth short of quantised ones.
+    * Texture coordinates live in a buffer of their own.
+    *
+    * `setupAttributes` points the scene shader's attributes at the data with the matching
+    * types; the shader scales quantised positions back by the `positionScale` and
+    * `positionOffset` uniforms, and decodes octahedral normals if `octahedralNormals` is 1.
+    */
+    struct VertexFormat {
+        PositionFormat position;
+        NormalFormat normal;
+        TexCoordFormat texCoord;
+
+        /** Quantised positions, 2_10_10_10 normals and half float texture coordinates: 12 + 4 bytes */
+        VertexFormat();
+
+        VertexFormat(PositionFormat position, NormalFormat normal, TexCoordFormat texCoord);
+
+        /** Bytes from one position + normal vertex to the next */
+        GLsizei stride() const;
+
+        /** Bytes of one pair of texture coordinates */
+        GLsizei texCoordSize() const;
+
+        /**
+        * Writes `count` position + normal vertices (6 floats each), `stride()` bytes apart.
+        *
+        * @param bounds     box the positions are quantised within; it must hold all of them
+        * @param materials  index in the gk3d::MaterialTable of every vertex, or NULL for none
+        */
+        void encode(const GLfloat *vertices, size_t count, const Bounds &bounds, const GLuint *materials,
+                    unsigned char *output) const;
+
+        /** Writes `count` pairs of texture coordinates, `texCoordSize()` bytes each */
+        void encodeTexCoords(const GLfloat *texCoords, size_t count, unsigned char *output) const;
+
+        /**
+        * Scale and offset the shader turns stored positions back into the mesh's with:
+        * `positionOffset + vert * positionScale`. Float positions are kept as they are.
+        */
+        void dequantization(const Bounds &bounds, glm::vec3 &scale, glm::vec3 &offset) const;
+
+        /**
+        * Points `vert`, `vertNormal` and, if `perVertexMaterial`, `vertMaterial` of `program`
+        * at the buffer bound to GL_ARRAY_BUFFER, in the bound VAO.
+        */
+        void setupAttributes(const Program &program, bool perVertexMaterial) const;
+
+        /** Points `vertTexCoord` of `program` at the buffer bound to GL_ARRAY_BUFFER, in the bound VAO */
+        void setupTexCoordAttribute(const Program &program) const;
+    };
+
+}
@@ -18,6 +18,7 @@
  */
 
 #include "Helper.h"
+#include "Benchmark.h"
 
 // third-party libraries
 #include <GL/glew.h>
@@ -35,35 +36,291 @@
 #include "gk3d/Texture.h"
 #include "gk3d/Camera.h"
 #include "gk3d/Model.h"
+#include "gk3d/FrameState.h"
+#include "gk3d/RenderQueue.h"
+#include "gk3d/Frustum.h"
+#include "gk3d/OcclusionCuller.h"
+#include "gk3d/TextureStreamer.h"
 // constants
 const glm::vec2 SCREEN_SIZE(800, 600);
+// texture coordinates of the cube faces, by the textures laid on them
+static GLfloat CUBE_UV[] = {
+        // U     V
+        // bottom
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+        1.0f, 1.0f,
+        0.0f, 1.0f,
+
+        // top
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+
+        // front
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        1.0f, 1.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+
+        // back
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+
+        // left
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+        1.0f, 0.0f,
+
+        // right
+        1.0f, 1.0f,
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        1.0f, 1.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f
+};
+
+static GLfloat LOGO_UV[] = {
+        // U     V
+        // bottom
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // top
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // front
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        1.0f, 1.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+
+        // back
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+
+        // left
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // right
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f
+};
+
+static GLfloat COURT_UV[] = {
+        // U     V
+        // bottom
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // top
+        0.0f, 0.0f,
+        0.0f, 10.0f,
+        10.0f, 0.0f,
+        10.0f, 0.0f,
+        0.0f, 10.0f,
+        10.0f, 10.0f,
+
+        // front
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // back
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // left
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+
+        // right
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 0.0f
+};
 // globals
 //gk3d::ModelAsset gCuboid;
 gk3d::ModelAsset gHall , gCourt, gNet, gCuboid, gBall, gSpot, gBench;
 std::list<gk3d::ModelInstance*> gInstances;
 gk3d::Camera gCamera;
 gk3d::RenderParams renderParams;
-gk3d::Fog *gFog;
+gk3d::FrameState *gFrameState;
+gk3d::OcclusionCuller *gOcclusion;
+gk3d::TextureStreamer *gTextureStreamer;
+double gStreamStart = 0.0;
+gk3d::RenderQueue gRenderQueue;
+std::vector<glm::vec4> gInstanceSpheres;
+std::vector<unsigned char> gInstanceVisible;
+float gViewportHeight = SCREEN_SIZE.y;
 float secondsElapsedAfterLastPress =0.0f;
 
+// CPU time spent submitting draws and the GL calls issued, accumulated between two reports
+struct SubmitTimings {
+    double seconds;
+    unsigned draws;
+    unsigned ranges;
+    unsigned instances;
+    unsigned programSwitches;
+    unsigned textureBinds;
+    unsigned samplerBinds;
+    unsigned vaoBinds;
+    unsigned instancesCulled;
+    unsigned meshesCulled;
+    unsigned meshesDrawn;
+    unsigned occlusionQueries;
+    unsigned instancesOccluded;
+    unsigned conditionalDraws;
+    unsigned coarseInstances;
+    size_t streamedBytes;
+    unsigned streamedRegions;
+    unsigned frames;
+    double lastReport;
+} gTimings = {0.0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0.0};
+const double TIMINGS_REPORT_INTERVAL = 5.0;
+
 static void LoadAssets() {
     char const *vertexShaderFile = "scene.v.shader";
     char const *fragmentShaderFile = "scene.f.shader";
+    double loadStart = glfwGetTime();
+
+    // the models are imported on worker threads while the GL thread builds everything else;
+    // after the first run, they are mapped in from binary files written next to them instead
+    gk3d::ModelAsset::Assets().setModelCache(".gkmesh");
+    gk3d::AssetLoader loader(gk3d::ModelAsset::Assets());
+    gSpot.init(loader, "spotlight.obj", vertexShaderFile, fragmentShaderFile);
+    gBall.init(loader, "Volleyball.obj", vertexShaderFile, fragmentShaderFile);
+    gBench.init(loader, "bench.obj", vertexShaderFile, fragmentShaderFile);
+
     gHall.init_cube_inward(vertexShaderFile, fragmentShaderFile);
     gHall.add_texture("stone.png", CUBE_UV, sizeof(CUBE_UV));
 
     gCourt.init(vertexShaderFile, fragmentShaderFile);
     gCourt.add_texture("court_mat.png", CUBE_UV, sizeof(CUBE_UV));
-    gCourt.add_texture("parquet.jpg", COURT_UV, sizeof(COURT_UV),0, GL_LINEAR, GL_REPEAT);
+    gCourt.add_texture("parquet.jpg", COURT_UV, sizeof(COURT_UV),0, GL_REPEAT);
     gCourt.add_texture("olympic.png", CUBE_UV, sizeof(CUBE_UV));
 
     gNet.init(vertexShaderFile, fragmentShaderFile);
-    gNet.add_texture("olympic.png", LOGO_UV, sizeof(LOGO_UV),0,GL_LINEAR, GL_CLAMP_TO_BORDER);
+    gNet.add_texture("olympic.png", LOGO_UV, sizeof(LOGO_UV),0, GL_CLAMP_TO_BORDER);
 
     gCuboid.init(vertexShaderFile, fragmentShaderFile,glm::vec4(1.0f,1.0f,1.0f,1.0f));
-    gSpot.init("spotlight.obj",vertexShaderFile,fragmentShaderFile);
-    gBall.init("Volleyball.obj",vertexShaderFile,fragmentShaderFile);
-    gBench.init("bench.obj",vertexShaderFile,fragmentShaderFile);
+
+    // the texture layers are decoded and built on worker threads too, and stream in over the first frames
+    gk3d::TextureArray& textures = gk3d::ModelAsset::Textures();
+    gStreamStart = loadStart;
+    double queueStart = glfwGetTime();
+    textures.setCompression(true);
+    textures.setCachePath(gk3d::ModelAsset::ResourcePath("textures.gktx"));
+    textures.upload(*gTextureStreamer);
+    double queueSeconds = glfwGetTime() - queueStart;
+    double issueSeconds = glfwGetTime() - loadStart;
+
+    // the meshes of each model are created as soon as it is imported
+    double waitStart = glfwGetTime();
+    loader.finish();
+    double waitSeconds = glfwGetTime() - waitStart - loader.completionSeconds();
+
+    size_t meshes = gHall.meshes.size() + gCourt.meshes.size() + gNet.meshes.size() + gCuboid.meshes.size()
+                    + gSpot.meshes.size() + gBall.meshes.size() + gBench.meshes.size();
+    std::cout << "Shader programs: " << gk3d::ModelAsset::Programs().linkCount() << " linked for "
+              << meshes << " meshes" << std::endl;
+
+    // the imported models share one vertex and index buffer, created now that all of them are loaded
+    double uploadStart = glfwGetTime();
+    gk3d::GeometryPool& geometry = gk3d::ModelAsset::Geometry();
+    geometry.upload(gk3d::ModelAsset::Format());
+    gk3d::ModelAsset::Materials().upload();
+    double uploadSeconds = glfwGetTime() - uploadStart;
+    std::cout << "Geometry pool: " << geometry.vertexBytes() << " vertex bytes (" << gk3d::ModelAsset::Format().stride()
+              << " per vertex), " << geometry.indexBytes()
+              << " index bytes; " << gk3d::ModelAsset::Materials().size() << " materials; "
+              << textures.size() << " texture layers, " << textures.bytes() << " bytes with mipmaps, format 0x"
+              << std::hex << textures.internalFormat() << std::dec << ", queued in " << 1000.0 * queueSeconds << " ms "
+              << (gTextureStreamer->persistent() ? "(persistently mapped ring)" : "(copied ring)") << std::endl;
+
+    // with every import on its own thread, the wait is bounded by the slowest one, not their sum
+    std::vector<gk3d::AssetLoader::Timing> timings = loader.timings();
+    double importSeconds = 0.0;
+    size_t slowest = 0;
+    for (size_t i = 0; i < timings.size(); ++i) {
+        importSeconds += timings[i].seconds;
+        if (timings[i].seconds > timings[slowest].seconds)
+            slowest = i;
+    }
+    std::cout << "Startup: " << 1000.0 * issueSeconds << " ms building on the GL thread, " << 1000.0 * waitSeconds
+              << " ms waiting for imports, " << 1000.0 * loader.completionSeconds() << " ms creating meshes, "
+              << 1000.0 * uploadSeconds << " ms uploading geometry; " << 1000.0 * (glfwGetTime() - loadStart) << " ms in all" << std::endl;
+    if (!timings.empty()) {
+        std::cout << "Imports: " << timings.size() << " on " << loader.threads() << " threads, "
+                  << 1000.0 * importSeconds << " ms of work, the slowest " << 1000.0 * timings[slowest].seconds
+                  << " ms (" << timings[slowest].path << ")" << std::endl;
+    }
+
+    // the imported models were copied into the geometry pool: the cache's copies are no longer needed
+    gk3d::AssetCache& assets = gk3d::ModelAsset::Assets();
+    gk3d::AssetCache::Stats cacheStats = assets.stats();
+    size_t evicted = assets.evictUnused();
+    std::cout << "Asset cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses ("
+              << cacheStats.shared << " shared by content), " << cacheStats.modelFiles << " models from cache files, "
+              << cacheStats.bytesRead << " bytes hashed; "
+              << evicted << " unused entries evicted" << std::endl;
 }
 
 // convenience function that returns a translation matrix
@@ -181,15 +438,196 @@ static void CreateInstances() {
     gInstances.push_back(bench2);
 }
 
+static void CreateLights() {
+    std::vector<gk3d::Light>& lights = gFrameState->lights();
+
+    gk3d::Light spotlight_exit;
+    spotlight_exit.intensities = glm::vec3(0, 1, 0);
+    spotlight_exit.position = glm::vec4(-70.0, 8.5, 0.0,1);
+    spotlight_exit.attenuation = 0.1f;
+    spotlight_exit.ambientCoefficient = 0.0f;
+    spotlight_exit.coneAngle=360.0f;
+    spotlight_exit.coneDirection=glm::vec3(-10,0,0);
+    lights.push_back(spotlight_exit);
+
+    gk3d::Light spotlight1;
+    spotlight1.intensities = glm::vec3(1, 1, 0);
+    spotlight1.position = glm::vec4(18.0, 9.5, -27.0,1);
+    spotlight1.attenuation = 0.0f;
+    spotlight1.ambientCoefficient = 0.0f;
+    spotlight1.coneAngle=10.0f;
+    spotlight1.coneDirection=glm::vec3(-1,-1,1);
+    lights.push_back(spotlight1);
+
+    gk3d::Light spotlight2;
+    spotlight2.intensities = glm::vec3(1, 1, 0);
+    spotlight2.position = glm::vec4(18.0, 9.5, 27.0,1);
+    spotlight2.attenuation = 0.0f;
+    spotlight2.ambientCoefficient = 0.0f;
+    spotlight2.coneAngle=10.0f;
+    spotlight2.coneDirection=glm::vec3(-1,-1,-1);
+    lights.push_back(spotlight2);
+
+    gk3d::Light spotlight3;
+    spotlight3.intensities = glm::vec3(1, 0, 1);
+    spotlight3.position = glm::vec4(-20.0, 9.5, -27.0,1);
+    spotlight3.attenuation = 0.0f;
+    spotlight3.ambientCoefficient = 0.0f;
+    spotlight3.coneAngle=10.0f;
+    spotlight3.coneDirection=glm::vec3(1,-1,1);
+    lights.push_back(spotlight3);
+
+    gk3d::Light spotlight4;
+    spotlight4.intensities = glm::vec3(0, 1, 1);
+    spotlight4.position = glm::vec4(-20.0, 9.5, 27.0,1);
+    spotlight4.attenuation = 0.0f;
+    spotlight4.ambientCoefficient = 0.0f;
+    spotlight4.coneAngle=10.0f;
+    spotlight4.coneDirection=glm::vec3(1,-1,-1);
+    lights.push_back(spotlight4);
+
+    gk3d::Light directional_light1;
+    directional_light1.intensities = glm::vec3(0.1, 0.1, 0.1);
+    directional_light1.position = glm::vec4(18.0, 9.5, 27.0,0);
+    directional_light1.attenuation = 0.5f;
+    directional_light1.ambientCoefficient = 0.0f;
+    lights.push_back(directional_light1);
+
+    gk3d::Light directional_light2;
+    directional_light2.intensities = glm::vec3(0.1, 0.1, 0.1);
+    directional_light2.position = glm::vec4(-20.0, 9.5, -27.0,0);
+    directional_light2.attenuation = 0.1f;
+    directional_light2.ambientCoefficient = 0.0f;
+    lights.push_back(directional_light2);
+
+    gk3d::Light directional_light3;
+    directional_light3.intensities = glm::vec3(0.1, 0.1, 0.1);
+    directional_light3.position = glm::vec4(-20.0, -9.5, -27.0,0);
+    directional_light3.attenuation = 0.1f;
+    directional_light3.ambientCoefficient = 0.0f;
+    lights.push_back(directional_light3);
+}
+
 // draws a single frame
 static void Render() {
 
     glClearColor(0, 0, 0, 1);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // the first spotlight blinks red/white
+    static int currColor = 0;
+    gFrameState->lights()[1].intensities = currColor == 0 ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(1.f, 1.f, 1.f);
+    currColor = (currColor + 1) % 2;
+    gFrameState->upload(gCamera);
+
+    // texture data filled by the workers since the last frame, within the upload budget
+    try {
+        gTextureStreamer->update();
+    } catch (const std::exception& e) {
+        // the region is dropped; the rest keep streaming
+        std::cout << "Texture upload failed: " << e.what() << std::endl;
+    }
+    const gk3d::TextureArray& textures = gk3d::ModelAsset::Textures();
+    static bool texturesResident = false;
+    if (!texturesResident && textures.resident()) {
+        texturesResident = true;
+        std::cout << "Textures resident " << 1000.0 * (glfwGetTime() - gStreamStart) << " ms after loading began" << std::endl;
+        if (!textures.cacheError().empty())
+            std::cout << "Texture cache not saved: " << textures.cacheError() << std::endl;
+    }
+
+    double submitStart = glfwGetTime();
+    gRenderQueue.begin(gCamera);
+
+    // cull whole instances by their world spheres in one batch, then the meshes of the survivors by their boxes
+    gk3d::Frustum frustum(gCamera.matrix());
+    gk3d::CullStats cullStats;
+    gInstanceSpheres.clear();
     std::list<gk3d::ModelInstance*>::iterator it;
     for (it=gInstances.begin(); it!=gInstances.end(); ++it) {
-        (*it)->Render(gCamera,renderParams);
+        gInstanceSpheres.push_back((*it)->worldSphere());
+    }
+    gInstanceVisible.resize(gInstanceSpheres.size());
+    if (!gInstanceSpheres.empty())
+        frustum.intersects(&gInstanceSpheres[0], gInstanceSpheres.size(), &gInstanceVisible[0]);
+
+    // heavy models are also tested for occlusion, against query results of earlier frames
+    gOcclusion->begin(gCamera);
+    size_t instance = 0;
+    unsigned coarseInstances = 0;
+    for (it=gInstances.begin(); it!=gInstances.end(); ++it, ++instance) {
+        if (!gInstanceVisible[instance]) {
+            cullStats.instancesCulled++;
+            continue;
+        }
+        gk3d::ModelInstance *modelInstance = *it;
+        GLuint condition = 0;
+        if (modelInstance->asset->triangles >= gk3d::OcclusionCuller::MinTriangles &&
+            !gOcclusion->test(modelInstance, modelInstance->asset->bounds, modelInstance->transform, condition)) {
+            continue;
+        }
+        modelInstance->selectLod(gCamera, gViewportHeight, renderParams.lodBias);
+        if (modelInstance->lod > 0)
+            coarseInstances++;
+        modelInstance->Enqueue(gRenderQueue, frustum, cullStats, condition);
+    }
+    gRenderQueue.sort();
+    gRenderQueue.submit(renderParams);
+    gOcclusion->issueQueries();
+    double submitEnd = glfwGetTime();
+
+    const gk3d::RenderQueue::Stats& stats = gRenderQueue.stats();
+    gTimings.seconds += submitEnd - submitStart;
+    gTimings.draws += stats.draws;
+    gTimings.ranges += stats.ranges;
+    gTimings.instances += stats.instances;
+    gTimings.programSwitches += stats.programSwitches;
+    gTimings.textureBinds += stats.textureBinds;
+    gTimings.samplerBinds += stats.samplerBinds;
+    gTimings.vaoBinds += stats.vaoBinds;
+    gTimings.instancesCulled += cullStats.instancesCulled;
+    gTimings.meshesCulled += cullStats.meshesCulled;
+    gTimings.meshesDrawn += cullStats.meshesDrawn;
+    gTimings.occlusionQueries += gOcclusion->stats().queries;
+    gTimings.instancesOccluded += gOcclusion->stats().occluded;
+    gTimings.conditionalDraws += stats.conditionalDraws;
+    gTimings.coarseInstances += coarseInstances;
+    gTimings.streamedBytes += gTextureStreamer->stats().bytes;
+    gTimings.streamedRegions += gTextureStreamer->stats().uploads;
+    gTimings.frames++;
+
+    if (submitEnd - gTimings.lastReport > TIMINGS_REPORT_INTERVAL) {
+        if (gTimings.draws > 0) {
+            std::cout << "Submit: " << 1000.0 * gTimings.seconds / gTimings.frames << " ms/frame, "
+                      << 1000000.0 * gTimings.seconds / gTimings.draws << " us/draw; per frame: "
+                      << gTimings.draws / gTimings.frames << " draws of "
+                      << gTimings.ranges / gTimings.frames << " index ranges and "
+                      << gTimings.instances / gTimings.frames << " instances, "
+                      << gTimings.programSwitches / gTimings.frames << " program switches, "
+                      << gTimings.textureBinds / gTimings.frames << " texture binds, "
+                      << gTimings.samplerBinds / gTimings.frames << " sampler binds, "
+                      << gTimings.vaoBinds / gTimings.frames << " VAO binds" << std::endl;
+        }
+        if (gTimings.frames > 0) {
+            std::cout << "Culling: " << gTimings.instancesCulled / gTimings.frames << " of " << gInstances.size()
+                      << " instances and " << gTimings.meshesCulled / gTimings.frames << " meshes culled, "
+                      << gTimings.meshesDrawn / gTimings.frames << " meshes drawn per frame" << std::endl;
+            std::cout << "LOD (bias " << renderParams.lodBias << "): "
+                      << gTimings.coarseInstances / gTimings.frames << " instances drawn coarser per frame" << std::endl;
+            static const char *const occlusionModes[] = {"off", "deferred", "conditional"};
+            std::cout << "Occlusion (" << occlusionModes[gOcclusion->mode()] << "): "
+                      << gTimings.occlusionQueries / gTimings.frames << " queries, "
+                      << gTimings.instancesOccluded / gTimings.frames << " instances occluded, "
+                      << gTimings.conditionalDraws / gTimings.frames << " conditional draws per frame" << std::endl;
+            if (gTimings.streamedRegions > 0 || !textures.resident()) {
+                std::cout << "Texture streaming: " << gTimings.streamedBytes / gTimings.frames << " bytes in "
+                          << (double) gTimings.streamedRegions / gTimings.frames << " regions per frame, "
+                          << gTextureStreamer->stats().pending << " regions pending, base level "
+                          << textures.baseLevel() << std::endl;
+            }
+        }
+        gTimings = SubmitTimings();
+        gTimings.lastReport = submitEnd;
     }
 
     glfwSwapBuffers();
@@ -251,6 +689,30 @@ void update_delayed_input(float& secondsElapsed) {
         renderParams.bias=0;
     }
 
+    //level of detail bias: coarser / finer meshes
+    GLfloat lodBias=0.0f;
+    if (glfwGetKey('K')) {
+        if (secondsElapsed>0.3){
+            lodBias=0.5f;
+            secondsElapsed=0.0;
+        }
+    }
+    if (glfwGetKey('J')) {
+        if (secondsElapsed>0.3){
+            lodBias=-0.5f;
+            secondsElapsed=0.0;
+        }
+    }
+    renderParams.lodBias=glm::clamp(renderParams.lodBias+lodBias, -2.0f, 3.0f);
+
+    //anisotropic filtering: off, 2x, 4x, 8x, 16x
+    if (glfwGetKey('I')) {
+        if (secondsElapsed>0.3){
+            renderParams.anisotropy = renderParams.anisotropy >= 16.0f ? 1.0f : renderParams.anisotropy * 2.0f;
+            secondsElapsed=0.0;
+        }
+    }
+
     if (glfwGetKey('M')) {
         if (secondsElapsed>0.3) {
             if (!gCourt.swap()) {
@@ -261,27 +723,35 @@ void update_delayed_input(float& secondsElapsed) {
             secondsElapsed=0.0;
         }
     }
+    //cycle occlusion culling: off, deferred, conditional
+    if (glfwGetKey('Q')) {
+        if (secondsElapsed>0.3) {
+            gOcclusion->setMode((gk3d::OcclusionCuller::Mode) ((gOcclusion->mode() + 1) % 3));
+            secondsElapsed=0.0;
+        }
+    }
+    gk3d::Fog& fog = gFrameState->fog();
     if (glfwGetKey('F')) {
         if (secondsElapsed>0.3) {
-            gFog->eq=(gFog->eq+1)%4;
+            fog.eq=(fog.eq+1)%4;
             secondsElapsed=0.0;
         }
     }
     //fog density
     if (glfwGetKey('H')) {
         if (secondsElapsed>0.3) {
-            gFog->density=(gFog->density+0.01);
-            if (gFog->density>0.1) {
-                gFog->density=0.1;
+            fog.density=(fog.density+0.01);
+            if (fog.density>0.1) {
+                fog.density=0.1;
             }
             secondsElapsed=0.0;
         }
     }
     if (glfwGetKey('G')) {
         if (secondsElapsed>0.3) {
-            gFog->density=(gFog->density-0.01);
-            if (gFog->density<0.0) {
-                gFog->density=0.0;
+            fog.density=(fog.density-0.01);
+            if (fog.density<0.0) {
+                fog.density=0.0;
             }
             secondsElapsed=0.0;
         }
@@ -343,11 +813,15 @@ void Update(float secondsElapsed) {
 
 void GLFWCALL reshape( int width, int height ) {
     glViewport(0, 0, width, height);
+    gViewportHeight = (float)height;
     gCamera.setViewportAspectRatio((float)width/height);
 }
 
 // the program starts here
 int main(int argc, char *argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--benchmark")
+        return RunBenchmarks();
+
     // initialise GLFW
     if (!glfwInit())
         throw std::runtime_error("glfwInit failed");
@@ -355,9 +829,9 @@ int main(int argc, char *argv[]) {
     // open a window with GLFW
     glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
-    glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
+    glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 3);
     if (!glfwOpenWindow(SCREEN_SIZE.x, SCREEN_SIZE.y, 8, 8, 8, 8, 0, 0, GLFW_WINDOW))
-        throw std::runtime_error("glfwOpenWindow failed. Can your hardware handle OpenGL 3.2?");
+        throw std::runtime_error("glfwOpenWindow failed. Can your hardware handle OpenGL 3.3?");
 
     glfwSetWindowSizeCallback( reshape );
 
@@ -372,9 +846,9 @@ int main(int argc, char *argv[]) {
     std::cout << "Vendor: " << glGetString(GL_VENDOR) << std::endl;
     std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
 
-    // make sure OpenGL version 3.2 API is available
-    if (!GLEW_VERSION_3_2)
-        throw std::runtime_error("OpenGL 3.2 API is not available.");
+    // make sure OpenGL version 3.3 API is available (instanced vertex attributes)
+    if (!GLEW_VERSION_3_3)
+        throw std::runtime_error("OpenGL 3.3 API is not available.");
 
     // OpenGL settings
     glEnable(GL_DEPTH_TEST);
@@ -383,19 +857,24 @@ int main(int argc, char *argv[]) {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // create buffer and fill it with the points of the triangle
+    gFrameState = new gk3d::FrameState;
+    gTextureStreamer = new gk3d::TextureStreamer;
     LoadAssets();
+    gOcclusion = new gk3d::OcclusionCuller(gk3d::ModelAsset::LoadShaders("proxy.v.shader", "proxy.f.shader"));
     CreateInstances();
-
-    gFog =new gk3d::Fog;
-    gFog->density=0.01;
-    gFog->color=glm::vec4(1,1,1,1);
-    gFog->start=10;
-    gFog->end=80;
-    gFog->eq=3;
+    CreateLights();
+
+    gk3d::Fog& fog = gFrameState->fog();
+    fog.density=0.01;
+    fog.color=glm::vec4(1,1,1,1);
+    fog.start=10;
+    fog.end=80;
+    fog.eq=3;
     renderParams.magTextureFilter = GL_NEAREST;
     renderParams.minTextureFilter = GL_NEAREST;
     renderParams.bias=0.0f;
-    renderParams.fog= gFog;
+    renderParams.lodBias=0.0f;
+    renderParams.anisotropy=1.0f;
     gCamera.setPosition(glm::vec3(0,13,25));
     gCamera.setNearAndFarPlanes(0.1f, 200.0f);
     gCamera.setFieldOfView(90.0f);
@@ -419,6 +898,7 @@ int main(int argc, char *argv[]) {
     }
 
     // clean up and exit
+    delete gTextureStreamer;
     glfwTerminate();
     return EXIT_SUCCESS;
 }
\ No newline at end of file
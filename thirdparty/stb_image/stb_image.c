@@ -237,6 +237,24 @@ typedef struct
 
 extern stbi_uc *stbi_load_from_callbacks  (stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp);
 
+// gk3d: decoding into rows the caller provides, handing them over as they are finished
+// instead of returning one buffer at the end. Baseline JPEGs hand over the rows of every
+// row of MCUs and non-interlaced PNGs those of every deflate block, so no decoded copy of
+// the image is made besides the caller's; other images are decoded whole first.
+typedef struct
+{
+   // the image is x by y and its rows have comp channels, req_comp if nonzero; return 0 to stop
+   int      (*begin)    (void *user, int x, int y, int comp);
+   // where row y goes, x * comp bytes; rows are asked for in order. return NULL to stop
+   stbi_uc *(*row)      (void *user, int y);
+   // rows 0 up to y are finished; return 0 to stop
+   int      (*rows_done)(void *user, int y);
+} stbi_row_sink;
+
+// return 1 once every row was handed over, 0 on failure or if the sink stopped
+extern int stbi_load_rows_from_memory   (stbi_uc const *buffer, int len, int req_comp, stbi_row_sink const *sink, void *sink_user);
+extern int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *user, int req_comp, stbi_row_sink const *sink, void *sink_user);
+
 #ifndef STBI_NO_HDR
    extern float *stbi_loadf_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
 
@@ -472,9 +490,11 @@ static void stbi_rewind(stbi *s)
 
 static int      stbi_jpeg_test(stbi *s);
 static stbi_uc *stbi_jpeg_load(stbi *s, int *x, int *y, int *comp, int req_comp);
+static int      stbi_jpeg_load_rows(stbi *s, int req_comp, stbi_row_sink const *sink, void *user);
 static int      stbi_jpeg_info(stbi *s, int *x, int *y, int *comp);
 static int      stbi_png_test(stbi *s);
 static stbi_uc *stbi_png_load(stbi *s, int *x, int *y, int *comp, int req_comp);
+static int      stbi_png_load_rows(stbi *s, int req_comp, stbi_row_sink const *sink, void *user);
 static int      stbi_png_info(stbi *s, int *x, int *y, int *comp);
 static int      stbi_bmp_test(stbi *s);
 static stbi_uc *stbi_bmp_load(stbi *s, int *x, int *y, int *comp, int req_comp);
@@ -492,8 +512,12 @@ static stbi_uc *stbi_gif_load(stbi *s, int *x, int *y, int *comp, int req_comp);
 static int      stbi_gif_info(stbi *s, int *x, int *y, int *comp);
 
 
-// this is not threadsafe
+// one per thread when compiled as C++11, where images are decoded on several threads at once
+#if defined(__cplusplus) && __cplusplus >= 201103L
+static thread_local const char *failure_reason;
+#else
 static const char *failure_reason;
+#endif
 
 const char *stbi_failure_reason(void)
 {
@@ -831,9 +855,34 @@ static uint8 compute_y(int r, int g, int b)
    return (uint8) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
+static void convert_row(unsigned char *src, int img_n, unsigned char *dest, int req_comp, uint x)
+{
+   int i;
+   #define COMBO(a,b)  ((a)*8+(b))
+   #define CASE(a,b)   case COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per scanline and massive macros
+   switch (COMBO(img_n, req_comp)) {
+      CASE(1,2) dest[0]=src[0], dest[1]=255; break;
+      CASE(1,3) dest[0]=dest[1]=dest[2]=src[0]; break;
+      CASE(1,4) dest[0]=dest[1]=dest[2]=src[0], dest[3]=255; break;
+      CASE(2,1) dest[0]=src[0]; break;
+      CASE(2,3) dest[0]=dest[1]=dest[2]=src[0]; break;
+      CASE(2,4) dest[0]=dest[1]=dest[2]=src[0], dest[3]=src[1]; break;
+      CASE(3,4) dest[0]=src[0],dest[1]=src[1],dest[2]=src[2],dest[3]=255; break;
+      CASE(3,1) dest[0]=compute_y(src[0],src[1],src[2]); break;
+      CASE(3,2) dest[0]=compute_y(src[0],src[1],src[2]), dest[1] = 255; break;
+      CASE(4,1) dest[0]=compute_y(src[0],src[1],src[2]); break;
+      CASE(4,2) dest[0]=compute_y(src[0],src[1],src[2]), dest[1] = src[3]; break;
+      CASE(4,3) dest[0]=src[0],dest[1]=src[1],dest[2]=src[2]; break;
+      default: assert(0);
+   }
+   #undef CASE
+}
+
 static unsigned char *convert_format(unsigned char *data, int img_n, int req_comp, uint x, uint y)
 {
-   int i,j;
+   int j;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -845,36 +894,60 @@ static unsigned char *convert_format(unsigned char *data, int img_n, int req_com
       return epuc("outofmem", "Out of memory");
    }
 
-   for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
-
-      #define COMBO(a,b)  ((a)*8+(b))
-      #define CASE(a,b)   case COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (COMBO(img_n, req_comp)) {
-         CASE(1,2) dest[0]=src[0], dest[1]=255; break;
-         CASE(1,3) dest[0]=dest[1]=dest[2]=src[0]; break;
-         CASE(1,4) dest[0]=dest[1]=dest[2]=src[0], dest[3]=255; break;
-         CASE(2,1) dest[0]=src[0]; break;
-         CASE(2,3) dest[0]=dest[1]=dest[2]=src[0]; break;
-         CASE(2,4) dest[0]=dest[1]=dest[2]=src[0], dest[3]=src[1]; break;
-         CASE(3,4) dest[0]=src[0],dest[1]=src[1],dest[2]=src[2],dest[3]=255; break;
-         CASE(3,1) dest[0]=compute_y(src[0],src[1],src[2]); break;
-         CASE(3,2) dest[0]=compute_y(src[0],src[1],src[2]), dest[1] = 255; break;
-         CASE(4,1) dest[0]=compute_y(src[0],src[1],src[2]); break;
-         CASE(4,2) dest[0]=compute_y(src[0],src[1],src[2]), dest[1] = src[3]; break;
-         CASE(4,3) dest[0]=src[0],dest[1]=src[1],dest[2]=src[2]; break;
-         default: assert(0);
-      }
-      #undef CASE
-   }
+   for (j=0; j < (int) y; ++j)
+      convert_row(data + j * x * img_n, img_n, good + j * x * req_comp, req_comp, x);
 
    free(data);
    return good;
 }
 
+// gk3d: hands over an image decoded whole, with img_n channels, a row at a time
+static int write_rows(stbi_uc *data, int x, int y, int img_n, int req_comp, stbi_row_sink const *sink, void *user)
+{
+   int j, n = req_comp ? req_comp : img_n;
+   if (!sink->begin(user, x, y, n)) return e("stopped", "Decoding stopped");
+   for (j=0; j < y; ++j) {
+      stbi_uc *src = data + j * x * img_n;
+      stbi_uc *dest = sink->row(user, j);
+      if (!dest) return e("stopped", "Decoding stopped");
+      if (n == img_n)
+         memcpy(dest, src, x * n);
+      else
+         convert_row(src, img_n, dest, n, x);
+   }
+   if (!sink->rows_done(user, y)) return e("stopped", "Decoding stopped");
+   return 1;
+}
+
+static int stbi_load_rows_main(stbi *s, int req_comp, stbi_row_sink const *sink, void *user)
+{
+   int x, y, comp, ok;
+   stbi_uc *data;
+   if (req_comp < 0 || req_comp > 4) return e("bad req_comp", "Internal error");
+   if (stbi_jpeg_test(s)) return stbi_jpeg_load_rows(s, req_comp, sink, user);
+   if (stbi_png_test(s))  return stbi_png_load_rows(s, req_comp, sink, user);
+
+   data = stbi_load_main(s, &x, &y, &comp, req_comp);
+   if (data == NULL) return 0;
+   ok = write_rows(data, x, y, req_comp ? req_comp : comp, req_comp, sink, user);
+   stbi_image_free(data);
+   return ok;
+}
+
+int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, int req_comp, stbi_row_sink const *sink, void *sink_user)
+{
+   stbi s;
+   start_mem(&s,buffer,len);
+   return stbi_load_rows_main(&s, req_comp, sink, sink_user);
+}
+
+int stbi_load_rows_from_callbacks(stbi_io_callbacks const *clbk, void *user, int req_comp, stbi_row_sink const *sink, void *sink_user)
+{
+   stbi s;
+   start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi_load_rows_main(&s, req_comp, sink, sink_user);
+}
+
 #ifndef STBI_NO_HDR
 static float   *ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
@@ -989,6 +1062,7 @@ typedef struct
       uint8 *data;
       void *raw_data;
       uint8 *linebuf;
+      int rows;   // gk3d: rows of data decoded so far
    } img_comp[4];
 
    uint32         code_buffer; // jpeg entropy-coded buffer
@@ -998,6 +1072,10 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+
+   // gk3d: called after every row of blocks is decoded, to hand over the rows it finishes
+   int (*rows_decoded)(void *state);
+   void *rows_state;
 } jpeg;
 
 static int build_huffman(huffman *h, int *count)
@@ -1385,6 +1463,8 @@ static int parse_entropy_coded_data(jpeg *z)
                reset(z);
             }
          }
+         z->img_comp[n].rows = (j+1) * 8;
+         if (z->rows_decoded && !z->rows_decoded(z->rows_state)) return 0;
       }
    } else { // interleaved!
       int i,j,k,x,y;
@@ -1419,6 +1499,11 @@ static int parse_entropy_coded_data(jpeg *z)
                reset(z);
             }
          }
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            z->img_comp[n].rows = (j+1) * z->img_comp[n].v * 8;
+         }
+         if (z->rows_decoded && !z->rows_decoded(z->rows_state)) return 0;
       }
    }
    return 1;
@@ -1585,6 +1670,7 @@ static int process_frame_header(jpeg *z, int scan)
       // align blocks for installable-idct using mmx/sse
       z->img_comp[i].data = (uint8*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       z->img_comp[i].linebuf = NULL;
+      z->img_comp[i].rows = 0;
    }
 
    return 1;
@@ -1804,104 +1890,182 @@ typedef struct
    int ypos;    // which pre-expansion row we're on
 } stbi_resample;
 
-static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// gk3d: resampling and color conversion run a row at a time as the rows they read from are
+// decoded, writing to a row sink or, without one, to a buffer of the whole image
+typedef struct
 {
-   int n, decode_n;
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
-   z->s->img_n = 0;
+   jpeg *z;
+   int req_comp, n, decode_n;
+   int started;
+   uint32 rows;     // output rows written so far
+   stbi_resample res_comp[4];
+   uint8 *output;   // the whole image, without a sink
+   stbi_row_sink const *sink;
+   void *sink_user;
+} jpeg_output;
 
-   // load a jpeg image from whichever source
-   if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
+// sets up resampling once the frame header is known
+static int jpeg_output_start(jpeg_output *o)
+{
+   jpeg *z = o->z;
+   int k;
 
    // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n;
+   o->n = o->req_comp ? o->req_comp : z->s->img_n;
 
-   if (z->s->img_n == 3 && n < 3)
-      decode_n = 1;
+   if (z->s->img_n == 3 && o->n < 3)
+      o->decode_n = 1;
    else
-      decode_n = z->s->img_n;
-
-   // resample and color-convert
-   {
-      int k;
-      uint i,j;
-      uint8 *output;
-      uint8 *coutput[4];
+      o->decode_n = z->s->img_n;
+
+   for (k=0; k < o->decode_n; ++k) {
+      stbi_resample *r = &o->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      z->img_comp[k].linebuf = (uint8 *) malloc(z->s->img_x + 3);
+      if (!z->img_comp[k].linebuf) return e("outofmem", "Out of memory");
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
+      else                               r->resample = resample_row_generic;
+   }
 
-      stbi_resample res_comp[4];
+   if (o->sink) {
+      if (!o->sink->begin(o->sink_user, z->s->img_x, z->s->img_y, o->n)) return e("stopped", "Decoding stopped");
+   } else {
+      o->output = (uint8 *) malloc(o->n * z->s->img_x * z->s->img_y + 1);
+      if (!o->output) return e("outofmem", "Out of memory");
+   }
+   o->started = 1;
+   return 1;
+}
 
-      for (k=0; k < decode_n; ++k) {
-         stbi_resample *r = &res_comp[k];
+// nonzero once both rows of every component the next output row is resampled from are decoded
+static int jpeg_output_row_ready(jpeg_output *o)
+{
+   int k;
+   for (k=0; k < o->decode_n; ++k) {
+      stbi_resample *r = &o->res_comp[k];
+      int last = r->ypos < o->z->img_comp[k].y ? r->ypos : o->z->img_comp[k].y - 1;
+      if (last >= o->z->img_comp[k].rows) return 0;
+   }
+   return 1;
+}
 
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (uint8 *) malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
+// resamples and color-converts the output rows decoded so far
+static int jpeg_output_rows(void *state)
+{
+   jpeg_output *o = (jpeg_output *) state;
+   jpeg *z = o->z;
+   uint32 first = o->rows;
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
+   if (!o->started && !jpeg_output_start(o)) return 0;
 
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
-         else                               r->resample = resample_row_generic;
+   for (; o->rows < z->s->img_y && jpeg_output_row_ready(o); ++o->rows) {
+      int k, n = o->n;
+      uint i;
+      uint8 *coutput[4];
+      uint8 *out = o->sink ? o->sink->row(o->sink_user, o->rows) : o->output + n * z->s->img_x * o->rows;
+      if (!out) return e("stopped", "Decoding stopped");
+
+      for (k=0; k < o->decode_n; ++k) {
+         stbi_resample *r = &o->res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(z->img_comp[k].linebuf,
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
       }
-
-      // can't error after this so, this is safe
-      output = (uint8 *) malloc(n * z->s->img_x * z->s->img_y + 1);
-      if (!output) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         uint8 *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi_resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
+      if (n >= 3) {
+         uint8 *y = coutput[0];
+         if (z->s->img_n == 3) {
+            // the converters write a fourth byte per pixel even for 3 components, so the
+            // last pixel of a row goes through a scratch pixel rather than past the row
+            uint count = n == 3 ? z->s->img_x - 1 : z->s->img_x;
+            uint8 last[4];
+            #ifdef STBI_SIMD
+            stbi_YCbCr_installed(out, y, coutput[1], coutput[2], count, n);
+            if (count < z->s->img_x) stbi_YCbCr_installed(last, y+count, coutput[1]+count, coutput[2]+count, 1, n);
+            #else
+            YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], count, n);
+            if (count < z->s->img_x) YCbCr_to_RGB_row(last, y+count, coutput[1]+count, coutput[2]+count, 1, n);
+            #endif
+            if (count < z->s->img_x) memcpy(out + count*3, last, 3);
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               if (n == 4) out[3] = 255;
+               out += n;
             }
-         }
-         if (n >= 3) {
-            uint8 *y = coutput[0];
-            if (z->s->img_n == 3) {
-               #ifdef STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               #endif
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            uint8 *y = coutput[0];
-            if (n == 1)
-               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-            else
-               for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
-         }
+      } else {
+         uint8 *y = coutput[0];
+         if (n == 1)
+            for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+         else
+            for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
       }
-      cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp  = z->s->img_n; // report original components, not output
-      return output;
    }
+
+   if (o->sink && o->rows > first)
+      if (!o->sink->rows_done(o->sink_user, o->rows)) return e("stopped", "Decoding stopped");
+   return 1;
+}
+
+static int decode_jpeg_rows(jpeg *z, jpeg_output *o)
+{
+   int k, ok;
+   // validate req_comp
+   if (o->req_comp < 0 || o->req_comp > 4) return e("bad req_comp", "Internal error");
+   z->s->img_n = 0;
+   o->z = z;
+   o->started = 0;
+   o->rows = 0;
+   o->output = NULL;
+   z->rows_decoded = jpeg_output_rows;
+   z->rows_state = o;
+
+   // load a jpeg image from whichever source
+   ok = decode_jpeg_image(z);
+   if (ok) {
+      // rows a truncated image is missing come out as they are
+      for (k=0; k < z->s->img_n; ++k)
+         z->img_comp[k].rows = z->img_comp[k].y;
+      ok = jpeg_output_rows(o);
+   }
+   cleanup_jpeg(z);
+   if (!ok) {
+      free(o->output);
+      o->output = NULL;
+   }
+   return ok;
+}
+
+static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   jpeg_output o;
+   o.req_comp = req_comp;
+   o.sink = NULL;
+   if (!decode_jpeg_rows(z, &o)) return NULL;
+   *out_x = z->s->img_x;
+   *out_y = z->s->img_y;
+   if (comp) *comp  = z->s->img_n; // report original components, not output
+   return o.output;
 }
 
 static unsigned char *stbi_jpeg_load(stbi *s, int *x, int *y, int *comp, int req_comp)
@@ -1911,6 +2075,17 @@ static unsigned char *stbi_jpeg_load(stbi *s, int *x, int *y, int *comp, int req
    return load_jpeg_image(&j, x,y,comp,req_comp);
 }
 
+static int stbi_jpeg_load_rows(stbi *s, int req_comp, stbi_row_sink const *sink, void *user)
+{
+   jpeg j;
+   jpeg_output o;
+   j.s = s;
+   o.req_comp = req_comp;
+   o.sink = sink;
+   o.sink_user = user;
+   return decode_jpeg_rows(&j, &o);
+}
+
 static int stbi_jpeg_test(stbi *s)
 {
    int r;
@@ -1980,7 +2155,7 @@ stbi_inline static int bit_reverse(int v, int bits)
    return bitreverse16(v) >> (16-bits);
 }
 
-static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
+static int zbuild_huffman(zhuffman *z, const uint8 *sizelist, int num)
 {
    int i,k=0;
    int code, next_code[16], sizes[17];
@@ -2042,6 +2217,10 @@ typedef struct
    char *zout_end;
    int   z_expandable;
 
+   // gk3d: called with the end of the output after every block; return 0 to stop
+   int (*progress)(void *user, char *zout);
+   void *progress_user;
+
    zhuffman z_length, z_distance;
 } zbuf;
 
@@ -2244,18 +2423,24 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static uint8 default_length[288], default_distance[32];
-static void init_defaults(void)
+// fixed code lengths of the spec (3.2.6), filled statically so decoding
+// fixed-huffman blocks on several threads at once never writes shared state
+static const uint8 default_length[288] =
 {
-   int i;   // use <= to match clearly with spec
-   for (i=0; i <= 143; ++i)     default_length[i]   = 8;
-   for (   ; i <= 255; ++i)     default_length[i]   = 9;
-   for (   ; i <= 279; ++i)     default_length[i]   = 7;
-   for (   ; i <= 287; ++i)     default_length[i]   = 8;
-
-   for (i=0; i <=  31; ++i)     default_distance[i] = 5;
-}
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
+};
+static const uint8 default_distance[32] =
+{
+   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5
+};
 
 int stbi_png_partial; // a quick hack to only allow decoding some of a PNG... I should implement real streaming support instead
 static int parse_zlib(zbuf *a, int parse_header)
@@ -2275,7 +2460,6 @@ static int parse_zlib(zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!default_distance[31]) init_defaults();
             if (!zbuild_huffman(&a->z_length  , default_length  , 288)) return 0;
             if (!zbuild_huffman(&a->z_distance, default_distance,  32)) return 0;
          } else {
@@ -2283,6 +2467,7 @@ static int parse_zlib(zbuf *a, int parse_header)
          }
          if (!parse_huffman_block(a)) return 0;
       }
+      if (a->progress && !a->progress(a->progress_user, a->zout)) return 0;
       if (stbi_png_partial && a->zout - a->zout_start > 65536)
          break;
    } while (!final);
@@ -2295,6 +2480,7 @@ static int do_zlib(zbuf *a, char *obuf, int olen, int exp, int parse_header)
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->progress = NULL;
 
    return parse_zlib(a, parse_header);
 }
@@ -2414,6 +2600,10 @@ typedef struct
 {
    stbi *s;
    uint8 *idata, *expanded, *out;
+
+   // gk3d: where non-interlaced images go a row at a time, instead of out; may be NULL
+   stbi_row_sink const *sink;
+   void *sink_user;
 } png;
 
 
@@ -2438,12 +2628,74 @@ static int paeth(int a, int b, int c)
    return c;
 }
 
+// unfilter one row of post-deflated data, starting with its filter byte; prior is the
+// unfiltered row above. The first row never reads it, but it is still stepped along the
+// row, so it must point at a row of x pixels all the same: pass cur
+static int png_unfilter_row(uint8 *cur, uint8 *prior, uint8 *raw, int first, int img_n, int out_n, uint32 x)
+{
+   uint32 i;
+   int k;
+   int filter = *raw++;
+   if (filter > 4) return e("invalid filter","Corrupt PNG");
+   // if first row, use special filter that doesn't sample previous row
+   if (first) filter = first_row_filter[filter];
+   // handle first pixel explicitly
+   for (k=0; k < img_n; ++k) {
+      switch (filter) {
+         case F_none       : cur[k] = raw[k]; break;
+         case F_sub        : cur[k] = raw[k]; break;
+         case F_up         : cur[k] = raw[k] + prior[k]; break;
+         case F_avg        : cur[k] = raw[k] + (prior[k]>>1); break;
+         case F_paeth      : cur[k] = (uint8) (raw[k] + paeth(0,prior[k],0)); break;
+         case F_avg_first  : cur[k] = raw[k]; break;
+         case F_paeth_first: cur[k] = raw[k]; break;
+      }
+   }
+   if (img_n != out_n) cur[img_n] = 255;
+   raw += img_n;
+   cur += out_n;
+   prior += out_n;
+   // this is a little gross, so that we don't switch per-pixel or per-component
+   if (img_n == out_n) {
+      #define CASE(f) \
+          case f:     \
+             for (i=x-1; i >= 1; --i, raw+=img_n,cur+=img_n,prior+=img_n) \
+                for (k=0; k < img_n; ++k)
+      switch (filter) {
+         CASE(F_none)  cur[k] = raw[k]; break;
+         CASE(F_sub)   cur[k] = raw[k] + cur[k-img_n]; break;
+         CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
+         CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-img_n])>>1); break;
+         CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],prior[k],prior[k-img_n])); break;
+         CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-img_n] >> 1); break;
+         CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],0,0)); break;
+      }
+      #undef CASE
+   } else {
+      assert(img_n+1 == out_n);
+      #define CASE(f) \
+          case f:     \
+             for (i=x-1; i >= 1; --i, cur[img_n]=255,raw+=img_n,cur+=out_n,prior+=out_n) \
+                for (k=0; k < img_n; ++k)
+      switch (filter) {
+         CASE(F_none)  cur[k] = raw[k]; break;
+         CASE(F_sub)   cur[k] = raw[k] + cur[k-out_n]; break;
+         CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
+         CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-out_n])>>1); break;
+         CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-out_n],prior[k],prior[k-out_n])); break;
+         CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-out_n] >> 1); break;
+         CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-out_n],0,0)); break;
+      }
+      #undef CASE
+   }
+   return 1;
+}
+
 // create the png data from post-deflated data
 static int create_png_image_raw(png *a, uint8 *raw, uint32 raw_len, int out_n, uint32 x, uint32 y)
 {
    stbi *s = a->s;
-   uint32 i,j,stride = x*out_n;
-   int k;
+   uint32 j,stride = x*out_n;
    int img_n = s->img_n; // copy it into a local for later
    assert(out_n == s->img_n || out_n == s->img_n+1);
    if (stbi_png_partial) y = 1;
@@ -2458,60 +2710,8 @@ static int create_png_image_raw(png *a, uint8 *raw, uint32 raw_len, int out_n, u
    }
    for (j=0; j < y; ++j) {
       uint8 *cur = a->out + stride*j;
-      uint8 *prior = cur - stride;
-      int filter = *raw++;
-      if (filter > 4) return e("invalid filter","Corrupt PNG");
-      // if first row, use special filter that doesn't sample previous row
-      if (j == 0) filter = first_row_filter[filter];
-      // handle first pixel explicitly
-      for (k=0; k < img_n; ++k) {
-         switch (filter) {
-            case F_none       : cur[k] = raw[k]; break;
-            case F_sub        : cur[k] = raw[k]; break;
-            case F_up         : cur[k] = raw[k] + prior[k]; break;
-            case F_avg        : cur[k] = raw[k] + (prior[k]>>1); break;
-            case F_paeth      : cur[k] = (uint8) (raw[k] + paeth(0,prior[k],0)); break;
-            case F_avg_first  : cur[k] = raw[k]; break;
-            case F_paeth_first: cur[k] = raw[k]; break;
-         }
-      }
-      if (img_n != out_n) cur[img_n] = 255;
-      raw += img_n;
-      cur += out_n;
-      prior += out_n;
-      // this is a little gross, so that we don't switch per-pixel or per-component
-      if (img_n == out_n) {
-         #define CASE(f) \
-             case f:     \
-                for (i=x-1; i >= 1; --i, raw+=img_n,cur+=img_n,prior+=img_n) \
-                   for (k=0; k < img_n; ++k)
-         switch (filter) {
-            CASE(F_none)  cur[k] = raw[k]; break;
-            CASE(F_sub)   cur[k] = raw[k] + cur[k-img_n]; break;
-            CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
-            CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-img_n])>>1); break;
-            CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],prior[k],prior[k-img_n])); break;
-            CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-img_n] >> 1); break;
-            CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],0,0)); break;
-         }
-         #undef CASE
-      } else {
-         assert(img_n+1 == out_n);
-         #define CASE(f) \
-             case f:     \
-                for (i=x-1; i >= 1; --i, cur[img_n]=255,raw+=img_n,cur+=out_n,prior+=out_n) \
-                   for (k=0; k < img_n; ++k)
-         switch (filter) {
-            CASE(F_none)  cur[k] = raw[k]; break;
-            CASE(F_sub)   cur[k] = raw[k] + cur[k-out_n]; break;
-            CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
-            CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-out_n])>>1); break;
-            CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-out_n],prior[k],prior[k-out_n])); break;
-            CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-out_n] >> 1); break;
-            CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-out_n],0,0)); break;
-         }
-         #undef CASE
-      }
+      if (!png_unfilter_row(cur, j ? cur - stride : cur, raw, j == 0, img_n, out_n, x)) return 0;
+      raw += img_n * x + 1;
    }
    return 1;
 }
@@ -2557,11 +2757,9 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n, int i
    return 1;
 }
 
-static int compute_transparency(png *z, uint8 tc[3], int out_n)
+static int compute_transparency(uint8 *p, uint32 pixel_count, uint8 tc[3], int out_n)
 {
-   stbi *s = z->s;
-   uint32 i, pixel_count = s->img_x * s->img_y;
-   uint8 *p = z->out;
+   uint32 i;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
@@ -2582,17 +2780,9 @@ static int compute_transparency(png *z, uint8 tc[3], int out_n)
    return 1;
 }
 
-static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n)
+static void expand_palette_row(uint8 *p, uint8 *orig, uint32 pixel_count, uint8 *palette, int pal_img_n)
 {
-   uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-   uint8 *p, *temp_out, *orig = a->out;
-
-   p = (uint8 *) malloc(pixel_count * pal_img_n);
-   if (p == NULL) return e("outofmem", "Out of memory");
-
-   // between here and free(out) below, exitting would leak
-   temp_out = p;
-
+   uint32 i;
    if (pal_img_n == 3) {
       for (i=0; i < pixel_count; ++i) {
          int n = orig[i]*4;
@@ -2611,6 +2801,15 @@ static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n)
          p += 4;
       }
    }
+}
+
+static int expand_palette(png *a, uint8 *palette, int len, int pal_img_n)
+{
+   uint32 pixel_count = a->s->img_x * a->s->img_y;
+   uint8 *temp_out = (uint8 *) malloc(pixel_count * pal_img_n);
+   if (temp_out == NULL) return e("outofmem", "Out of memory");
+
+   expand_palette_row(temp_out, a->out, pixel_count, palette, pal_img_n);
    free(a->out);
    a->out = temp_out;
 
@@ -2631,13 +2830,11 @@ void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
    stbi_de_iphone_flag = flag_true_if_should_convert;
 }
 
-static void stbi_de_iphone(png *z)
+static void stbi_de_iphone(uint8 *p, uint32 pixel_count, int out_n)
 {
-   stbi *s = z->s;
-   uint32 i, pixel_count = s->img_x * s->img_y;
-   uint8 *p = z->out;
+   uint32 i;
 
-   if (s->img_out_n == 3) {  // convert bgr to rgb
+   if (out_n == 3) {  // convert bgr to rgb
       for (i=0; i < pixel_count; ++i) {
          uint8 t = p[0];
          p[0] = p[2];
@@ -2645,7 +2842,7 @@ static void stbi_de_iphone(png *z)
          p += 3;
       }
    } else {
-      assert(s->img_out_n == 4);
+      assert(out_n == 4);
       if (stbi_unpremultiply_on_load) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
@@ -2673,6 +2870,103 @@ static void stbi_de_iphone(png *z)
    }
 }
 
+// gk3d: a non-interlaced png inflating into a row sink
+typedef struct
+{
+   png *z;
+   uint8 *lines;      // two unfiltered rows, alternately the current one and the one above
+   uint8 *pal_line;   // a row expanded from the palette
+   uint32 rows;       // rows handed over so far
+   int out_n;         // channels of unfiltered rows, with the alpha of a tRNS chunk
+   int final_n;       // channels handed over
+   int iphone, has_trans, pal_img_n;
+   uint8 *tc, *palette;
+} png_stream;
+
+// unfilters and hands over the rows inflated up to zout
+static int png_stream_rows(void *state, char *zout)
+{
+   png_stream *ps = (png_stream *) state;
+   png *z = ps->z;
+   stbi *s = z->s;
+   uint32 x = s->img_x, raw_stride = s->img_n * x + 1, line = x * ps->out_n;
+   uint32 inflated = (uint32) ((uint8 *) zout - z->expanded) / raw_stride;
+   uint32 first = ps->rows;
+   if (inflated > s->img_y) inflated = s->img_y;
+
+   for (; ps->rows < inflated; ++ps->rows) {
+      uint8 *cur   = ps->lines + (ps->rows & 1) * line;
+      uint8 *prior = ps->lines + (~ps->rows & 1) * line;
+      uint8 *src = cur, *dest;
+      int src_n = ps->out_n;
+      if (!png_unfilter_row(cur, prior, z->expanded + ps->rows * raw_stride, ps->rows == 0, s->img_n, ps->out_n, x))
+         return 0;
+      if (ps->has_trans)
+         compute_transparency(cur, x, ps->tc, ps->out_n);
+      if (ps->iphone && ps->out_n > 2)
+         stbi_de_iphone(cur, x, ps->out_n);
+      if (ps->pal_img_n) {
+         expand_palette_row(ps->pal_line, cur, x, ps->palette, ps->pal_img_n);
+         src = ps->pal_line;
+         src_n = ps->pal_img_n;
+      }
+      dest = z->sink->row(z->sink_user, ps->rows);
+      if (!dest) return e("stopped", "Decoding stopped");
+      if (src_n == ps->final_n)
+         memcpy(dest, src, x * src_n);
+      else
+         convert_row(src, src_n, dest, ps->final_n, x);
+   }
+
+   if (ps->rows > first && !z->sink->rows_done(z->sink_user, ps->rows)) return e("stopped", "Decoding stopped");
+   return 1;
+}
+
+// inflates the ioff bytes of idata, handing rows to the sink as they come out of each block;
+// the inflated image is the window back references point into, so it is sized up front
+static int stream_png_image(png *z, uint32 ioff, int iphone, int has_trans, uint8 tc[3], uint8 *palette, int pal_img_n, int req_comp)
+{
+   stbi *s = z->s;
+   uint32 raw_len = (s->img_n * s->img_x + 1) * s->img_y;
+   png_stream ps;
+   zbuf a;
+   int ok;
+
+   ps.z = z;
+   ps.rows = 0;
+   ps.out_n = has_trans ? s->img_n+1 : s->img_n;
+   ps.final_n = req_comp ? req_comp : (pal_img_n ? pal_img_n : ps.out_n);
+   ps.iphone = iphone;
+   ps.has_trans = has_trans;
+   ps.pal_img_n = pal_img_n;
+   ps.tc = tc;
+   ps.palette = palette;
+   if (!z->sink->begin(z->sink_user, s->img_x, s->img_y, ps.final_n)) return e("stopped", "Decoding stopped");
+
+   z->expanded = (uint8 *) malloc(raw_len);
+   ps.lines = (uint8 *) malloc(2 * s->img_x * ps.out_n);
+   ps.pal_line = pal_img_n ? (uint8 *) malloc(s->img_x * pal_img_n) : NULL;
+   if (!z->expanded || !ps.lines || (pal_img_n && !ps.pal_line)) {
+      ok = e("outofmem", "Out of memory");
+   } else {
+      a.zbuffer = z->idata;
+      a.zbuffer_end = z->idata + ioff;
+      a.zout_start = a.zout = (char *) z->expanded;
+      a.zout_end = a.zout_start + raw_len;
+      a.z_expandable = 0;
+      a.progress = png_stream_rows;
+      a.progress_user = &ps;
+      ok = parse_zlib(&a, !iphone);
+      if (ok && ps.rows < s->img_y) ok = e("not enough pixels","Corrupt PNG");
+   }
+   free(ps.lines);
+   free(ps.pal_line);
+
+   if (pal_img_n) s->img_n = pal_img_n;
+   s->img_out_n = ps.final_n;
+   return ok;
+}
+
 static int parse_png_file(png *z, int scan, int req_comp)
 {
    uint8 palette[1024], pal_img_n=0;
@@ -2780,6 +3074,8 @@ static int parse_png_file(png *z, int scan, int req_comp)
             if (first) return e("first not IHDR", "Corrupt PNG");
             if (scan != SCAN_load) return 1;
             if (z->idata == NULL) return e("no IDAT","Corrupt PNG");
+            if (z->sink && !interlace)
+               return stream_png_image(z, ioff, iphone, has_trans, tc, palette, pal_img_n, req_comp);
             z->expanded = (uint8 *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, 16384, (int *) &raw_len, !iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
             free(z->idata); z->idata = NULL;
@@ -2789,9 +3085,9 @@ static int parse_png_file(png *z, int scan, int req_comp)
                s->img_out_n = s->img_n;
             if (!create_png_image(z, z->expanded, raw_len, s->img_out_n, interlace)) return 0;
             if (has_trans)
-               if (!compute_transparency(z, tc, s->img_out_n)) return 0;
+               if (!compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
             if (iphone && s->img_out_n > 2)
-               stbi_de_iphone(z);
+               stbi_de_iphone(z->out, s->img_x * s->img_y, s->img_out_n);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
                s->img_n = pal_img_n; // record the actual colors we had
@@ -2853,9 +3149,27 @@ static unsigned char *stbi_png_load(stbi *s, int *x, int *y, int *comp, int req_
 {
    png p;
    p.s = s;
+   p.sink = NULL;
    return do_png(&p, x,y,comp,req_comp);
 }
 
+static int stbi_png_load_rows(stbi *s, int req_comp, stbi_row_sink const *sink, void *user)
+{
+   png p;
+   int ok;
+   p.s = s;
+   p.sink = sink;
+   p.sink_user = user;
+   ok = parse_png_file(&p, SCAN_load, req_comp);
+   // interlaced images are not streamed, they come out whole
+   if (ok && p.out)
+      ok = write_rows(p.out, s->img_x, s->img_y, s->img_out_n, req_comp, sink, user);
+   free(p.out);
+   free(p.expanded);
+   free(p.idata);
+   return ok;
+}
+
 static int stbi_png_test(stbi *s)
 {
    int r;
@@ -2880,6 +3194,7 @@ static int      stbi_png_info(stbi *s, int *x, int *y, int *comp)
 {
    png p;
    p.s = s;
+   p.sink = NULL;
    return stbi_png_info_raw(&p, x, y, comp);
 }
 